@@ -0,0 +1,40 @@
+#include "VMRender.hpp"
+#include "VMLink.hpp"
+#include "SerializeInstruction.hpp"
+#include "SerializeData.hpp"
+#include "EvalBenchmark.hpp"
+
+#include <functional>
+
+int main(int argc, char const *const *argv) {
+  using vm::unserialize::package;
+  using vm::unserialize::data;
+  
+  typedef std::function<void(vm::Data const &)> Evaluate;
+  typedef std::function<Evaluate(vm::Package &)> Variant;
+  
+  // Render ten seconds at 48kHz from the example's start time and time step, long enough
+  // for every thread to take several blocks. The example's sample count is ignored.
+  uint64_t const sampleCount = 10 * 48000;
+  
+  auto renderer = [=](unsigned threadCount) -> Variant {
+    return [=](vm::Package &package) -> Evaluate {
+      auto arena = std::make_shared<Arena>();
+      auto linked = std::make_shared<vm::Package>(vm::link(&package, arena.get()));
+      auto renderer = std::make_shared<vm::Renderer>(linked.get(), threadCount);
+      auto output = std::make_shared<std::vector<float>>(sampleCount);
+      
+      // Hold on to the linked package, which the renderer refers to.
+      return [arena, linked, renderer, output, sampleCount](vm::Data const &params) {
+        renderer->render(Symbol::get("main"), params.values[0].f32, params.values[1].f32, output->data(), sampleCount);
+      };
+    };
+  };
+  
+  return evalBenchmark<vm::Package, vm::Data, Variant>(argc, argv, package, data, 20, {
+    {"1-thread", renderer(1)},
+    {"2-threads", renderer(2)},
+    {"4-threads", renderer(4)},
+    {"auto", renderer(vm::AutoThreadCount)},
+  });
+}
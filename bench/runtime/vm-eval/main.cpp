@@ -0,0 +1,53 @@
+#include "VMEval.hpp"
+#include "VMLink.hpp"
+#include "SerializeInstruction.hpp"
+#include "SerializeData.hpp"
+#include "EvalBenchmark.hpp"
+
+#include <functional>
+
+int main(int argc, char const *const *argv) {
+  using vm::unserialize::package;
+  using vm::unserialize::data;
+  
+  typedef std::function<void(vm::Data const &)> Evaluate;
+  typedef std::function<Evaluate(vm::Package &)> Variant;
+  
+  // Small stacks, so that allocating them doesn't dominate the one-shot timings.
+  size_t const stackSize = 256;
+  
+  // Evaluate via the one-shot entry point, which sets up a fresh VM each time.
+  auto oneShot = [=](vm::Dispatch dispatch) -> Variant {
+    return [=](vm::Package &package) -> Evaluate {
+      return [=, &package](vm::Data const &params) {
+        vm::eval(&package, Symbol::get("main"), params, stackSize, dispatch);
+      };
+    };
+  };
+  
+  // Render repeatedly into the same buffer using a persistent context.
+  auto context = [=](vm::Dispatch dispatch, uint32_t tileSamples) -> Variant {
+    return [=](vm::Package &package) -> Evaluate {
+      auto arena = std::make_shared<Arena>();
+      auto linked = std::make_shared<vm::Package>(vm::link(&package, arena.get()));
+      auto context = std::make_shared<vm::Context>(linked.get(), stackSize, dispatch, true, tileSamples);
+      auto output = std::make_shared<std::vector<float>>();
+      
+      // Hold on to the linked package, which the context refers to.
+      return [arena, linked, context, output](vm::Data const &params) {
+        output->resize(params.sampleCount());
+        context->render(Symbol::get("main"), (float const *)params.values.data(), output->data(), params.sampleCount());
+      };
+    };
+  };
+  
+  return evalBenchmark<vm::Package, vm::Data, Variant>(argc, argv, package, data, 200000, {
+    {"switch", oneShot(vm::SwitchDispatch)},
+    {"threaded", oneShot(vm::ThreadedDispatch)},
+    {"ctx-switch", context(vm::SwitchDispatch, vm::WholeBlock)},
+    {"ctx-threaded", context(vm::ThreadedDispatch, vm::WholeBlock)},
+    {"ctx-tiled", context(vm::ThreadedDispatch, vm::AutoTileSize)},
+    {"ctx-closure", context(vm::ClosureDispatch, vm::WholeBlock)},
+    {"ctx-jit", context(vm::JitDispatch, vm::WholeBlock)},
+  });
+}
@@ -9,7 +9,7 @@
 namespace ast {
   struct Expression;
   struct Apply;
-
+  
   struct Declaration {
     Symbol name;
     Expression const *value;
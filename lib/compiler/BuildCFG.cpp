@@ -2,6 +2,8 @@
 #include "Type.hpp"
 #include "Intrinsics.hpp"
 
+#include <algorithm>
+#include <functional>
 #include <sstream>
 
 namespace {
@@ -18,7 +20,7 @@ namespace {
    functions as part of the BuildCFG transformation by instantiating the most
    specific variant of the function that satisfied all type constraints.
    */
-
+  
   
   
   /** Context Types **/
@@ -131,14 +133,14 @@ namespace {
                      s->params.end(),
                      std::back_inserter(params),
                      std::bind(&ScopeContext::build, context, _1, type::AnyType::get()));
-      
+                     
       // Construct function type constraint
       Arena::vector<type::Type const *> paramTypes(context->arena->allocator<type::Type const *>());
       std::transform(params.begin(),
                      params.end(),
                      std::back_inserter(paramTypes),
                      std::bind(&cfg::Value::typeInFunction, _1, context->function));
-      
+                     
       // Reify the called function
       auto fnType = create<type::Function>(requestedType, paramTypes);
       auto fnSite = context->build(s->function, fnType);
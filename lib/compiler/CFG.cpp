@@ -12,6 +12,10 @@ namespace cfg {
     visitor->acceptBinaryOp(this);
   }
   
+  void UnaryOp::visit(Value::Visitor *visitor) const {
+    visitor->acceptUnaryOp(this);
+  }
+  
   void ParamRef::visit(Value::Visitor *visitor) const {
     visitor->acceptParamRef(this);
   }
@@ -24,6 +28,14 @@ namespace cfg {
     visitor->acceptFPValue(this);
   }
   
+  void TableRef::visit(Value::Visitor *visitor) const {
+    visitor->acceptTableRef(this);
+  }
+  
+  void Select::visit(Value::Visitor *visitor) const {
+    visitor->acceptSelect(this);
+  }
+  
   void CallFunc::visit(Value::MutatingVisitor *visitor) {
     visitor->acceptCall(this);
   }
@@ -32,6 +44,10 @@ namespace cfg {
     visitor->acceptBinaryOp(this);
   }
   
+  void UnaryOp::visit(Value::MutatingVisitor *visitor) {
+    visitor->acceptUnaryOp(this);
+  }
+  
   void ParamRef::visit(Value::MutatingVisitor *visitor) {
     visitor->acceptParamRef(this);
   }
@@ -44,13 +60,21 @@ namespace cfg {
     visitor->acceptFPValue(this);
   }
   
+  void TableRef::visit(Value::MutatingVisitor *visitor) {
+    visitor->acceptTableRef(this);
+  }
+  
+  void Select::visit(Value::MutatingVisitor *visitor) {
+    visitor->acceptSelect(this);
+  }
+  
   
   /** Comparisons **/
   bool Package::operator==(Package const &rhs) const {
     return equalCollections(functions, rhs.functions, [&](Record const &record, Record const &) {
       auto it = rhs.functions.find(record.first);
       return it != rhs.functions.end() && *it->second == *record.second;
-    });
+    }) && tables == rhs.tables;
   }
   
   bool CallFunc::operator==(Value const &rhs) const {
@@ -72,6 +96,15 @@ namespace cfg {
     ;
   }
   
+  bool UnaryOp::operator==(Value const &rhs) const {
+    auto that = dynamic_cast<UnaryOp const *>(&rhs);
+    if (!that) return false;
+    
+    return this->operation == that->operation
+    && *this->operand == *that->operand
+    ;
+  }
+  
   bool ParamRef::operator==(Value const &rhs) const {
     auto that = dynamic_cast<ParamRef const *>(&rhs);
     if (!that) return false;
@@ -93,6 +126,23 @@ namespace cfg {
     return this->value == that->value;
   }
   
+  bool TableRef::operator==(Value const &rhs) const {
+    auto that = dynamic_cast<TableRef const *>(&rhs);
+    if (!that) return false;
+    
+    return this->name == that->name;
+  }
+  
+  bool Select::operator==(Value const &rhs) const {
+    auto that = dynamic_cast<Select const *>(&rhs);
+    if (!that) return false;
+    
+    return *this->condition == *that->condition
+    && *this->ifTrue == *that->ifTrue
+    && *this->ifFalse == *that->ifFalse
+    ;
+  }
+  
   
   /** Types **/
   
@@ -105,6 +155,10 @@ namespace cfg {
     return type::intersectionType(lhs->typeInFunction(fn), rhs->typeInFunction(fn));
   }
   
+  type::Type const *UnaryOp::typeInFunction(type::Function const *fn) const {
+    return operand->typeInFunction(fn);
+  }
+  
   type::Function const *FunctionRef::typeInFunction(type::Function const *fn) const {
     return type;
   }
@@ -117,6 +171,16 @@ namespace cfg {
     return type::F32();
   }
   
+  // Tables are referenced by their index, a scalar.
+  type::Type const *TableRef::typeInFunction(type::Function const *fn) const {
+    return type::F32();
+  }
+  
+  type::Type const *Select::typeInFunction(type::Function const *fn) const {
+    auto arms = type::intersectionType(ifTrue->typeInFunction(fn), ifFalse->typeInFunction(fn));
+    return type::intersectionType(condition->typeInFunction(fn), arms);
+  }
+  
   
   /** Properties **/
   
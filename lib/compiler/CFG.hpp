@@ -27,10 +27,14 @@ namespace cfg {
     
     Package(Arena *arena)
     : functions(arena->allocator<Record>())
+    , tables(arena->allocator<vm::Table>())
     {}
     
     Arena::unordered_map<TypedSymbol, Value *> functions;
     
+    // Read-only tables referenced by TableRef values, copied into the generated package.
+    Arena::vector<vm::Table> tables;
+    
     bool operator==(Package const &rhs) const;
     
     inline bool operator!=(Package const &rhs) {
@@ -70,6 +74,31 @@ namespace cfg {
     virtual type::Type const *typeInFunction(type::Function const *fn) const;
   };
   
+  struct UnaryOp : Value {
+    vm::Instruction::Opcode operation;
+    Value *operand;
+    
+    virtual void visit(Visitor *visitor) const;
+    virtual void visit(MutatingVisitor *visitor);
+    virtual bool operator==(Value const &rhs) const;
+    
+    virtual type::Type const *typeInFunction(type::Function const *fn) const;
+  };
+  
+  // Choice of `ifTrue` for each sample where `condition` is greater than zero, and
+  // `ifFalse` elsewhere.
+  struct Select : Value {
+    Value *condition;
+    Value *ifTrue;
+    Value *ifFalse;
+    
+    virtual void visit(Visitor *visitor) const;
+    virtual void visit(MutatingVisitor *visitor);
+    virtual bool operator==(Value const &rhs) const;
+    
+    virtual type::Type const *typeInFunction(type::Function const *fn) const;
+  };
+  
   struct FunctionRef : Value {
     Symbol name;
     type::Function const *type;
@@ -81,6 +110,17 @@ namespace cfg {
     virtual type::Function const *typeInFunction(type::Function const *fn) const;
   };
   
+  // Reference to a package table, as the table operand of a table lookup op.
+  struct TableRef : Value {
+    Symbol name;
+    
+    virtual void visit(Visitor *visitor) const;
+    virtual void visit(MutatingVisitor *visitor);
+    virtual bool operator==(Value const &rhs) const;
+    
+    virtual type::Type const *typeInFunction(type::Function const *fn) const;
+  };
+  
   struct IndirectValue : Value {
     Value *actualValue;
     
@@ -124,16 +164,22 @@ namespace cfg {
   struct Value::Visitor {
     virtual void acceptCall(CallFunc const *v) = 0;
     virtual void acceptBinaryOp(BinaryOp const *v) = 0;
+    virtual void acceptUnaryOp(UnaryOp const *v) = 0;
     virtual void acceptFunctionRef(FunctionRef const *v) = 0;
     virtual void acceptParamRef(ParamRef const *v) = 0;
     virtual void acceptFPValue(FPValue const *v) = 0;
+    virtual void acceptTableRef(TableRef const *v) = 0;
+    virtual void acceptSelect(Select const *v) = 0;
   };
   
   struct Value::MutatingVisitor {
     virtual void acceptCall(CallFunc *v) = 0;
     virtual void acceptBinaryOp(BinaryOp *v) = 0;
+    virtual void acceptUnaryOp(UnaryOp *v) = 0;
     virtual void acceptFunctionRef(FunctionRef *v) = 0;
     virtual void acceptParamRef(ParamRef *v) = 0;
     virtual void acceptFPValue(FPValue *v) = 0;
+    virtual void acceptTableRef(TableRef *v) = 0;
+    virtual void acceptSelect(Select *v) = 0;
   };
 };
@@ -0,0 +1,175 @@
+#include "CSE-CFG.hpp"
+#include "Type.hpp"
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+  // Structural identity of a CFG node, given the canonical nodes of its children.
+  struct NodeKey {
+    enum Kind {
+      Call, BinaryOp, UnaryOp, FunctionRef, ParamRef, FPValue, TableRef, Select
+    };
+    
+    Kind kind;
+    
+    // Opcode (BinaryOp, UnaryOp), index (ParamRef) or bit pattern (FPValue).
+    uint64_t payload = 0;
+    
+    // Function name and type (FunctionRef), or table name (TableRef)
+    Symbol name;
+    type::Type const *type = nullptr;
+    
+    // Canonical child nodes
+    std::vector<cfg::Value *> children;
+    
+    bool operator==(NodeKey const &rhs) const {
+      return kind == rhs.kind
+      && payload == rhs.payload
+      && name == rhs.name
+      && (type == rhs.type || (type && rhs.type && *type == *rhs.type))
+      && children == rhs.children
+      ;
+    }
+  };
+  
+  struct HashNodeKey {
+    size_t operator()(NodeKey const &key) const {
+      size_t hash = std::hash<uint64_t>()(key.payload) ^ ((size_t)key.kind << 24);
+      
+      if (key.type) {
+        hash ^= key.type->hashValue();
+      }
+      
+      hash ^= std::hash<Symbol>()(key.name);
+      
+      for (auto child : key.children) {
+        hash = (hash * 31) ^ std::hash<cfg::Value *>()(child);
+      }
+      
+      return hash;
+    }
+  };
+  
+  
+  // CFG visitor replacing each node with the first structurally identical node
+  // seen within the function.
+  struct HashCons : cfg::Value::MutatingVisitor {
+    // Canonical node for each node key
+    std::unordered_map<NodeKey, cfg::Value *, HashNodeKey> canonical;
+    
+    // Canonical node for each visited node, so shared nodes are only visited once.
+    std::unordered_map<cfg::Value *, cfg::Value *> visited;
+    
+    // Canonical node for the most recently visited value.
+    cfg::Value *result = nullptr;
+    
+    // Return the canonical node for `v`, after canonicalizing its children.
+    cfg::Value *rewrite(cfg::Value *v) {
+      auto hit = visited.find(v);
+      if (hit != visited.end()) {
+        return hit->second;
+      }
+      
+      v->visit(this);
+      visited[v] = result;
+      
+      return result;
+    }
+    
+    virtual void acceptCall(cfg::CallFunc *v) {
+      NodeKey key = {NodeKey::Call};
+      
+      v->function = rewrite(v->function);
+      key.children.push_back(v->function);
+      
+      for (auto &p : v->params) {
+        p = rewrite(p);
+        key.children.push_back(p);
+      }
+      
+      intern(key, v);
+    }
+    
+    virtual void acceptBinaryOp(cfg::BinaryOp *v) {
+      NodeKey key = {NodeKey::BinaryOp};
+      key.payload = v->operation;
+      
+      v->lhs = rewrite(v->lhs);
+      v->rhs = rewrite(v->rhs);
+      key.children = {v->lhs, v->rhs};
+      
+      intern(key, v);
+    }
+    
+    virtual void acceptUnaryOp(cfg::UnaryOp *v) {
+      NodeKey key = {NodeKey::UnaryOp};
+      key.payload = v->operation;
+      
+      v->operand = rewrite(v->operand);
+      key.children = {v->operand};
+      
+      intern(key, v);
+    }
+    
+    virtual void acceptSelect(cfg::Select *v) {
+      NodeKey key = {NodeKey::Select};
+      
+      v->condition = rewrite(v->condition);
+      v->ifTrue = rewrite(v->ifTrue);
+      v->ifFalse = rewrite(v->ifFalse);
+      key.children = {v->condition, v->ifTrue, v->ifFalse};
+      
+      intern(key, v);
+    }
+    
+    virtual void acceptFunctionRef(cfg::FunctionRef *v) {
+      NodeKey key = {NodeKey::FunctionRef};
+      key.name = v->name;
+      key.type = v->type;
+      
+      intern(key, v);
+    }
+    
+    virtual void acceptParamRef(cfg::ParamRef *v) {
+      NodeKey key = {NodeKey::ParamRef};
+      key.payload = v->index;
+      
+      intern(key, v);
+    }
+    
+    virtual void acceptFPValue(cfg::FPValue *v) {
+      NodeKey key = {NodeKey::FPValue};
+      static_assert(sizeof(v->value) == sizeof(key.payload), "FP value should fit in payload");
+      memcpy(&key.payload, &v->value, sizeof(v->value));
+      
+      intern(key, v);
+    }
+    
+    virtual void acceptTableRef(cfg::TableRef *v) {
+      NodeKey key = {NodeKey::TableRef};
+      key.name = v->name;
+      
+      intern(key, v);
+    }
+    
+    // Set the result to the canonical node for `key`, registering `v` as canonical
+    // if there is none.
+    void intern(NodeKey const &key, cfg::Value *v) {
+      auto hit = canonical.insert(std::make_pair(key, v));
+      result = hit.first->second;
+    }
+  };
+}
+
+namespace compiler {
+  void cseCFG(Arena *arena, cfg::Package *package) {
+    for (auto &fn : package->functions) {
+      // Parameter references are only equivalent within a function, so each function
+      // is hash-consed separately.
+      HashCons visitor;
+      fn.second = visitor.rewrite(fn.second);
+    }
+  }
+}
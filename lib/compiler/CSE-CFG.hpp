@@ -0,0 +1,12 @@
+#pragma once
+
+#include "CFG.hpp"
+
+namespace compiler {
+  // Eliminate common subexpressions by hash-consing each function's CFG.
+  //
+  // Structurally identical values within a function are replaced by a single
+  // shared node, turning the function's tree into a DAG. This is valid since Tempo
+  // functions are pure. Codegen evaluates each shared node once per call.
+  void cseCFG(Arena *arena, cfg::Package *package);
+}
@@ -1,6 +1,10 @@
 #include "Codegen.hpp"
+#include "SimplifyCFG.hpp"
+#include "VMStackDepth.hpp"
 
+#include <algorithm>
 #include <sstream>
+#include <vector>
 
 using vm::Instruction;
 using vm::Data;
@@ -22,10 +26,65 @@ namespace {
     return isVector ? VectorReturn : 0;
   }
   
+  // Operations with a variant that writes to its top operand's buffer.
+  struct InPlaceVariant {
+    Instruction::Opcode opcode;
+    Instruction::Opcode inPlace;
+  };
+  
+  InPlaceVariant const InPlaceVariants[] = {
+    {Instruction::ADD_VV, Instruction::ADD_VV_INPLACE},
+    {Instruction::ADD_VS, Instruction::ADD_VS_INPLACE},
+    {Instruction::MUL_VV, Instruction::MUL_VV_INPLACE},
+    {Instruction::MUL_VS, Instruction::MUL_VS_INPLACE},
+  };
+  
+  // Return the in-place variant of `opcode`, or `opcode` if it has none.
+  Instruction::Opcode inPlaceVariant(Instruction::Opcode opcode) {
+    for (auto &variant : InPlaceVariants) {
+      if (variant.opcode == opcode) {
+        return variant.inPlace;
+      }
+    }
+    
+    return opcode;
+  }
+  
+  // Commutative binary operations with mixed operand types, and the variant taking them
+  // swapped, which gives the same result.
+  struct CommutedVariant {
+    Instruction::Opcode opcode;
+    Instruction::Opcode commuted;
+  };
+  
+  CommutedVariant const CommutedVariants[] = {
+    {Instruction::ADD_VS, Instruction::ADD_SV},
+    {Instruction::ADD_SV, Instruction::ADD_VS},
+    {Instruction::MUL_VS, Instruction::MUL_SV},
+    {Instruction::MUL_SV, Instruction::MUL_VS},
+  };
+  
+  // Return the variant of `opcode` taking its operands swapped.
+  Instruction::Opcode commutedVariant(Instruction::Opcode opcode) {
+    for (auto &variant : CommutedVariants) {
+      if (variant.opcode == opcode) {
+        return variant.commuted;
+      }
+    }
+    
+    return opcode;
+  }
+  
+  // Largest # CFG nodes in both arms of a select that is branched, which emits each arm
+  // twice (see `CodegenValue::isBranched`).
+  uint32_t const MaxBranchedArmsSize = 32;
+  
   // Function-level codegen context.
   struct CodegenFunction {
     CodegenFunction(Arena *arena)
-    : unusedParams(arena->allocator<uint32_t>())
+    : locals(arena->allocator<decltype(locals)::value_type>())
+    , vectorsNeeded(arena->allocator<decltype(vectorsNeeded)::value_type>())
+    , armSizes(arena->allocator<decltype(armSizes)::value_type>())
     {}
     
     // Code output.
@@ -40,9 +99,88 @@ namespace {
     // Value is invalid after code is emitted for a function's root cfg node.
     uint32_t stackSize = 0;
     
-    // Set of unused function parameters. Used to determine stack cleanup
-    // on exit.
-    Arena::unordered_set<uint32_t> unusedParams;
+    // CFG nodes shared by multiple parents, which are evaluated once on function
+    // entry and kept on the stack above the parameters until the function returns.
+    //
+    // Maps each node to its position on the stack (equal to `stackSize` after it was
+    // pushed).
+    Arena::unordered_map<cfg::Value const *, uint32_t> locals;
+    
+    // Memoized results of `CodegenValue::vectorsNeeded`.
+    Arena::unordered_map<cfg::Value const *, uint32_t> vectorsNeeded;
+    
+    // Memoized results of `CodegenValue::armSize`.
+    Arena::unordered_map<cfg::Value const *, uint32_t> armSizes;
+  };
+  
+  
+  // CFG visitor finding the nodes in a function that should be evaluated once and
+  // shared between their parents.
+  struct FindSharedValues : cfg::Value::Visitor {
+    FindSharedValues(Arena *arena)
+    : referenceCounts(arena->allocator<decltype(referenceCounts)::value_type>())
+    , order(arena->allocator<cfg::Value const *>())
+    {}
+    
+    // # parents referencing each node
+    Arena::unordered_map<cfg::Value const *, size_t> referenceCounts;
+    
+    // Non-trivial nodes, with each node following the nodes it depends on.
+    Arena::vector<cfg::Value const *> order;
+    
+    // Return the non-trivial nodes referenced by more than one parent, with each node
+    // following the nodes it depends on.
+    Arena::vector<cfg::Value const *> sharedValues() const {
+      Arena::vector<cfg::Value const *> result(order.get_allocator());
+      
+      for (auto v : order) {
+        if (referenceCounts.at(v) > 1) {
+          result.push_back(v);
+        }
+      }
+      
+      return result;
+    }
+    
+    // Count a reference to `v` and visit it if this is the first.
+    void reference(cfg::Value const *v) {
+      if (referenceCounts[v]++ == 0) {
+        v->visit(this);
+      }
+    }
+    
+    virtual void acceptCall(cfg::CallFunc const *v) {
+      for (auto p : v->params) {
+        reference(p);
+      }
+      
+      reference(v->function);
+      order.push_back(v);
+    }
+    
+    virtual void acceptBinaryOp(cfg::BinaryOp const *v) {
+      reference(v->rhs);
+      reference(v->lhs);
+      order.push_back(v);
+    }
+    
+    virtual void acceptUnaryOp(cfg::UnaryOp const *v) {
+      reference(v->operand);
+      order.push_back(v);
+    }
+    
+    virtual void acceptSelect(cfg::Select const *v) {
+      reference(v->ifFalse);
+      reference(v->ifTrue);
+      reference(v->condition);
+      order.push_back(v);
+    }
+    
+    // Trivial values are cheaper to re-emit than to share.
+    virtual void acceptFunctionRef(cfg::FunctionRef const *v) {}
+    virtual void acceptParamRef(cfg::ParamRef const *v) {}
+    virtual void acceptFPValue(cfg::FPValue const *v) {}
+    virtual void acceptTableRef(cfg::TableRef const *v) {}
   };
   
   class CodegenValue : public cfg::Value::Visitor {
@@ -72,19 +210,75 @@ namespace {
       
       emit(Instruction(Instruction::CALL, popCount()),
            vecFlag(v->hasVectorReturnInFunction(context->type)));
-      
+           
       popOperands(v->params.size() + 1);
     }
     
     
     virtual void acceptBinaryOp(cfg::BinaryOp const *v) {
-      emit(v->rhs);
-      emit(v->lhs);
+      // Operands are evaluated right to left, unless the left needs enough more vectors that
+      // evaluating it first lowers the peak. The operation then takes its operands swapped.
+      auto swap = isSwapped(v);
+      
+      auto lhs = swap ? v->rhs : v->lhs;
+      auto rhs = swap ? v->lhs : v->rhs;
+      auto operation = swap ? commutedVariant(v->operation) : v->operation;
+      
+      emit(rhs);
+      emit(lhs);
+      
+      // The result of a function's root node is written below its parameters, so can't
+      // reuse an operand's buffer.
+      auto inPlace = !returnNode && isTemporaryVector(lhs) && !mayBeStrongVector(rhs);
+      auto opcode = inPlace ? inPlaceVariant(operation) : operation;
+      
+      emit(Instruction(opcode, popCount()),
+           vecFlag(v->typeInFunction(context->type)->isVector()));
+           
+      popOperands(2);
+    }
+    
+    virtual void acceptUnaryOp(cfg::UnaryOp const *v) {
+      emit(v->operand);
       
       emit(Instruction(v->operation, popCount()),
            vecFlag(v->typeInFunction(context->type)->isVector()));
+           
+      popOperands(1);
+    }
+    
+    // The condition is evaluated last, so is the top operand. Vector variants take a
+    // vector condition, so a scalar condition choosing between vectors is filled.
+    virtual void acceptSelect(cfg::Select const *v) {
+      if (isBranched(v)) {
+        emitBranches(v);
+        return;
+      }
       
-      popOperands(2);
+      auto vectorCondition = v->condition->typeInFunction(context->type)->isVector();
+      auto vectorTrue = v->ifTrue->typeInFunction(context->type)->isVector();
+      auto vectorFalse = v->ifFalse->typeInFunction(context->type)->isVector();
+      
+      emit(v->ifFalse);
+      emit(v->ifTrue);
+      emit(v->condition);
+      
+      auto opcode = Instruction::SELECT_SSS;
+      
+      if (vectorCondition || vectorTrue || vectorFalse) {
+        if (!vectorCondition) {
+          context->code->push_back(Instruction(Instruction::FILL));
+        }
+        
+        opcode = vectorTrue
+        ? (vectorFalse ? Instruction::SELECT_VVV : Instruction::SELECT_VVS)
+        : (vectorFalse ? Instruction::SELECT_VSV : Instruction::SELECT_VSS);
+      }
+      
+      emit(Instruction(opcode, popCount()),
+           vecFlag(v->typeInFunction(context->type)->isVector()));
+           
+      popOperands(3);
     }
     
     virtual void acceptFunctionRef(cfg::FunctionRef const *v) {
@@ -93,7 +287,7 @@ namespace {
       
       emit(Instruction(Instruction::PUSH_SYM, mangledSym, Data::SymbolValue),
            ExplicitPop);
-      
+           
       pushValue();
     }
     
@@ -103,30 +297,183 @@ namespace {
       if (paramType->isVector()) {
         emit(Instruction(Instruction::REF_VEC, paramOffset(v->index)),
              VectorReturn | ExplicitPop);
-        
+             
       } else {
         emit(Instruction(Instruction::COPY, paramOffset(v->index)),
              ExplicitPop);
       }
       
-      markUsed(v->index);
       pushValue();
     }
     
     virtual void acceptFPValue(cfg::FPValue const *v) {
       emit(Instruction(Instruction::PUSH, v->value, Data::F32Value),
            ExplicitPop);
-      
+           
+      pushValue();
+    }
+    
+    // Tables are pushed by name, which linking replaces with the table's index.
+    virtual void acceptTableRef(cfg::TableRef const *v) {
+      emit(Instruction(Instruction::PUSH_SYM, v->name, Data::SymbolValue),
+           ExplicitPop);
+           
       pushValue();
     }
     
     
     /** Helpers **/
     
+    // True if a select should jump over the arm it doesn't choose when its condition is
+    // the same in every sample, which saves at least one pass over a vector.
+    //
+    // Each arm is emitted twice, so only small arms are branched, and none containing a
+    // branched select of its own, which would double the code again at every level.
+    bool isBranched(cfg::Select const *v) {
+      return v->typeInFunction(context->type)->isVector()
+      && (vectorsNeeded(v->ifTrue) > 0 || vectorsNeeded(v->ifFalse) > 0)
+      && armSize(v->ifTrue) + armSize(v->ifFalse) <= MaxBranchedArmsSize;
+    }
+    
+    // # CFG nodes emitted to evaluate `value`, or more than MaxBranchedArmsSize if it
+    // contains a branched select.
+    uint32_t armSize(cfg::Value const *value) {
+      if (context->locals.find(value) != context->locals.end()) {
+        return 1;
+      }
+      
+      auto cached = context->armSizes.find(value);
+      if (cached != context->armSizes.end()) {
+        return cached->second;
+      }
+      
+      uint32_t size = 1;
+      
+      if (auto op = dynamic_cast<cfg::BinaryOp const *>(value)) {
+        size += armSize(op->lhs) + armSize(op->rhs);
+        
+      } else if (auto unary = dynamic_cast<cfg::UnaryOp const *>(value)) {
+        size += armSize(unary->operand);
+        
+      } else if (auto select = dynamic_cast<cfg::Select const *>(value)) {
+        size = isBranched(select)
+        ? MaxBranchedArmsSize + 1
+        : size + armSize(select->condition) + armSize(select->ifTrue) + armSize(select->ifFalse);
+        
+      } else if (auto call = dynamic_cast<cfg::CallFunc const *>(value)) {
+        size += armSize(call->function);
+        
+        for (auto param : call->params) {
+          size += armSize(param);
+        }
+      }
+      
+      // Saturate, so that sums of a few sizes can't overflow.
+      size = std::min(size, MaxBranchedArmsSize + 1);
+      
+      context->armSizes[value] = size;
+      return size;
+    }
+    
+    // Emit a select as three paths, one evaluating each arm alone and one evaluating
+    // both and selecting between them. The condition is evaluated first:
+    //
+    //     <condition>
+    //     jump_all_false  >false
+    //     jump_all_true   >true
+    //     <ifFalse>
+    //     <ifTrue>
+    //     ref_vec 3
+    //     select_* 1
+    //     jump            >end
+    //   true:
+    //     <ifTrue>
+    //     jump            >end
+    //   false:
+    //     <ifFalse>
+    //   end:
+    //
+    // The conditional jumps pop the condition when taken, and the select pops it too, so
+    // each path leaves one vector in its place. A scalar arm is filled when evaluated
+    // alone, and a scalar condition is filled for the select (though it's always uniform).
+    void emitBranches(cfg::Select const *v) {
+      auto vectorCondition = v->condition->typeInFunction(context->type)->isVector();
+      auto vectorTrue = v->ifTrue->typeInFunction(context->type)->isVector();
+      auto vectorFalse = v->ifFalse->typeInFunction(context->type)->isVector();
+      
+      auto code = context->code;
+      
+      emit(v->condition);
+      auto stackSize = context->stackSize;
+      
+      auto jumpFalse = code->size();
+      code->push_back(Instruction(Instruction::JUMP_ALL_FALSE, 0u));
+      
+      auto jumpTrue = code->size();
+      code->push_back(Instruction(Instruction::JUMP_ALL_TRUE, 0u));
+      
+      emit(v->ifFalse);
+      emit(v->ifTrue);
+      
+      if (vectorCondition) {
+        code->push_back(Instruction(Instruction::REF_VEC, 3u));
+        
+      } else {
+        code->push_back(Instruction(Instruction::COPY, 3u));
+        code->push_back(Instruction(Instruction::FILL));
+      }
+      
+      auto opcode = vectorTrue
+      ? (vectorFalse ? Instruction::SELECT_VVV : Instruction::SELECT_VVS)
+      : (vectorFalse ? Instruction::SELECT_VSV : Instruction::SELECT_VSS);
+      
+      code->push_back(Instruction(opcode, 1u));
+      
+      auto jumpEnd = code->size();
+      code->push_back(Instruction(Instruction::JUMP, 0u));
+      
+      patchJump(jumpTrue);
+      context->stackSize = stackSize - 1;
+      emitFilled(v->ifTrue, vectorTrue);
+      
+      auto jumpTrueEnd = code->size();
+      code->push_back(Instruction(Instruction::JUMP, 0u));
+      
+      patchJump(jumpFalse);
+      context->stackSize = stackSize - 1;
+      emitFilled(v->ifFalse, vectorFalse);
+      
+      patchJump(jumpEnd);
+      patchJump(jumpTrueEnd);
+      context->stackSize = stackSize;
+      
+      // Every path reaches the end, so the function returns from there.
+      if (returnNode) {
+        emit(Instruction(Instruction::DROP_V, popCount()), VectorReturn);
+      }
+    }
+    
+    // Emit `value`, filling it if it's a scalar.
+    void emitFilled(cfg::Value const *value, bool isVector) {
+      emit(value);
+      
+      if (!isVector) {
+        context->code->push_back(Instruction(Instruction::FILL));
+      }
+    }
+    
+    // Point the jump at `jump` to the next instruction emitted.
+    void patchJump(size_t jump) {
+      (*context->code)[jump].operand.u32 = (uint32_t)(context->code->size() - jump);
+    }
+    
     // Number of stack values that need to be popped before returning from
     // the function.
+    //
+    // Parameters and shared values are only ever copied or referenced, so all of them
+    // remain on the stack until the function's result overwrites them.
     uint32_t popCount() {
-      return returnNode ? context->unusedParams.size() : 0;
+      return returnNode ? (uint32_t)(context->type->getArity() + context->locals.size()) : 0;
     }
     
     
@@ -141,14 +488,13 @@ namespace {
           context->code->push_back(Instruction::RET);
           
           auto opcode = (flags & VectorReturn) ? Instruction::DROP_V : Instruction::DROP_S;
-          context->code->push_back(Instruction(opcode, context->unusedParams.size()));
+          context->code->push_back(Instruction(opcode, popCount()));
           
         } else {
           context->code->push_back(Instruction::RET);
           context->code->push_back(inst);
         }
         
-        context->unusedParams.clear();
         context->code->push_back(Instruction::EXIT);
         
       } else {
@@ -159,11 +505,120 @@ namespace {
     }
     
     // Recurse into `value` and emit code at the current insertion point.
+    //
+    // Shared values have already been evaluated, so are copied from the stack.
     void emit(cfg::Value const *value) {
+      auto local = context->locals.find(value);
+      
+      if (local != context->locals.end()) {
+        auto offset = context->stackSize - local->second + 1;
+        
+        if (value->typeInFunction(context->type)->isVector()) {
+          context->code->push_back(Instruction(Instruction::REF_VEC, offset));
+        } else {
+          context->code->push_back(Instruction(Instruction::COPY, offset));
+        }
+        
+        pushValue();
+        return;
+      }
+      
       CodegenValue visitor(context, false);
       value->visit(&visitor);
     }
     
+    // True if evaluating `value` leaves the only reference to a newly allocated vector
+    // on the stack.
+    bool isTemporaryVector(cfg::Value const *value) {
+      return (dynamic_cast<cfg::BinaryOp const *>(value) || dynamic_cast<cfg::UnaryOp const *>(value))
+      && context->locals.find(value) == context->locals.end()
+      && value->typeInFunction(context->type)->isVector();
+    }
+    
+    // True if evaluating `value` may leave a strong vector reference on the stack.
+    //
+    // Parameters and shared values are only ever referenced, but a function may return
+    // either kind of reference.
+    bool mayBeStrongVector(cfg::Value const *value) {
+      return value->typeInFunction(context->type)->isVector()
+      && !dynamic_cast<cfg::ParamRef const *>(value)
+      && context->locals.find(value) == context->locals.end();
+    }
+    
+    // Sethi-Ullman number of `value`, counting only vectors: the peak # vectors allocated
+    // at once while evaluating it, including its result.
+    //
+    // Scalar slots are an eighth of the size of even the smallest vector, so aren't counted.
+    // The vectors a called function allocates are unknown, so only its result is counted.
+    uint32_t vectorsNeeded(cfg::Value const *value) {
+      if (context->locals.find(value) != context->locals.end()) {
+        return 0;
+      }
+      
+      auto cached = context->vectorsNeeded.find(value);
+      if (cached != context->vectorsNeeded.end()) {
+        return cached->second;
+      }
+      
+      uint32_t needed = 0;
+      
+      if (auto op = dynamic_cast<cfg::BinaryOp const *>(value)) {
+        needed = isSwapped(op) ? evaluationCost(op->lhs, op->rhs) : evaluationCost(op->rhs, op->lhs);
+        
+      } else if (auto unary = dynamic_cast<cfg::UnaryOp const *>(value)) {
+        needed = vectorsNeeded(unary->operand);
+        
+      } else if (auto select = dynamic_cast<cfg::Select const *>(value)) {
+        if (isBranched(select)) {
+          // The condition is evaluated first, and held while evaluating both arms.
+          needed = vectorsNeeded(select->condition);
+          needed = std::max(needed, vectorsHeld(select->condition) + evaluationCost(select->ifFalse, select->ifTrue));
+          
+        } else {
+          auto held = vectorsHeld(select->ifFalse);
+          
+          needed = evaluationCost(select->ifFalse, select->ifTrue);
+          needed = std::max(needed, held + vectorsHeld(select->ifTrue) + vectorsNeeded(select->condition));
+        }
+        
+      } else if (auto call = dynamic_cast<cfg::CallFunc const *>(value)) {
+        uint32_t held = 0;
+        
+        for (auto it = call->params.rbegin(); it != call->params.rend(); ++it) {
+          needed = std::max(needed, held + vectorsNeeded(*it));
+          held += vectorsHeld(*it);
+        }
+        
+        needed = std::max(needed, held + vectorsNeeded(call->function));
+        needed = std::max(needed, held + vectorsHeld(call));
+      }
+      
+      needed = std::max(needed, vectorsHeld(value));
+      
+      context->vectorsNeeded[value] = needed;
+      return needed;
+    }
+    
+    // # vectors allocated by evaluating `value` that remain on the stack afterwards.
+    uint32_t vectorsHeld(cfg::Value const *value) {
+      return mayBeStrongVector(value) ? 1 : 0;
+    }
+    
+    // True if a binary operation's left operand should be evaluated first, which is only
+    // possible if the operation commutes.
+    bool isSwapped(cfg::BinaryOp const *op) {
+      auto rule = compiler::binaryOpRule(op->operation);
+      
+      return rule && rule->commutative
+      && evaluationCost(op->lhs, op->rhs) < evaluationCost(op->rhs, op->lhs);
+    }
+    
+    // Peak # vectors allocated at once while evaluating `first` then `second`.
+    
+    uint32_t evaluationCost(cfg::Value const *first, cfg::Value const *second) {
+      return std::max(vectorsNeeded(first), vectorsHeld(first) + vectorsNeeded(second));
+    }
+    
     // Increment runtime stack size counter.
     void pushValue() {
       ++context->stackSize;
@@ -183,35 +638,166 @@ namespace {
     uint32_t paramOffset(uint32_t paramIndex) {
       return context->stackSize + paramIndex + 1;
     }
+  };
+  
+  
+  /** Peephole optimizations **/
+  
+  // A multiply followed by an add, and the multiply-add instruction replacing them.
+  //
+  // The fused instruction can operate in-place if both the multiply and add did, since
+  // then neither the multiply's operands nor the add's other operand are strong references.
+  struct MultiplyAddPattern {
+    Instruction::Opcode multiply, multiplyInPlace;
+    Instruction::Opcode add, addInPlace;
+    Instruction::Opcode fused, fusedInPlace;
+  };
+  
+  MultiplyAddPattern const MultiplyAddPatterns[] = {
+    {Instruction::MUL_VV, Instruction::MUL_VV_INPLACE, Instruction::ADD_VV, Instruction::ADD_VV_INPLACE, Instruction::FMA_VVV, Instruction::FMA_VVV_INPLACE},
+    {Instruction::MUL_VS, Instruction::MUL_VS_INPLACE, Instruction::ADD_VV, Instruction::ADD_VV_INPLACE, Instruction::FMA_VSV, Instruction::FMA_VSV_INPLACE},
+    {Instruction::MUL_VV, Instruction::MUL_VV_INPLACE, Instruction::ADD_VS, Instruction::ADD_VS_INPLACE, Instruction::FMA_VVS, Instruction::FMA_VVS_INPLACE},
+    {Instruction::MUL_VS, Instruction::MUL_VS_INPLACE, Instruction::ADD_VS, Instruction::ADD_VS_INPLACE, Instruction::FMA_VSS, Instruction::FMA_VSS_INPLACE},
+  };
+  
+  // Return the multiply-add instruction equivalent to executing `multiply` then `add`,
+  // or false if there isn't one.
+  bool findMultiplyAdd(Instruction const &multiply, Instruction const &add, Instruction *fused) {
+    for (auto &pattern : MultiplyAddPatterns) {
+      auto multiplyInPlace = multiply.operation == pattern.multiplyInPlace;
+      auto addInPlace = add.operation == pattern.addInPlace;
+      
+      // A multiply popping additional slots is returning from the function, so its result
+      // can't be used by a following add.
+      if (!multiplyInPlace && (multiply.operation != pattern.multiply || multiply.operand.u32 != 0)) {
+        continue;
+      }
+      
+      if (!addInPlace && add.operation != pattern.add) {
+        continue;
+      }
+      
+      auto opcode = (multiplyInPlace && addInPlace) ? pattern.fusedInPlace : pattern.fused;
+      *fused = Instruction(opcode, add.operand.u32);
+      
+      return true;
+    }
     
-    // Mark that a function parameter has been consumed by an operation.
-    void markUsed(uint32_t paramIndex) {
-      assert(returnNode || context->unusedParams.find(paramIndex) != context->unusedParams.end());
-      context->unusedParams.erase(paramIndex);
+    return false;
+  }
+  
+  // Replace each multiply followed by an add with a single multiply-add instruction,
+  // for the code from `start` onwards.
+  //
+  // An add always takes the value at the top of the stack as its lhs, so if it directly
+  // follows a multiply, it adds to the multiply's result. A RET between the two
+  // (emitted when the add is a function's return value) is kept, since it only affects
+  // how many slots the add pops.
+  //
+  // This removes instructions, so must be applied before any code is emitted after
+  // `start` that refers to instruction addresses. Jumps are relative, and are adjusted
+  // for the instructions removed. An add that a jump lands on (or on the RET before it)
+  // may follow other code, so isn't fused.
+  void fuseMultiplyAdd(Arena::vector<Instruction> *code, size_t start) {
+    auto size = code->size();
+    
+    std::vector<bool> isTarget(size - start + 1);
+    for (auto i = start; i < size; ++i) {
+      auto inst = (*code)[i];
+      
+      if (inst.isJump() && i + inst.operand.u32 <= size) {
+        isTarget[i + inst.operand.u32 - start] = true;
+      }
     }
-  };
+    
+    // New position of each instruction, and of the end of the code.
+    std::vector<size_t> moved(size - start + 1);
+    
+    size_t out = start;
+    
+    for (size_t in = start; in < size; ++in) {
+      auto next = in + 1;
+      if (next < size && (*code)[next].operation == Instruction::RET && !isTarget[next - start]) {
+        ++next;
+      }
+      
+      Instruction fused;
+      moved[in - start] = out;
+      
+      if (next < size && !isTarget[next - start] && findMultiplyAdd((*code)[in], (*code)[next], &fused)) {
+        for (auto i = in + 1; i < next; ++i) {
+          moved[i - start] = out;
+          (*code)[out++] = (*code)[i];
+        }
+        
+        moved[next - start] = out;
+        (*code)[out++] = fused;
+        in = next;
+        
+      } else {
+        (*code)[out++] = (*code)[in];
+      }
+    }
+    
+    moved[size - start] = out;
+    
+    // Fused instructions never jump, so each jump moved alone.
+    for (auto in = start; in < size; ++in) {
+      auto &inst = (*code)[moved[in - start]];
+      
+      if (inst.isJump()) {
+        inst.operand.u32 = (uint32_t)(moved[in + inst.operand.u32 - start] - moved[in - start]);
+      }
+    }
+    
+    code->resize(out);
+  }
 }
 
 namespace compiler {
   vm::Package codegen(cfg::Package const *sources, Arena *arena) {
     vm::Package package(arena);
     
+    for (auto &table : sources->tables) {
+      package.tables.push_back(vm::Table(arena, table.name));
+      package.tables.back().samples.assign(table.samples.begin(), table.samples.end());
+    }
+    
     for (auto fn : sources->functions) {
+      auto start = package.code.size();
+      
       auto mangledSym = Symbol::get((std::stringstream() << fn.first).str());
-      package.symbols[mangledSym] = package.code.size();
+      package.symbols[mangledSym] = start;
       
       CodegenFunction context(arena);
       context.code = &package.code;
       context.type = dynamic_cast<type::Function const *>(fn.first.type);
       
-      for (size_t i = 0; i < context.type->getArity(); ++i) {
-        context.unusedParams.insert(i);
+      // Evaluate shared values up front, so that each is only evaluated once.
+      FindSharedValues shared(arena);
+      shared.reference(fn.second);
+      
+      for (auto v : shared.sharedValues()) {
+        CodegenValue local(&context, false);
+        v->visit(&local);
+        
+        context.locals[v] = context.stackSize;
       }
       
       CodegenValue root(&context, true);
       fn.second->visit(&root);
       
-      assert(context.unusedParams.empty());
+      fuseMultiplyAdd(&package.code, start);
+    }
+    
+    // Reject functions whose stack usage can't be bounded, rather than let them overflow
+    // a context's stacks. Functions calling into other packages are analysed once linked.
+    for (auto sym : package.symbols) {
+      vm::StackDepth depth;
+      
+      if (vm::computeStackDepth(&package, sym.first, &depth)) {
+        package.stackDepths[sym.first] = depth;
+      }
     }
     
     return package;
@@ -1,16 +1,19 @@
 #include "GC-CFG.hpp"
 #include "Type.hpp"
 
+#include <algorithm>
 #include <sstream>
 
 // CFG visitor performing mark phase of garbage collection
 struct MarkCFGFunctions : cfg::Value::Visitor {
   MarkCFGFunctions(Arena *arena, cfg::Package *package_)
   : marked(arena->allocator<TypedSymbol>())
+  , markedTables(arena->allocator<Symbol>())
   , package(package_)
   {}
   
   Arena::unordered_set<TypedSymbol> marked;
+  Arena::unordered_set<Symbol> markedTables;
   cfg::Package *package;
   
   virtual void acceptCall(cfg::CallFunc const *v) {
@@ -26,6 +29,16 @@ struct MarkCFGFunctions : cfg::Value::Visitor {
     v->rhs->visit(this);
   }
   
+  virtual void acceptUnaryOp(cfg::UnaryOp const *v) {
+    v->operand->visit(this);
+  }
+  
+  virtual void acceptSelect(cfg::Select const *v) {
+    v->condition->visit(this);
+    v->ifTrue->visit(this);
+    v->ifFalse->visit(this);
+  }
+  
   virtual void acceptFunctionRef(cfg::FunctionRef const *v) {
     TypedSymbol key = {v->type, v->name};
     
@@ -41,11 +54,15 @@ struct MarkCFGFunctions : cfg::Value::Visitor {
   }
   
   virtual void acceptParamRef(cfg::ParamRef const *v) {
-    
+  
   }
   
   virtual void acceptFPValue(cfg::FPValue const *v) {
-    
+  
+  }
+  
+  virtual void acceptTableRef(cfg::TableRef const *v) {
+    markedTables.insert(v->name);
   }
 };
 
@@ -74,5 +91,10 @@ namespace compiler {
         ++it;
       }
     }
+    
+    auto &tables = package->tables;
+    tables.erase(std::remove_if(tables.begin(), tables.end(), [&](vm::Table const &table) {
+      return markVisitor.markedTables.find(table.name) == markVisitor.markedTables.end();
+    }), tables.end());
   }
 }
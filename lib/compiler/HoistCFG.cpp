@@ -0,0 +1,438 @@
+#include "HoistCFG.hpp"
+#include "SimplifyCFG.hpp"
+#include "Type.hpp"
+#include "VMOps.hpp"
+
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+using vm::Instruction;
+
+namespace {
+  // Maximum depth of nested calls evaluated at compile time. Deeper calls are
+  // assumed not to be time-invariant.
+  size_t const MaxCallDepth = 64;
+  
+  // Value of a scalar CFG node, if known at compile time.
+  struct Scalar {
+    bool known;
+    float value;
+  };
+  
+  Scalar const Unknown = {false, 0};
+  
+  // Apply a scalar-scalar binary operation.
+  Scalar evalBinaryOp(Instruction::Opcode op, float lhs, float rhs) {
+    auto rule = compiler::binaryOpRule(op);
+    if (!rule || op != rule->ss) {
+      return Unknown;
+    }
+    
+    return {true, rule->fold(lhs, rhs)};
+  }
+  
+  // Apply a scalar unary operation.
+  Scalar evalUnaryOp(Instruction::Opcode op, float operand) {
+    auto rule = compiler::unaryOpRule(op);
+    if (!rule || op != rule->s) {
+      return Unknown;
+    }
+    
+    return {true, rule->fold(operand)};
+  }
+  
+  
+  // CFG visitor finding the parameters a function's body refers to.
+  struct FindParams : cfg::Value::Visitor {
+    std::unordered_set<size_t> params;
+    std::unordered_set<cfg::Value const *> visited;
+    
+    void find(cfg::Value const *v) {
+      if (visited.insert(v).second) {
+        v->visit(this);
+      }
+    }
+    
+    // Callees have parameters of their own, so only their arguments are searched.
+    virtual void acceptCall(cfg::CallFunc const *v) {
+      for (auto p : v->params) {
+        find(p);
+      }
+    }
+    
+    virtual void acceptBinaryOp(cfg::BinaryOp const *v) {
+      find(v->lhs);
+      find(v->rhs);
+    }
+    
+    virtual void acceptUnaryOp(cfg::UnaryOp const *v) {
+      find(v->operand);
+    }
+    
+    virtual void acceptSelect(cfg::Select const *v) {
+      find(v->condition);
+      find(v->ifTrue);
+      find(v->ifFalse);
+    }
+    
+    virtual void acceptParamRef(cfg::ParamRef const *v) {
+      params.insert(v->index);
+    }
+    
+    virtual void acceptFunctionRef(cfg::FunctionRef const *v) {}
+    virtual void acceptFPValue(cfg::FPValue const *v) {}
+    virtual void acceptTableRef(cfg::TableRef const *v) {}
+  };
+  
+  
+  // Results of calls evaluated so far, shared by every evaluation of a package.
+  //
+  // Functions are pure, so a call with the same arguments always has the same result.
+  // Without this, recursive functions would take exponential time to evaluate.
+  struct CallCache {
+    // Evaluated call: the callee's body, and the bits of each argument (unused ones zero).
+    typedef std::pair<cfg::Value const *, std::vector<uint32_t>> Key;
+    
+    struct Result {
+      Scalar value;
+      size_t operationCount;
+    };
+    
+    std::map<Key, Result> results;
+    
+    // Parameters used by each function body.
+    std::unordered_map<cfg::Value const *, std::unordered_set<size_t>> params;
+    
+    std::unordered_set<size_t> const &usedParams(cfg::Value const *fn) {
+      auto hit = params.find(fn);
+      if (hit != params.end()) {
+        return hit->second;
+      }
+      
+      FindParams finder;
+      finder.find(fn);
+      
+      return params[fn] = std::move(finder.params);
+    }
+  };
+  
+  
+  // CFG visitor evaluating a scalar value at compile time.
+  //
+  // Evaluates the value in the scope of a call with known (or unknown) scalar arguments,
+  // counting the operations that would execute at runtime.
+  struct EvaluateScalar : cfg::Value::Visitor {
+    EvaluateScalar(cfg::Package const *package_, CallCache *calls_, std::vector<Scalar> const *args_, size_t depth_)
+    : package(package_)
+    , calls(calls_)
+    , args(args_)
+    , depth(depth_)
+    {}
+    
+    cfg::Package const *package;
+    CallCache *calls;
+    std::vector<Scalar> const *args;
+    size_t depth;
+    
+    Scalar result = Unknown;
+    size_t operationCount = 0;
+    
+    Scalar evaluate(cfg::Value const *v) {
+      v->visit(this);
+      return result;
+    }
+    
+    virtual void acceptCall(cfg::CallFunc const *v) {
+      result = Unknown;
+      
+      auto fnRef = dynamic_cast<cfg::FunctionRef const *>(v->function);
+      if (!fnRef || depth == MaxCallDepth || fnRef->type->getResultType()->isVector()) {
+        return;
+      }
+      
+      auto fn = package->functions.find({fnRef->type, fnRef->name});
+      if (fn == package->functions.end()) {
+        return;
+      }
+      
+      // Unknown arguments only prevent evaluation if the callee uses them, in which case
+      // its result is unknown without descending into it.
+      auto &used = calls->usedParams(fn->second);
+      
+      std::vector<Scalar> callArgs;
+      CallCache::Key key(fn->second, std::vector<uint32_t>(v->params.size(), 0));
+      
+      for (size_t i = 0; i < v->params.size(); ++i) {
+        callArgs.push_back(used.count(i) ? evaluate(v->params[i]) : Unknown);
+        
+        if (used.count(i) && !callArgs[i].known) {
+          result = Unknown;
+          return;
+        }
+        
+        memcpy(&key.second[i], &callArgs[i].value, sizeof(float));
+      }
+      
+      auto hit = calls->results.find(key);
+      
+      if (hit == calls->results.end()) {
+        EvaluateScalar callee(package, calls, &callArgs, depth + 1);
+        auto value = callee.evaluate(fn->second);
+        
+        hit = calls->results.insert({key, {value, callee.operationCount}}).first;
+      }
+      
+      operationCount += hit->second.operationCount + 1;
+      result = hit->second.value;
+    }
+    
+    virtual void acceptBinaryOp(cfg::BinaryOp const *v) {
+      auto lhs = evaluate(v->lhs);
+      auto rhs = evaluate(v->rhs);
+      
+      ++operationCount;
+      result = (lhs.known && rhs.known) ? evalBinaryOp(v->operation, lhs.value, rhs.value) : Unknown;
+    }
+    
+    virtual void acceptUnaryOp(cfg::UnaryOp const *v) {
+      auto operand = evaluate(v->operand);
+      
+      ++operationCount;
+      result = operand.known ? evalUnaryOp(v->operation, operand.value) : Unknown;
+    }
+    
+    // Only the operand the condition chooses is evaluated. Following the other would
+    // recurse without end through functions that select their base case. So only the
+    // chosen operand's operations are counted, though both are evaluated at runtime.
+    virtual void acceptSelect(cfg::Select const *v) {
+      auto condition = evaluate(v->condition);
+      
+      if (!condition.known) {
+        result = Unknown;
+        return;
+      }
+      
+      ++operationCount;
+      result = evaluate(vm::Select::isTrue(condition.value) ? v->ifTrue : v->ifFalse);
+    }
+    
+    virtual void acceptFunctionRef(cfg::FunctionRef const *v) {
+      result = Unknown;
+    }
+    
+    virtual void acceptParamRef(cfg::ParamRef const *v) {
+      result = (args && v->index < args->size()) ? (*args)[v->index] : Unknown;
+    }
+    
+    virtual void acceptFPValue(cfg::FPValue const *v) {
+      result = {true, (float)v->value};
+    }
+    
+    virtual void acceptTableRef(cfg::TableRef const *v) {
+      result = Unknown;
+    }
+  };
+  
+  
+  // CFG visitor finding the largest time-invariant values within a function and
+  // the constants to replace them with.
+  struct FindInvariants : cfg::Value::Visitor {
+    FindInvariants(Arena *arena_, cfg::Package const *package_, CallCache *calls_, type::Function const *type_)
+    : arena(arena_)
+    , package(package_)
+    , calls(calls_)
+    , type(type_)
+    {}
+    
+    Arena *arena;
+    cfg::Package const *package;
+    CallCache *calls;
+    type::Function const *type;
+    
+    // Constant replacing each invariant value.
+    std::unordered_map<cfg::Value const *, cfg::Value *> constants;
+    
+    // # operations no longer executed once the values are replaced.
+    size_t operationsRemoved = 0;
+    
+    // Nodes already visited, so shared nodes are only visited once.
+    std::unordered_set<cfg::Value const *> visited;
+    
+    void find(cfg::Value const *v) {
+      if (visited.insert(v).second && !hoist(v)) {
+        v->visit(this);
+      }
+    }
+    
+    virtual void acceptCall(cfg::CallFunc const *v) {
+      find(v->function);
+      
+      for (auto p : v->params) {
+        find(p);
+      }
+    }
+    
+    virtual void acceptBinaryOp(cfg::BinaryOp const *v) {
+      find(v->lhs);
+      find(v->rhs);
+    }
+    
+    virtual void acceptUnaryOp(cfg::UnaryOp const *v) {
+      find(v->operand);
+    }
+    
+    virtual void acceptSelect(cfg::Select const *v) {
+      find(v->condition);
+      find(v->ifTrue);
+      find(v->ifFalse);
+    }
+    
+    virtual void acceptFunctionRef(cfg::FunctionRef const *v) {}
+    virtual void acceptParamRef(cfg::ParamRef const *v) {}
+    virtual void acceptFPValue(cfg::FPValue const *v) {}
+    virtual void acceptTableRef(cfg::TableRef const *v) {}
+    
+    // Record a constant replacing `v` if it is a time-invariant operation, returning
+    // true if it is.
+    bool hoist(cfg::Value const *v) {
+      auto isOperation = dynamic_cast<cfg::CallFunc const *>(v)
+      || dynamic_cast<cfg::BinaryOp const *>(v)
+      || dynamic_cast<cfg::UnaryOp const *>(v)
+      || dynamic_cast<cfg::Select const *>(v);
+      if (!isOperation || v->typeInFunction(type)->isVector()) {
+        return false;
+      }
+      
+      // Parameters are unknown within the function itself.
+      EvaluateScalar evaluator(package, calls, nullptr, 0);
+      auto value = evaluator.evaluate(v);
+      
+      if (!value.known) {
+        return false;
+      }
+      
+      auto constant = arena->create<cfg::FPValue>();
+      constant->value = value.value;
+      
+      constants[v] = constant;
+      operationsRemoved += evaluator.operationCount;
+      
+      return true;
+    }
+  };
+  
+  
+  // CFG visitor replacing values with the constants found by FindInvariants.
+  struct ReplaceInvariants : cfg::Value::MutatingVisitor {
+    explicit ReplaceInvariants(std::unordered_map<cfg::Value const *, cfg::Value *> const *constants_)
+    : constants(constants_)
+    {}
+    
+    std::unordered_map<cfg::Value const *, cfg::Value *> const *constants;
+    std::unordered_set<cfg::Value *> visited;
+    
+    cfg::Value *replace(cfg::Value *v) {
+      auto hit = constants->find(v);
+      if (hit != constants->end()) {
+        return hit->second;
+      }
+      
+      if (visited.insert(v).second) {
+        v->visit(this);
+      }
+      
+      return v;
+    }
+    
+    virtual void acceptCall(cfg::CallFunc *v) {
+      v->function = replace(v->function);
+      
+      for (auto &p : v->params) {
+        p = replace(p);
+      }
+    }
+    
+    virtual void acceptBinaryOp(cfg::BinaryOp *v) {
+      v->lhs = replace(v->lhs);
+      v->rhs = replace(v->rhs);
+    }
+    
+    virtual void acceptUnaryOp(cfg::UnaryOp *v) {
+      v->operand = replace(v->operand);
+    }
+    
+    virtual void acceptSelect(cfg::Select *v) {
+      v->condition = replace(v->condition);
+      v->ifTrue = replace(v->ifTrue);
+      v->ifFalse = replace(v->ifFalse);
+    }
+    
+    virtual void acceptFunctionRef(cfg::FunctionRef *v) {}
+    virtual void acceptParamRef(cfg::ParamRef *v) {}
+    virtual void acceptFPValue(cfg::FPValue *v) {}
+    virtual void acceptTableRef(cfg::TableRef *v) {}
+  };
+}
+
+namespace compiler {
+  HoistReport hoistCFG(Arena *arena, cfg::Package *package) {
+    HoistReport report;
+    
+    // Find all invariant values before replacing any, so that work is measured against
+    // the original code.
+    std::vector<FindInvariants> invariants;
+    CallCache calls;
+    
+    for (auto &fn : package->functions) {
+      auto type = dynamic_cast<type::Function const *>(fn.first.type);
+      
+      invariants.emplace_back(arena, package, &calls, type);
+      invariants.back().find(fn.second);
+    }
+    
+    auto found = invariants.begin();
+    
+    for (auto &fn : package->functions) {
+      ReplaceInvariants visitor(&found->constants);
+      fn.second = visitor.replace(fn.second);
+      
+      if (!found->constants.empty()) {
+        report.functions.push_back({fn.first, found->constants.size(), found->operationsRemoved});
+      }
+      
+      ++found;
+    }
+    
+    return report;
+  }
+  
+  size_t HoistReport::hoistedValues() const {
+    size_t count = 0;
+    for (auto fn : functions) {
+      count += fn.hoistedValues;
+    }
+    
+    return count;
+  }
+  
+  size_t HoistReport::operationsRemoved() const {
+    size_t count = 0;
+    for (auto fn : functions) {
+      count += fn.operationsRemoved;
+    }
+    
+    return count;
+  }
+}
+
+std::ostream &operator<<(std::ostream &str, compiler::HoistReport const &report) {
+  for (auto fn : report.functions) {
+    str << fn.symbol << ": " << fn.hoistedValues << " values hoisted, "
+    << fn.operationsRemoved << " operations removed per evaluation" << std::endl;
+  }
+  
+  return str << "Total: " << report.hoistedValues() << " values hoisted, "
+  << report.operationsRemoved() << " operations removed per evaluation" << std::endl;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "CFG.hpp"
+
+#include <ostream>
+#include <vector>
+
+namespace compiler {
+  // Summary of the work removed from the per-block path by hoistCFG.
+  struct HoistReport {
+    struct Function {
+      TypedSymbol symbol;
+      
+      // # values replaced by constants.
+      size_t hoistedValues;
+      
+      // # operations (arithmetic ops and calls) that no longer execute each time
+      // the function is evaluated, including those within called functions. Of each
+      // select's operands, only the one its condition chooses is counted.
+      size_t operationsRemoved;
+    };
+    
+    // Functions with at least one hoisted value.
+    std::vector<Function> functions;
+    
+    size_t hoistedValues() const;
+    size_t operationsRemoved() const;
+  };
+  
+  // Evaluate time-invariant values ahead of time, replacing them with constants.
+  //
+  // A value is time-invariant if it is a scalar that depends only on constants and
+  // on the results of calling functions with time-invariant arguments. Since vector
+  // values are derived from the time parameter, invariant values are the same in
+  // every block, so only need evaluating once when the package is compiled.
+  //
+  // Evaluation uses the same single-precision arithmetic as the VM, so results are
+  // identical to evaluating the original code.
+  HoistReport hoistCFG(Arena *arena, cfg::Package *package);
+}
+
+std::ostream &operator<<(std::ostream &str, compiler::HoistReport const &report);
@@ -0,0 +1,304 @@
+#include "InlineCFG.hpp"
+#include "Type.hpp"
+
+#include <vector>
+
+namespace {
+  // CFG visitor gathering the properties of a function body that determine whether
+  // it can be inlined.
+  struct InlineCandidate : cfg::Value::Visitor {
+    // # nodes in the body.
+    size_t nodeCount = 0;
+    
+    // True if the body contains a function call.
+    bool hasCall = false;
+    
+    // # references to each parameter.
+    std::vector<size_t> paramUses;
+    
+    virtual void acceptCall(cfg::CallFunc const *v) {
+      ++nodeCount;
+      hasCall = true;
+    }
+    
+    virtual void acceptBinaryOp(cfg::BinaryOp const *v) {
+      ++nodeCount;
+      v->lhs->visit(this);
+      v->rhs->visit(this);
+    }
+    
+    virtual void acceptUnaryOp(cfg::UnaryOp const *v) {
+      ++nodeCount;
+      v->operand->visit(this);
+    }
+    
+    virtual void acceptSelect(cfg::Select const *v) {
+      ++nodeCount;
+      v->condition->visit(this);
+      v->ifTrue->visit(this);
+      v->ifFalse->visit(this);
+    }
+    
+    virtual void acceptFunctionRef(cfg::FunctionRef const *v) {
+      ++nodeCount;
+    }
+    
+    virtual void acceptParamRef(cfg::ParamRef const *v) {
+      ++nodeCount;
+      
+      if (paramUses.size() <= v->index) {
+        paramUses.resize(v->index + 1);
+      }
+      
+      ++paramUses[v->index];
+    }
+    
+    virtual void acceptFPValue(cfg::FPValue const *v) {
+      ++nodeCount;
+    }
+    
+    virtual void acceptTableRef(cfg::TableRef const *v) {
+      ++nodeCount;
+    }
+  };
+  
+  
+  // CFG visitor returning true if a value is cheap enough to evaluate that it can
+  // be duplicated freely.
+  struct IsTrivial : cfg::Value::Visitor {
+    bool result = false;
+    
+    virtual void acceptCall(cfg::CallFunc const *v) {}
+    virtual void acceptBinaryOp(cfg::BinaryOp const *v) {}
+    virtual void acceptUnaryOp(cfg::UnaryOp const *v) {}
+    virtual void acceptSelect(cfg::Select const *v) {}
+    
+    virtual void acceptFunctionRef(cfg::FunctionRef const *v) {
+      result = true;
+    }
+    
+    virtual void acceptParamRef(cfg::ParamRef const *v) {
+      result = true;
+    }
+    
+    virtual void acceptFPValue(cfg::FPValue const *v) {
+      result = true;
+    }
+    
+    virtual void acceptTableRef(cfg::TableRef const *v) {
+      result = true;
+    }
+  };
+  
+  
+  // CFG visitor copying an inlined function body into the calling function,
+  // replacing parameter references with the call's arguments.
+  struct SubstituteParams : cfg::Value::Visitor {
+    SubstituteParams(Arena *arena_, Arena::vector<cfg::Value *> const *args_)
+    : arena(arena_)
+    , args(args_)
+    {}
+    
+    Arena *arena;
+    Arena::vector<cfg::Value *> const *args;
+    cfg::Value *result = nullptr;
+    
+    cfg::Value *copy(cfg::Value const *v) {
+      v->visit(this);
+      return result;
+    }
+    
+    virtual void acceptCall(cfg::CallFunc const *v) {
+      throw std::logic_error("Inlined functions should not contain calls");
+    }
+    
+    virtual void acceptBinaryOp(cfg::BinaryOp const *v) {
+      auto op = arena->create<cfg::BinaryOp>();
+      op->operation = v->operation;
+      op->lhs = copy(v->lhs);
+      op->rhs = copy(v->rhs);
+      
+      result = op;
+    }
+    
+    virtual void acceptUnaryOp(cfg::UnaryOp const *v) {
+      auto op = arena->create<cfg::UnaryOp>();
+      op->operation = v->operation;
+      op->operand = copy(v->operand);
+      
+      result = op;
+    }
+    
+    virtual void acceptSelect(cfg::Select const *v) {
+      auto select = arena->create<cfg::Select>();
+      select->condition = copy(v->condition);
+      select->ifTrue = copy(v->ifTrue);
+      select->ifFalse = copy(v->ifFalse);
+      
+      result = select;
+    }
+    
+    virtual void acceptFunctionRef(cfg::FunctionRef const *v) {
+      result = arena->create<cfg::FunctionRef>(*v);
+    }
+    
+    virtual void acceptParamRef(cfg::ParamRef const *v) {
+      result = (*args)[v->index];
+    }
+    
+    virtual void acceptFPValue(cfg::FPValue const *v) {
+      result = arena->create<cfg::FPValue>(*v);
+    }
+    
+    virtual void acceptTableRef(cfg::TableRef const *v) {
+      result = arena->create<cfg::TableRef>(*v);
+    }
+  };
+  
+  
+  // CFG visitor inlining calls within a function body.
+  //
+  // Callees are processed before deciding whether to inline them, so that
+  // functions whose calls have all been inlined become candidates themselves.
+  struct InlineCalls : cfg::Value::MutatingVisitor {
+    InlineCalls(Arena *arena_, cfg::Package *package_, size_t maxNodes_)
+    : arena(arena_)
+    , package(package_)
+    , maxNodes(maxNodes_)
+    , processed(arena_->allocator<TypedSymbol>())
+    {}
+    
+    Arena *arena;
+    cfg::Package *package;
+    size_t maxNodes;
+    
+    // Functions that have been processed (or are being processed).
+    Arena::unordered_set<TypedSymbol> processed;
+    
+    // Replacement for the most recently visited value.
+    cfg::Value *result = nullptr;
+    
+    // Inline calls within the function `key`.
+    void processFunction(TypedSymbol key) {
+      if (processed.find(key) != processed.end()) {
+        return;
+      }
+      
+      processed.insert(key);
+      
+      auto fn = package->functions.find(key);
+      if (fn != package->functions.end()) {
+        fn->second = rewrite(fn->second);
+      }
+    }
+    
+    // Inline calls within `v` and return its replacement.
+    cfg::Value *rewrite(cfg::Value *v) {
+      v->visit(this);
+      return result;
+    }
+    
+    virtual void acceptCall(cfg::CallFunc *v) {
+      v->function = rewrite(v->function);
+      
+      for (auto &p : v->params) {
+        p = rewrite(p);
+      }
+      
+      result = v;
+      
+      auto callee = dynamic_cast<cfg::FunctionRef const *>(v->function);
+      if (!callee) {
+        return;
+      }
+      
+      TypedSymbol key = {callee->type, callee->name};
+      processFunction(key);
+      
+      auto fn = package->functions.find(key);
+      if (fn != package->functions.end() && shouldInline(fn->second, v)) {
+        result = SubstituteParams(arena, &v->params).copy(fn->second);
+      }
+    }
+    
+    virtual void acceptBinaryOp(cfg::BinaryOp *v) {
+      v->lhs = rewrite(v->lhs);
+      v->rhs = rewrite(v->rhs);
+      
+      result = v;
+    }
+    
+    virtual void acceptUnaryOp(cfg::UnaryOp *v) {
+      v->operand = rewrite(v->operand);
+      result = v;
+    }
+    
+    virtual void acceptSelect(cfg::Select *v) {
+      v->condition = rewrite(v->condition);
+      v->ifTrue = rewrite(v->ifTrue);
+      v->ifFalse = rewrite(v->ifFalse);
+      
+      result = v;
+    }
+    
+    virtual void acceptFunctionRef(cfg::FunctionRef *v) {
+      // Process referenced functions even if they aren't called here, since they
+      // may be called indirectly.
+      processFunction({v->type, v->name});
+      result = v;
+    }
+    
+    virtual void acceptParamRef(cfg::ParamRef *v) {
+      result = v;
+    }
+    
+    virtual void acceptFPValue(cfg::FPValue *v) {
+      result = v;
+    }
+    
+    virtual void acceptTableRef(cfg::TableRef *v) {
+      result = v;
+    }
+    
+    // Return true if `call` should be replaced by the function body `body`.
+    bool shouldInline(cfg::Value const *body, cfg::CallFunc const *call) {
+      InlineCandidate candidate;
+      body->visit(&candidate);
+      
+      if (candidate.hasCall || candidate.nodeCount > maxNodes) {
+        return false;
+      }
+      
+      for (size_t i = 0; i < candidate.paramUses.size(); ++i) {
+        if (candidate.paramUses[i] > 1 && !isTrivial(call->params[i])) {
+          return false;
+        }
+      }
+      
+      return true;
+    }
+    
+    static bool isTrivial(cfg::Value const *v) {
+      IsTrivial visitor;
+      v->visit(&visitor);
+      
+      return visitor.result;
+    }
+  };
+}
+
+namespace compiler {
+  void inlineCFG(Arena *arena, cfg::Package *package, size_t maxNodes) {
+    InlineCalls visitor(arena, package, maxNodes);
+    
+    // Collect keys first, since processing functions modifies the package's values.
+    std::vector<TypedSymbol> keys;
+    for (auto fn : package->functions) {
+      keys.push_back(fn.first);
+    }
+    
+    for (auto key : keys) {
+      visitor.processFunction(key);
+    }
+  }
+}
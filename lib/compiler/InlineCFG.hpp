@@ -0,0 +1,17 @@
+#pragma once
+
+#include "CFG.hpp"
+
+namespace compiler {
+  // Replace calls to small leaf functions (including intrinsic operators) with
+  // the callee's body, substituting the call's arguments for its parameters.
+  //
+  // A callee is inlined if its body contains no calls and has no more than
+  // `maxNodes` CFG nodes. Arguments are duplicated if the callee references a
+  // parameter more than once, so callees that do so are only inlined when those
+  // arguments are trivial to evaluate.
+  //
+  // Functions that are no longer referenced after inlining are left in the package,
+  // and may be removed using gcCFG.
+  void inlineCFG(Arena *arena, cfg::Package *package, size_t maxNodes = 8);
+}
@@ -1,6 +1,8 @@
 #include "Intrinsics.hpp"
 
+#include <cmath>
 #include <sstream>
+#include <stdexcept>
 
 namespace {
   // Add an intrunsic function to a CFG package and return it's root node.
@@ -38,6 +40,58 @@ namespace {
     intrinsic->lhs = arena->create<cfg::ParamRef>(0);
     intrinsic->rhs = arena->create<cfg::ParamRef>(1);
   }
+  
+  // Helper for inserting unary operator.
+  //
+  // Adds a cfg::UnaryOp value performing a specific opcode on an operand of the
+  // specified type, which is also the return type.
+  void addUnaryOpIntrinsic(cfg::Package &package, Arena *arena, char const *name, vm::Instruction::Opcode op, type::Type const *operand) {
+    auto intrinsic = addIntrinsic<cfg::UnaryOp>(package, arena, name, operand, {operand});
+    
+    intrinsic->operation = op;
+    intrinsic->operand = arena->create<cfg::ParamRef>(0);
+  }
+  
+  // Helper for inserting a select, choosing between operands of the specified types
+  // with a condition of the specified type.
+  void addSelectIntrinsic(cfg::Package &package, Arena *arena, char const *name, type::Type const *condition, type::Type const *ifTrue, type::Type const *ifFalse) {
+    auto result = type::intersectionType(condition, type::intersectionType(ifTrue, ifFalse));
+    auto intrinsic = addIntrinsic<cfg::Select>(package, arena, name, result, {condition, ifTrue, ifFalse});
+    
+    intrinsic->condition = arena->create<cfg::ParamRef>(0);
+    intrinsic->ifTrue = arena->create<cfg::ParamRef>(1);
+    intrinsic->ifFalse = arena->create<cfg::ParamRef>(2);
+  }
+  
+  // Helper for inserting a table lookup, reading table `table` at a phase of the
+  // specified type, which is also the return type.
+  void addTableIntrinsic(cfg::Package &package, Arena *arena, char const *name, vm::Instruction::Opcode op, type::Type const *phase) {
+    auto intrinsic = addIntrinsic<cfg::BinaryOp>(package, arena, name, phase, {phase});
+    auto table = arena->create<cfg::TableRef>();
+    table->name = Symbol::get(name);
+    
+    intrinsic->operation = op;
+    intrinsic->lhs = arena->create<cfg::ParamRef>(0);
+    intrinsic->rhs = table;
+  }
+  
+  // One cycle of a sawtooth rising from -1 to 1, summed from its first `harmonics`
+  // harmonics so that it doesn't alias when played below sampleRate / (2 * harmonics).
+  std::vector<float> bandLimitedSaw(size_t size, size_t harmonics) {
+    std::vector<float> samples(size);
+    
+    for (size_t i = 0; i < size; ++i) {
+      double sum = 0;
+      
+      for (size_t k = 1; k <= harmonics; ++k) {
+        sum += std::sin(2 * M_PI * k * i / size) / k;
+      }
+      
+      samples[i] = (float)(-2 / M_PI * sum);
+    }
+    
+    return samples;
+  }
 }
 
 namespace compiler {
@@ -55,9 +109,78 @@ namespace compiler {
     
     BINARY_INTRINSIC_VARIANTS("+", ADD);
     BINARY_INTRINSIC_VARIANTS("*", MUL);
+    BINARY_INTRINSIC_VARIANTS("pow", POW);
+    BINARY_INTRINSIC_VARIANTS("fastPow", FAST_POW);
+    
+    // Noise of a time and a seed (see VMOps.hpp).
+    BINARY_INTRINSIC_VARIANTS("noise", NOISE);
+    BINARY_INTRINSIC_VARIANTS("noiseBipolar", NOISE_BIPOLAR);
+    
+    // Clamping, where `clip(x, limit)` clips `x` to -limit..limit.
+    BINARY_INTRINSIC_VARIANTS("min", MIN);
+    BINARY_INTRINSIC_VARIANTS("max", MAX);
+    BINARY_INTRINSIC_VARIANTS("clip", CLIP);
     
 #undef BINARY_INTRINSIC_VARIANTS
-  
+    
+    // Math functions come in two accuracy tiers (see VMOps.hpp). The fast tier is named
+    // explicitly, so that only code opting in to its larger error uses it.
+#define UNARY_INTRINSIC_VARIANTS(SYMBOL, OPCODE_PREFIX) \
+    addUnaryOpIntrinsic(package, arena, SYMBOL, vm::Instruction::OPCODE_PREFIX##_V, vF32); \
+    addUnaryOpIntrinsic(package, arena, SYMBOL, vm::Instruction::OPCODE_PREFIX##_S, F32);
+    
+    UNARY_INTRINSIC_VARIANTS("sin", SIN);
+    UNARY_INTRINSIC_VARIANTS("cos", COS);
+    UNARY_INTRINSIC_VARIANTS("exp", EXP);
+    UNARY_INTRINSIC_VARIANTS("log", LOG);
+    UNARY_INTRINSIC_VARIANTS("tanh", TANH);
+    UNARY_INTRINSIC_VARIANTS("fastSin", FAST_SIN);
+    UNARY_INTRINSIC_VARIANTS("fastCos", FAST_COS);
+    UNARY_INTRINSIC_VARIANTS("fastExp", FAST_EXP);
+    UNARY_INTRINSIC_VARIANTS("fastLog", FAST_LOG);
+    UNARY_INTRINSIC_VARIANTS("fastTanh", FAST_TANH);
+    UNARY_INTRINSIC_VARIANTS("abs", ABS);
+    
+#undef UNARY_INTRINSIC_VARIANTS
+    
+    // `select(condition, ifTrue, ifFalse)` chooses `ifTrue` where the condition is greater
+    // than zero, for every combination of operand types.
+    for (auto condition : {vF32, F32}) {
+      for (auto ifTrue : {vF32, F32}) {
+        for (auto ifFalse : {vF32, F32}) {
+          addSelectIntrinsic(package, arena, "select", condition, ifTrue, ifFalse);
+        }
+      }
+    }
+    
+    // Band-limited sawtooth oscillator, alias-free up to about sampleRate / 128.
+    static auto const saw = bandLimitedSaw(2048, 64);
+    bindTable(&package, arena, "saw", saw, vm::Interpolation::Linear);
+    
     return package;
   }
+  
+  void bindTable(cfg::Package *package, Arena *arena, char const *name, std::vector<float> const &samples, vm::Interpolation interpolation) {
+    if (samples.empty() || (samples.size() & (samples.size() - 1)) != 0) {
+      auto err = std::stringstream() << "Table `" << name << "` has " << samples.size() << " samples, expected a power of two";
+      throw std::runtime_error(err.str());
+    }
+    
+    package->tables.push_back(vm::Table(arena, Symbol::get(name)));
+    package->tables.back().samples.assign(samples.begin(), samples.end());
+    
+    auto F32 = type::F32();
+    auto vF32 = F32->vectorVersion(arena);
+    
+    auto vector = interpolation == vm::Interpolation::Nearest ? vm::Instruction::TABLE_NEAREST_V
+    : interpolation == vm::Interpolation::Linear ? vm::Instruction::TABLE_LINEAR_V
+    : vm::Instruction::TABLE_CUBIC_V;
+    
+    auto scalar = interpolation == vm::Interpolation::Nearest ? vm::Instruction::TABLE_NEAREST_S
+    : interpolation == vm::Interpolation::Linear ? vm::Instruction::TABLE_LINEAR_S
+    : vm::Instruction::TABLE_CUBIC_S;
+    
+    addTableIntrinsic(*package, arena, name, vector, vF32);
+    addTableIntrinsic(*package, arena, name, scalar, F32);
+  }
 }
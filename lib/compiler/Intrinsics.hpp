@@ -1,6 +1,13 @@
 #include "CFG.hpp"
+#include "VMOps.hpp"
+
+#include <vector>
 
 namespace compiler {
   // Return a CFG package containing intrinsic language functions.
   cfg::Package intrinsics(Arena *arena);
+  
+  // Add a table to a CFG package, with an intrinsic function `name(phase)` reading it
+  // at a phase measured in cycles of the table. The table's size must be a power of two.
+  void bindTable(cfg::Package *package, Arena *arena, char const *name, std::vector<float> const &samples, vm::Interpolation interpolation);
 };
@@ -4,7 +4,7 @@
 
 namespace ast {
   using namespace parse;
-
+  
   // Expression parser type
   template <typename Action>
   Grammar expressionTree(Action const &result);
@@ -12,7 +12,7 @@ namespace ast {
   // AST stringifier type
   struct ASTStringifier : Expression::Visitor {
     ASTStringifier(std::ostream &str) : stringify(str) {}
-
+    
     Stringifier stringify;
     
     // Expression stringifiers
@@ -22,11 +22,15 @@ namespace cfg {
     // SSA value types
     virtual void acceptCall(CallFunc const *v);
     virtual void acceptBinaryOp(BinaryOp const *v);
+    virtual void acceptUnaryOp(UnaryOp const *v);
     virtual void acceptFunctionRef(FunctionRef const *v);
     virtual void acceptParamRef(ParamRef const *v);
     virtual void acceptFPValue(FPValue const *v);
+    virtual void acceptTableRef(TableRef const *v);
+    virtual void acceptSelect(Select const *v);
     
     void acceptPackageFunction(std::pair<TypedSymbol const, cfg::Value *> const *v);
+    void acceptPackageTable(vm::Table const *v);
     void acceptPackage(Package const *v);
   };
   
@@ -79,13 +83,27 @@ state >> match(SYM_PREFIX "_vv") >> emitValue(vm::Instruction::OPCODE_PREFIX##_V
 ?: state >> match(SYM_PREFIX "_sv") >> emitValue(vm::Instruction::OPCODE_PREFIX##_SV, out) \
 ?: state >> match(SYM_PREFIX "_vs") >> emitValue(vm::Instruction::OPCODE_PREFIX##_VS, out) \
 ?: state >> match(SYM_PREFIX "_ss") >> emitValue(vm::Instruction::OPCODE_PREFIX##_SS, out)
-      
+
+#define TABLE_INTRINSIC_VARIANTS(OPCODE_PREFIX, SYM_PREFIX) \
+state >> match(SYM_PREFIX "_v") >> emitValue(vm::Instruction::OPCODE_PREFIX##_V, out) \
+?: state >> match(SYM_PREFIX "_s") >> emitValue(vm::Instruction::OPCODE_PREFIX##_S, out)
       
       return BINARY_INTRINSIC_VARIANTS(ADD, "add")
       ?: BINARY_INTRINSIC_VARIANTS(MUL, "mul")
+      ?: BINARY_INTRINSIC_VARIANTS(POW, "pow")
+      ?: BINARY_INTRINSIC_VARIANTS(FAST_POW, "fast_pow")
+      ?: BINARY_INTRINSIC_VARIANTS(NOISE, "noise")
+      ?: BINARY_INTRINSIC_VARIANTS(NOISE_BIPOLAR, "noise_bipolar")
+      ?: BINARY_INTRINSIC_VARIANTS(MIN, "min")
+      ?: BINARY_INTRINSIC_VARIANTS(MAX, "max")
+      ?: BINARY_INTRINSIC_VARIANTS(CLIP, "clip")
+      ?: TABLE_INTRINSIC_VARIANTS(TABLE_NEAREST, "table_nearest")
+      ?: TABLE_INTRINSIC_VARIANTS(TABLE_LINEAR, "table_linear")
+      ?: TABLE_INTRINSIC_VARIANTS(TABLE_CUBIC, "table_cubic")
       ;
       
 #undef BINARY_INTRINSIC_VARIANTS
+#undef TABLE_INTRINSIC_VARIANTS
     };
   }
   
@@ -97,18 +115,72 @@ case vm::Instruction::OPCODE_PREFIX##_VV: return SYM_PREFIX "_vv"; \
 case vm::Instruction::OPCODE_PREFIX##_VS: return SYM_PREFIX "_vs"; \
 case vm::Instruction::OPCODE_PREFIX##_SV: return SYM_PREFIX "_sv"; \
 case vm::Instruction::OPCODE_PREFIX##_SS: return SYM_PREFIX "_ss"; \
-
+        
         BINARY_INTRINSIC_VARIANTS(ADD, "add");
         BINARY_INTRINSIC_VARIANTS(MUL, "mul");
+        BINARY_INTRINSIC_VARIANTS(POW, "pow");
+        BINARY_INTRINSIC_VARIANTS(FAST_POW, "fast_pow");
+        BINARY_INTRINSIC_VARIANTS(NOISE, "noise");
+        BINARY_INTRINSIC_VARIANTS(NOISE_BIPOLAR, "noise_bipolar");
+        BINARY_INTRINSIC_VARIANTS(MIN, "min");
+        BINARY_INTRINSIC_VARIANTS(MAX, "max");
+        BINARY_INTRINSIC_VARIANTS(CLIP, "clip");
         
 #undef BINARY_INTRINSIC_VARIANTS
+#define UNARY_INTRINSIC_VARIANTS(OPCODE_PREFIX, SYM_PREFIX) \
+case vm::Instruction::OPCODE_PREFIX##_V: return SYM_PREFIX "_v"; \
+case vm::Instruction::OPCODE_PREFIX##_S: return SYM_PREFIX "_s"; \
+        
+        UNARY_INTRINSIC_VARIANTS(SIN, "sin");
+        UNARY_INTRINSIC_VARIANTS(COS, "cos");
+        UNARY_INTRINSIC_VARIANTS(EXP, "exp");
+        UNARY_INTRINSIC_VARIANTS(LOG, "log");
+        UNARY_INTRINSIC_VARIANTS(TANH, "tanh");
+        UNARY_INTRINSIC_VARIANTS(FAST_SIN, "fast_sin");
+        UNARY_INTRINSIC_VARIANTS(FAST_COS, "fast_cos");
+        UNARY_INTRINSIC_VARIANTS(FAST_EXP, "fast_exp");
+        UNARY_INTRINSIC_VARIANTS(FAST_LOG, "fast_log");
+        UNARY_INTRINSIC_VARIANTS(FAST_TANH, "fast_tanh");
+        UNARY_INTRINSIC_VARIANTS(ABS, "abs");
+        
+        // Table lookups are binary in the CFG, taking the table as their rhs.
+        UNARY_INTRINSIC_VARIANTS(TABLE_NEAREST, "table_nearest");
+        UNARY_INTRINSIC_VARIANTS(TABLE_LINEAR, "table_linear");
+        UNARY_INTRINSIC_VARIANTS(TABLE_CUBIC, "table_cubic");
+        
+#undef UNARY_INTRINSIC_VARIANTS
       default: {
-        auto err = std::stringstream() << "Cannot serialize binary operator " << op;
+        auto err = std::stringstream() << "Cannot serialize operator " << op;
         throw std::logic_error(err.str());
       }
     }
   }
   
+  // Parse unary type
+  template <typename Action>
+  auto unaryOperation(Action out) {
+    return [=](State const &state) -> Result {
+#define UNARY_INTRINSIC_VARIANTS(OPCODE_PREFIX, SYM_PREFIX) \
+state >> match(SYM_PREFIX "_v") >> emitValue(vm::Instruction::OPCODE_PREFIX##_V, out) \
+?: state >> match(SYM_PREFIX "_s") >> emitValue(vm::Instruction::OPCODE_PREFIX##_S, out)
+      
+      return UNARY_INTRINSIC_VARIANTS(SIN, "sin")
+      ?: UNARY_INTRINSIC_VARIANTS(COS, "cos")
+      ?: UNARY_INTRINSIC_VARIANTS(EXP, "exp")
+      ?: UNARY_INTRINSIC_VARIANTS(LOG, "log")
+      ?: UNARY_INTRINSIC_VARIANTS(TANH, "tanh")
+      ?: UNARY_INTRINSIC_VARIANTS(FAST_SIN, "fast_sin")
+      ?: UNARY_INTRINSIC_VARIANTS(FAST_COS, "fast_cos")
+      ?: UNARY_INTRINSIC_VARIANTS(FAST_EXP, "fast_exp")
+      ?: UNARY_INTRINSIC_VARIANTS(FAST_LOG, "fast_log")
+      ?: UNARY_INTRINSIC_VARIANTS(FAST_TANH, "fast_tanh")
+      ?: UNARY_INTRINSIC_VARIANTS(ABS, "abs")
+      ;
+      
+#undef UNARY_INTRINSIC_VARIANTS
+    };
+  }
+  
   // Parse
   template <typename Action>
   auto primitive(Action out) {
@@ -137,6 +209,62 @@ case vm::Instruction::OPCODE_PREFIX##_SS: return SYM_PREFIX "_ss"; \
     stringify.end();
   }
   
+  // Parse unary
+  template <typename Action>
+  auto unaryPrimitive(Action out) {
+    return sExp([=](State const &state) -> Result {
+      auto result = state.create<UnaryOp>();
+      
+      return state
+      >> unaryOperation(receive(&result->operation))
+      >> whitespace
+      >> valueTree(receive(&result->operand))
+      >> emit(&result, out)
+      ;
+    });
+  }
+  
+  // Stringify unary
+  void CFGStringifier::acceptUnaryOp(const cfg::UnaryOp *v) {
+    stringify.begin();
+    
+    stringify.atom(operationString(v->operation));
+    stringify.compound(v->operand, this);
+    
+    stringify.end();
+  }
+  
+  
+  /** Select **/
+  
+  // Parse
+  template <typename Action>
+  auto select(Action out) {
+    return taggedSExp("select", [=](State const &state) -> Result {
+      auto result = state.create<Select>();
+      
+      return state
+      >> valueTree(receive(&result->condition))
+      >> whitespace
+      >> valueTree(receive(&result->ifTrue))
+      >> whitespace
+      >> valueTree(receive(&result->ifFalse))
+      >> emit(&result, out)
+      ;
+    });
+  }
+  
+  // Stringify
+  void CFGStringifier::acceptSelect(const cfg::Select *v) {
+    stringify.begin("select");
+    
+    stringify.compound(v->condition, this);
+    stringify.compound(v->ifTrue, this);
+    stringify.compound(v->ifFalse, this);
+    
+    stringify.end();
+  }
+  
   
   /** FunctionRef Reference **/
   
@@ -196,7 +324,7 @@ case vm::Instruction::OPCODE_PREFIX##_SS: return SYM_PREFIX "_ss"; \
       auto result = state.create<FPValue>();
       
       return state
-      >> real(receive(&result->value))
+      >> signedReal(receive(&result->value))
       >> emit(&result, out)
       ;
     });
@@ -212,17 +340,43 @@ case vm::Instruction::OPCODE_PREFIX##_SS: return SYM_PREFIX "_ss"; \
   }
   
   
+  /** Table Reference **/
+  
+  // Parse
+  template <typename Action>
+  auto tableRef(Action out) {
+    return taggedSExp("table", [=](State const &state) -> Result {
+      auto result = state.create<TableRef>();
+      
+      return state
+      >> identifierString(receive(&result->name))
+      >> emit(&result, out)
+      ;
+    });
+  }
+  
+  // Stringify
+  void CFGStringifier::acceptTableRef(const cfg::TableRef *v) {
+    stringify.begin("table");
+    stringify.atom(v->name);
+    stringify.end();
+  }
+  
+  
   /** SSA Value Variant **/
   
   template <typename Action>
   Grammar valueTree(Action action) {
     return [=](State const &state) -> Result {
       return state >> call(action)
+      ?: state >> select(action) >> log("select")
       ?: state >> primitive(action) >> log("primitive")
+      ?: state >> unaryPrimitive(action) >> log("unary primitive")
       ?: state >> call(action) >> log("call")
       ?: state >> paramRef(action) >> log("param")
       ?: state >> scalar(action) >> log("scalar")
       ?: state >> functionRef(action) >> log("ref")
+      ?: state >> tableRef(action) >> log("table")
       ;
     };
   }
@@ -288,9 +442,27 @@ case vm::Instruction::OPCODE_PREFIX##_SS: return SYM_PREFIX "_ss"; \
         ;
       });
       
+      // Table definition, eg. `(table ramp 0 1 2 3)`
+      auto table = taggedSExp("table", [&](State const &state) {
+        vm::Table table(state.arena, Symbol());
+        
+        return state
+        >> identifierString(receive(&table.name))
+        >> whitespace
+        >> delimited(signedReal<float>(collect(&table.samples)), whitespace)
+        >> inject([&]{ result.tables.push_back(table); })
+        ;
+      });
+      
+      auto definition = [&](State const &state) {
+        return state >> table
+        ?: state >> function
+        ;
+      };
+      
       return state
       >> optionalWhitespace
-      >> delimited(function, whitespace)
+      >> delimited(definition, whitespace)
       >> optionalWhitespace
       >> emit(&result, out)
       ;
@@ -306,7 +478,15 @@ case vm::Instruction::OPCODE_PREFIX##_SS: return SYM_PREFIX "_ss"; \
     stringify.end();
   }
   
+  void CFGStringifier::acceptPackageTable(vm::Table const *v) {
+    stringify.begin("table");
+    stringify.atom(v->name);
+    stringify.each(v->samples);
+    stringify.end();
+  }
+  
   void CFGStringifier::acceptPackage(const cfg::Package *v) {
+    stringify.each(v->tables, this, &CFGStringifier::acceptPackageTable);
     stringify.each(v->functions, this, &CFGStringifier::acceptPackageFunction);
   }
 }
@@ -0,0 +1,309 @@
+#include "SimplifyCFG.hpp"
+#include "Type.hpp"
+#include "VMOps.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+using vm::Instruction;
+
+namespace {
+  float add(float lhs, float rhs) {
+    return lhs + rhs;
+  }
+  
+  float mul(float lhs, float rhs) {
+    return lhs * rhs;
+  }
+  
+  // Fold an operation through the VM's own scalar variant, so that folding gives the
+  // same result as evaluation.
+  template <typename Op>
+  float unaryFold(float operand) {
+    float result;
+    Op()(operand, &result);
+    
+    return result;
+  }
+  
+  template <typename Op>
+  float binaryFold(float lhs, float rhs) {
+    float result;
+    Op()(lhs, rhs, &result);
+    
+    return result;
+  }
+  
+  using vm::Accuracy;
+  
+  compiler::BinaryOpRule const Rules[] = {
+    // `x + 0` is +0 for x = -0, so only -0 leaves every x unchanged.
+    {Instruction::ADD_VV, Instruction::ADD_SV, Instruction::ADD_VS, Instruction::ADD_SS, add, true, -0.0f, true, true},
+    {Instruction::MUL_VV, Instruction::MUL_SV, Instruction::MUL_VS, Instruction::MUL_SS, mul, true, 1, true, true},
+    
+    // `pow(x, 1)` is `x` except for -0, but isn't worth simplifying.
+    {Instruction::POW_VV, Instruction::POW_SV, Instruction::POW_VS, Instruction::POW_SS, binaryFold<vm::Pow<Accuracy::Precise>>, false, 0, false, false},
+    {Instruction::FAST_POW_VV, Instruction::FAST_POW_SV, Instruction::FAST_POW_VS, Instruction::FAST_POW_SS, binaryFold<vm::Pow<Accuracy::Fast>>, false, 0, false, false},
+    {Instruction::NOISE_VV, Instruction::NOISE_SV, Instruction::NOISE_VS, Instruction::NOISE_SS, binaryFold<vm::Noise<false>>, false, 0, false, false},
+    {Instruction::NOISE_BIPOLAR_VV, Instruction::NOISE_BIPOLAR_SV, Instruction::NOISE_BIPOLAR_VS, Instruction::NOISE_BIPOLAR_SS, binaryFold<vm::Noise<true>>, false, 0, false, false},
+    
+    // An infinite rhs leaves the lhs unchanged. Where an operand is NaN, the result is the
+    // lhs (see VMOps.hpp), so these neither commute nor reassociate.
+    {Instruction::MIN_VV, Instruction::MIN_SV, Instruction::MIN_VS, Instruction::MIN_SS, binaryFold<vm::Min>, true, INFINITY, false, false},
+    {Instruction::MAX_VV, Instruction::MAX_SV, Instruction::MAX_VS, Instruction::MAX_SS, binaryFold<vm::Max>, true, -INFINITY, false, false},
+    {Instruction::CLIP_VV, Instruction::CLIP_SV, Instruction::CLIP_VS, Instruction::CLIP_SS, binaryFold<vm::Clip>, false, 0, false, false},
+  };
+  
+  compiler::UnaryOpRule const UnaryRules[] = {
+    {Instruction::SIN_V, Instruction::SIN_S, unaryFold<vm::Sin<Accuracy::Precise>>},
+    {Instruction::COS_V, Instruction::COS_S, unaryFold<vm::Cos<Accuracy::Precise>>},
+    {Instruction::EXP_V, Instruction::EXP_S, unaryFold<vm::Exp<Accuracy::Precise>>},
+    {Instruction::LOG_V, Instruction::LOG_S, unaryFold<vm::Log<Accuracy::Precise>>},
+    {Instruction::TANH_V, Instruction::TANH_S, unaryFold<vm::Tanh<Accuracy::Precise>>},
+    {Instruction::FAST_SIN_V, Instruction::FAST_SIN_S, unaryFold<vm::Sin<Accuracy::Fast>>},
+    {Instruction::FAST_COS_V, Instruction::FAST_COS_S, unaryFold<vm::Cos<Accuracy::Fast>>},
+    {Instruction::FAST_EXP_V, Instruction::FAST_EXP_S, unaryFold<vm::Exp<Accuracy::Fast>>},
+    {Instruction::FAST_LOG_V, Instruction::FAST_LOG_S, unaryFold<vm::Log<Accuracy::Fast>>},
+    {Instruction::FAST_TANH_V, Instruction::FAST_TANH_S, unaryFold<vm::Tanh<Accuracy::Fast>>},
+    {Instruction::ABS_V, Instruction::ABS_S, unaryFold<vm::Abs>},
+  };
+  
+  
+  // True if `value` rounds to exactly `identity`, telling -0 and +0 apart.
+  bool isIdentity(double value, float identity) {
+    float rounded = (float)value;
+    
+    uint32_t bits, identityBits;
+    memcpy(&bits, &rounded, sizeof(bits));
+    memcpy(&identityBits, &identity, sizeof(identityBits));
+    
+    return bits == identityBits;
+  }
+  
+  // Return the constant operand of a binary operation if exactly one operand is
+  // constant, storing the other operand in `other`.
+  cfg::FPValue *constantOperand(cfg::BinaryOp *v, cfg::Value **other) {
+    auto lhs = dynamic_cast<cfg::FPValue *>(v->lhs);
+    auto rhs = dynamic_cast<cfg::FPValue *>(v->rhs);
+    
+    if (lhs && !rhs) {
+      *other = v->rhs;
+      return lhs;
+    }
+    
+    if (rhs && !lhs) {
+      *other = v->lhs;
+      return rhs;
+    }
+    
+    return nullptr;
+  }
+  
+  
+  // CFG visitor simplifying the binary operations within a function.
+  //
+  // Children are simplified before their parents, so constants propagate up through
+  // nested operations.
+  struct Simplify : cfg::Value::MutatingVisitor {
+    Simplify(Arena *arena_, type::Function const *type_, bool reassociate_)
+    : arena(arena_)
+    , type(type_)
+    , reassociate(reassociate_)
+    {}
+    
+    Arena *arena;
+    type::Function const *type;
+    bool reassociate;
+    
+    // Simplified node for each visited node, so shared nodes are only visited once.
+    std::unordered_map<cfg::Value *, cfg::Value *> visited;
+    
+    // Simplified node for the most recently visited value.
+    cfg::Value *result = nullptr;
+    
+    cfg::Value *rewrite(cfg::Value *v) {
+      auto hit = visited.find(v);
+      if (hit != visited.end()) {
+        return hit->second;
+      }
+      
+      result = v;
+      v->visit(this);
+      visited[v] = result;
+      
+      return result;
+    }
+    
+    virtual void acceptCall(cfg::CallFunc *v) {
+      v->function = rewrite(v->function);
+      
+      for (auto &p : v->params) {
+        p = rewrite(p);
+      }
+      
+      result = v;
+    }
+    
+    virtual void acceptBinaryOp(cfg::BinaryOp *v) {
+      v->lhs = rewrite(v->lhs);
+      v->rhs = rewrite(v->rhs);
+      
+      result = simplify(v);
+    }
+    
+    virtual void acceptUnaryOp(cfg::UnaryOp *v) {
+      v->operand = rewrite(v->operand);
+      
+      auto rule = compiler::unaryOpRule(v->operation);
+      auto operand = dynamic_cast<cfg::FPValue *>(v->operand);
+      
+      result = v;
+      
+      if (rule && operand) {
+        result = constant(rule->fold(operand->value));
+      }
+    }
+    
+    // A constant condition chooses the same operand for every sample. The other is only
+    // dropped if that keeps the node's type, since a vector result can't become a scalar.
+    virtual void acceptSelect(cfg::Select *v) {
+      v->condition = rewrite(v->condition);
+      v->ifTrue = rewrite(v->ifTrue);
+      v->ifFalse = rewrite(v->ifFalse);
+      
+      result = v;
+      
+      auto condition = dynamic_cast<cfg::FPValue *>(v->condition);
+      if (!condition) {
+        return;
+      }
+      
+      auto chosen = vm::Select::isTrue(condition->value) ? v->ifTrue : v->ifFalse;
+      
+      if (chosen->typeInFunction(type)->isVector() == v->typeInFunction(type)->isVector()) {
+        result = chosen;
+      }
+    }
+    
+    virtual void acceptFunctionRef(cfg::FunctionRef *v) {}
+    virtual void acceptParamRef(cfg::ParamRef *v) {}
+    virtual void acceptFPValue(cfg::FPValue *v) {}
+    virtual void acceptTableRef(cfg::TableRef *v) {}
+    
+    // Return a simplified equivalent of a binary operation whose operands have already
+    // been simplified.
+    cfg::Value *simplify(cfg::BinaryOp *v) {
+      auto rule = compiler::binaryOpRule(v->operation);
+      if (!rule) {
+        return v;
+      }
+      
+      auto lhs = dynamic_cast<cfg::FPValue *>(v->lhs);
+      auto rhs = dynamic_cast<cfg::FPValue *>(v->rhs);
+      
+      if (lhs && rhs) {
+        return constant(rule->fold(lhs->value, rhs->value));
+      }
+      
+      if (rule->hasIdentity) {
+        if (rhs && isIdentity(rhs->value, rule->identity)) {
+          return v->lhs;
+        }
+        
+        if (lhs && rule->commutative && isIdentity(lhs->value, rule->identity)) {
+          return v->rhs;
+        }
+      }
+      
+      if (reassociate && rule->commutative && rule->associative) {
+        return reassociateConstants(v, rule);
+      }
+      
+      return v;
+    }
+    
+    // Rewrite `(x op c1) op c2` as `x op (c1 op c2)`, in any operand order.
+    cfg::Value *reassociateConstants(cfg::BinaryOp *v, compiler::BinaryOpRule const *rule) {
+      cfg::Value *outer = nullptr;
+      auto outerConstant = constantOperand(v, &outer);
+      
+      auto inner = dynamic_cast<cfg::BinaryOp *>(outer);
+      if (!outerConstant || !inner || compiler::binaryOpRule(inner->operation) != rule) {
+        return v;
+      }
+      
+      cfg::Value *x = nullptr;
+      auto innerConstant = constantOperand(inner, &x);
+      if (!innerConstant) {
+        return v;
+      }
+      
+      // A combined constant that overflows or underflows would change every result, not
+      // just their rounding (`(x * 1e20) * 1e20` isn't `x * inf` for x = 0).
+      auto folded = rule->fold(innerConstant->value, outerConstant->value);
+      if (!std::isnormal(folded)) {
+        return v;
+      }
+      
+      // The inner node may be shared, so build a new node rather than updating it.
+      auto combined = arena->create<cfg::BinaryOp>();
+      combined->operation = rule->variant(x->typeInFunction(type)->isVector(), false);
+      combined->lhs = x;
+      combined->rhs = constant(folded);
+      
+      return simplify(combined);
+    }
+    
+    cfg::FPValue *constant(float value) {
+      auto v = arena->create<cfg::FPValue>();
+      v->value = value;
+      
+      return v;
+    }
+  };
+}
+
+namespace compiler {
+  Instruction::Opcode BinaryOpRule::variant(bool lhsVector, bool rhsVector) const {
+    if (lhsVector) {
+      return rhsVector ? vv : vs;
+      
+    } else {
+      return rhsVector ? sv : ss;
+    }
+  }
+  
+  BinaryOpRule const *binaryOpRule(Instruction::Opcode opcode) {
+    for (auto &rule : Rules) {
+      if (opcode == rule.vv || opcode == rule.sv || opcode == rule.vs || opcode == rule.ss) {
+        return &rule;
+      }
+    }
+    
+    return nullptr;
+  }
+  
+  Instruction::Opcode UnaryOpRule::variant(bool vector) const {
+    return vector ? v : s;
+  }
+  
+  UnaryOpRule const *unaryOpRule(Instruction::Opcode opcode) {
+    for (auto &rule : UnaryRules) {
+      if (opcode == rule.v || opcode == rule.s) {
+        return &rule;
+      }
+    }
+    
+    return nullptr;
+  }
+  
+  void simplifyCFG(Arena *arena, cfg::Package *package, bool reassociate) {
+    for (auto &fn : package->functions) {
+      auto type = dynamic_cast<type::Function const *>(fn.first.type);
+      
+      Simplify visitor(arena, type, reassociate);
+      fn.second = visitor.rewrite(fn.second);
+    }
+  }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "CFG.hpp"
+
+namespace compiler {
+  // Algebraic properties of a binary operation, shared by all of its scalar and
+  // vector variants.
+  //
+  // Optimizations that reason about binary operations look them up here, so that
+  // supporting a new operation only requires adding it to the table.
+  struct BinaryOpRule {
+    // Opcode for each combination of operand types.
+    vm::Instruction::Opcode vv, sv, vs, ss;
+    
+    // Apply the operation to two scalars, matching the VM's single-precision
+    // arithmetic.
+    float (*fold)(float lhs, float rhs);
+    
+    // Operand that leaves the other operand unchanged, if there is one.
+    bool hasIdentity;
+    float identity;
+    
+    bool commutative;
+    bool associative;
+    
+    // Return the variant of the operation taking operands of the given types.
+    vm::Instruction::Opcode variant(bool lhsVector, bool rhsVector) const;
+  };
+  
+  // Return the rule for the operation performed by `opcode`, or null if `opcode` isn't
+  // a binary operation.
+  BinaryOpRule const *binaryOpRule(vm::Instruction::Opcode opcode);
+  
+  // Scalar and vector variants of an operation on one operand.
+  struct UnaryOpRule {
+    vm::Instruction::Opcode v, s;
+    
+    // Apply the operation to a scalar, matching the VM's kernels.
+    float (*fold)(float operand);
+    
+    // Return the variant of the operation taking an operand of the given type.
+    vm::Instruction::Opcode variant(bool vector) const;
+  };
+  
+  // Return the rule for the operation performed by `opcode`, or null if `opcode` isn't
+  // a unary operation.
+  UnaryOpRule const *unaryOpRule(vm::Instruction::Opcode opcode);
+  
+  // Fold constant operations and remove redundant ones.
+  //
+  // Applies the following rewrites to each binary operation:
+  //  - Operations on constants are replaced by their result (as are unary operations).
+  //  - Operations on an identity element (`x * 1`, `x + -0`) are replaced by the other
+  //    operand, which is exact. `x + 0` is kept, since it gives +0 where `x` is -0.
+  //  - If `reassociate` is set, chains of associative operations on constants are
+  //    combined (`(x * 2) * 3` becomes `x * 6`), as long as the combined constant is
+  //    finite and normal. This rounds once rather than twice, so results may differ
+  //    from the original code. For multiplication they differ in the last bit, or
+  //    arbitrarily where the original's intermediate product overflows or underflows:
+  //    `(x * 1e30) * 1e-30` becomes about `x`, where the original is inf for x = 1e20.
+  //    For addition they may differ arbitrarily: `(x + 3e7) + -2e7` becomes `x + 1e7`,
+  //    keeping bits of `x` that the original rounded away.
+  //  - Selects with a constant condition are replaced by the operand it chooses, unless
+  //    that would turn a vector into a scalar.
+  //
+  // Absorbing elements are not used, since `x * 0` is NaN for infinite or NaN `x`.
+  void simplifyCFG(Arena *arena, cfg::Package *package, bool reassociate = true);
+}
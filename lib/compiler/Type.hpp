@@ -6,12 +6,12 @@
 namespace type {
   /**
     Type
-   
+    
     Represent the possible concrete types available to the VM.
-   
+    
     These types are assigned to the CFG on creation and used by the codegen stage
     to emit the appropriate VM instructions.
-   
+    
     Types exist in a hierarchy, rooted at `Any`, with subtypes.
     Polymorphism between coveraint types holds only at compile time.
    */
@@ -73,7 +73,7 @@ namespace type {
   private:
     AnyType() {};
   };
-
+  
   
   // An atomic type, identified by pointer identity.
   //
@@ -62,6 +62,159 @@ namespace vm {
       MUL_VS,
       MUL_SS,
       
+      // Multiply-add
+      //
+      // Computes `a * b + c`, where `a` is the top stack value, `b` is beneath it
+      // and `c` beneath that, and replaces all three with the result. Each sample is
+      // rounded after the multiply and again after the add, so the result is
+      // identical to a MUL followed by an ADD.
+      //
+      // Payload is a u32 stating how many additional stack slots
+      // to pop when returning the value.
+      //
+      // `a` is always a vector. The suffix gives the types of `a`, `b` and `c`:
+      //   VVV - Vector-Vector-Vector
+      //   VSV - Vector-Scalar-Vector
+      //   VVS - Vector-Vector-Scalar
+      //   VSS - Vector-Scalar-Scalar
+      FMA_VVV,
+      FMA_VSV,
+      FMA_VVS,
+      FMA_VSS,
+      
+      // Math ops.
+      //
+      // Compute a transcendental function of the top stack value (or of the top two,
+      // for POW), and replace the operands with the result. Plain ops are computed to
+      // the precise accuracy tier, FAST_ ops to the fast tier (see VMOps.hpp).
+      //
+      // Payload is a u32 stating how many additional stack slots
+      // to pop when returning the value.
+      //
+      // Functions of one operand come in two flavours:
+      //   V - Vector
+      //   S - Scalar
+      //
+      // POW raises the top value to the power of the value beneath it, and comes in
+      // the same four flavours as the arithmetic ops.
+      SIN_V, SIN_S,
+      COS_V, COS_S,
+      EXP_V, EXP_S,
+      LOG_V, LOG_S,
+      TANH_V, TANH_S,
+      POW_VV, POW_SV, POW_VS, POW_SS,
+      
+      FAST_SIN_V, FAST_SIN_S,
+      FAST_COS_V, FAST_COS_S,
+      FAST_EXP_V, FAST_EXP_S,
+      FAST_LOG_V, FAST_LOG_S,
+      FAST_TANH_V, FAST_TANH_S,
+      FAST_POW_VV, FAST_POW_SV, FAST_POW_VS, FAST_POW_SS,
+      
+      // Noise ops.
+      //
+      // Hash the top stack value (a time) with the value beneath it (a seed), and
+      // replace the operands with the result: noise in [0, 1), or in [-1, 1) for
+      // NOISE_BIPOLAR (see VMOps.hpp).
+      //
+      // Payload is a u32 stating how many additional stack slots
+      // to pop when returning the value.
+      //
+      // Comes in the same four flavours as the arithmetic ops.
+      NOISE_VV, NOISE_SV, NOISE_VS, NOISE_SS,
+      NOISE_BIPOLAR_VV, NOISE_BIPOLAR_SV, NOISE_BIPOLAR_VS, NOISE_BIPOLAR_SS,
+      
+      // Table lookup ops.
+      //
+      // Read the package table whose index is the scalar beneath the top stack value
+      // at the top value's phase, and replace both with the result. Phase is measured
+      // in cycles of the table, so wraps around at every integer. TABLE_NEAREST reads
+      // the closest sample, TABLE_LINEAR interpolates linearly between the two
+      // surrounding samples and TABLE_CUBIC fits a Catmull-Rom spline through the four
+      // surrounding samples (see VMOps.hpp).
+      //
+      // The table index is usually pushed as a symbol, which the linker resolves to
+      // the table's index in the package.
+      //
+      // Payload is a u32 stating how many additional stack slots
+      // to pop when returning the value.
+      //
+      // The suffix gives the type of the phase:
+      //   V - Vector
+      //   S - Scalar
+      TABLE_NEAREST_V, TABLE_NEAREST_S,
+      TABLE_LINEAR_V, TABLE_LINEAR_S,
+      TABLE_CUBIC_V, TABLE_CUBIC_S,
+      
+      // Clamping ops.
+      //
+      // MIN and MAX replace the top two stack values with the lesser or greater of
+      // them, and CLIP clips the top value to the range -b..b, where `b` is the
+      // value beneath it. ABS replaces the top value with its magnitude.
+      //
+      // Payload is a u32 stating how many additional stack slots
+      // to pop when returning the value.
+      //
+      // MIN, MAX and CLIP come in the same four flavours as the arithmetic ops, ABS
+      // in the same two flavours as the math ops of one operand.
+      MIN_VV, MIN_SV, MIN_VS, MIN_SS,
+      MAX_VV, MAX_SV, MAX_VS, MAX_SS,
+      CLIP_VV, CLIP_SV, CLIP_VS, CLIP_SS,
+      ABS_V, ABS_S,
+      
+      // Select
+      //
+      // Choose `b` for each sample where `a` is greater than zero, and `c` elsewhere,
+      // where `a` is the top stack value, `b` is beneath it and `c` beneath that, and
+      // replace all three with the result.
+      //
+      // Payload is a u32 stating how many additional stack slots
+      // to pop when returning the value.
+      //
+      // The suffix gives the types of `a`, `b` and `c`. Apart from SSS, which selects
+      // between scalars, `a` is always a vector, as for the multiply-add ops:
+      //   VVV - Vector-Vector-Vector
+      //   VSV - Vector-Scalar-Vector
+      //   VVS - Vector-Vector-Scalar
+      //   VSS - Vector-Scalar-Scalar
+      //   SSS - Scalar-Scalar-Scalar
+      SELECT_VVV,
+      SELECT_VSV,
+      SELECT_VVS,
+      SELECT_VSS,
+      SELECT_SSS,
+      
+      // In-place arithmetic ops.
+      //
+      // Perform the same operation as the op without the suffix, but write the result
+      // into the top operand's vector buffer instead of allocating a new one.
+      //
+      // Requires that the top operand is a strong vector reference and that no other
+      // operand is, so that the top operand's buffer is the top of the vector stack.
+      // Never pops additional stack slots, so has no payload.
+      ADD_VV_INPLACE,
+      ADD_VS_INPLACE,
+      MUL_VV_INPLACE,
+      MUL_VS_INPLACE,
+      FMA_VVV_INPLACE,
+      FMA_VSV_INPLACE,
+      FMA_VVS_INPLACE,
+      FMA_VSS_INPLACE,
+      
+      // Jumps
+      //
+      // Continue execution n instructions further on, where n is the u32 payload.
+      // Jumps only go forwards, so n is at least one.
+      //
+      // JUMP always jumps. JUMP_ALL_TRUE jumps if the top stack value is greater than
+      // zero in every sample, and JUMP_ALL_FALSE if it is greater than zero in none
+      // (as tested by SELECT), popping the value when jumping. Otherwise the value is
+      // left on the stack for the following instructions. The tested value may be a
+      // scalar or a vector.
+      JUMP,
+      JUMP_ALL_TRUE,
+      JUMP_ALL_FALSE,
+      
       // Call function
       //
       // Call the function referenced at stack top, passing parameters from
@@ -119,7 +272,6 @@ namespace vm {
         case DROP_V:
         case PUSH_SYM:
         case CALL:
-        case FILL:
         case ADD_VV:
         case ADD_VS:
         case ADD_SV:
@@ -128,8 +280,50 @@ namespace vm {
         case MUL_VS:
         case MUL_SV:
         case MUL_SS:
+        case FMA_VVV:
+        case FMA_VSV:
+        case FMA_VVS:
+        case FMA_VSS:
+        case SIN_V: case SIN_S:
+        case COS_V: case COS_S:
+        case EXP_V: case EXP_S:
+        case LOG_V: case LOG_S:
+        case TANH_V: case TANH_S:
+        case POW_VV: case POW_SV: case POW_VS: case POW_SS:
+        case FAST_SIN_V: case FAST_SIN_S:
+        case FAST_COS_V: case FAST_COS_S:
+        case FAST_EXP_V: case FAST_EXP_S:
+        case FAST_LOG_V: case FAST_LOG_S:
+        case FAST_TANH_V: case FAST_TANH_S:
+        case FAST_POW_VV: case FAST_POW_SV: case FAST_POW_VS: case FAST_POW_SS:
+        case NOISE_VV: case NOISE_SV: case NOISE_VS: case NOISE_SS:
+        case NOISE_BIPOLAR_VV: case NOISE_BIPOLAR_SV: case NOISE_BIPOLAR_VS: case NOISE_BIPOLAR_SS:
+        case TABLE_NEAREST_V: case TABLE_NEAREST_S:
+        case TABLE_LINEAR_V: case TABLE_LINEAR_S:
+        case TABLE_CUBIC_V: case TABLE_CUBIC_S:
+        case MIN_VV: case MIN_SV: case MIN_VS: case MIN_SS:
+        case MAX_VV: case MAX_SV: case MAX_VS: case MAX_SS:
+        case CLIP_VV: case CLIP_SV: case CLIP_VS: case CLIP_SS:
+        case ABS_V: case ABS_S:
+        case SELECT_VVV:
+        case SELECT_VSV:
+        case SELECT_VVS:
+        case SELECT_VSS:
+        case SELECT_SSS:
+        case JUMP:
+        case JUMP_ALL_TRUE:
+        case JUMP_ALL_FALSE:
           return operand.u32 == rhs.operand.u32;
           
+        case ADD_VV_INPLACE:
+        case ADD_VS_INPLACE:
+        case MUL_VV_INPLACE:
+        case MUL_VS_INPLACE:
+        case FMA_VVV_INPLACE:
+        case FMA_VSV_INPLACE:
+        case FMA_VVS_INPLACE:
+        case FMA_VSS_INPLACE:
+        case FILL:
         case EXIT:
         case RET:
           return true;
@@ -139,18 +333,55 @@ namespace vm {
     inline bool operator!=(const Instruction &rhs) const {
       return !(*this == rhs);
     }
+    
+    // True if the instruction may continue at `operand.u32` instructions further on.
+    bool isJump() const {
+      return operation == JUMP || operation == JUMP_ALL_TRUE || operation == JUMP_ALL_FALSE;
+    }
   };
   
   static_assert(sizeof(Instruction) == 8, "Expected instruction size to be 64 bits");
   
+  // Maximum stack usage while evaluating a function (see vm::stackDepth).
+  struct StackDepth {
+    // # scalar stack slots, including the function's input.
+    uint32_t scalars;
+    
+    // # vectors allocated at once, including the function's input.
+    uint32_t vectors;
+    
+    // # call frames saved at once.
+    uint32_t calls;
+  };
+  
+  // Read-only samples for the table lookup ops, holding one cycle of a waveform.
+  //
+  // The number of samples must be a power of two, so lookups can wrap indices with a
+  // mask.
+  struct Table {
+    Table(Arena *arena, Symbol name_)
+    : name(name_)
+    , samples(arena->allocator<float>())
+    {}
+    
+    bool operator==(Table const &rhs) const {
+      return name == rhs.name && samples == rhs.samples;
+    }
+    
+    Symbol name;
+    Arena::vector<float> samples;
+  };
+  
   struct Package {
     explicit Package(Arena *arena)
     : code(arena->allocator<Instruction>())
     , symbols(arena->allocator<std::pair<Symbol, size_t>>())
+    , tables(arena->allocator<Table>())
+    , stackDepths(arena->allocator<std::pair<Symbol, StackDepth>>())
     {}
     
     bool operator==(Package const &rhs) const {
-      return code == rhs.code && symbols == rhs.symbols;
+      return code == rhs.code && symbols == rhs.symbols && tables == rhs.tables;
     }
     
     inline bool operator!=(Package const &rhs) const {
@@ -159,5 +390,12 @@ namespace vm {
     
     Arena::vector<Instruction> code;
     Arena::unordered_map<Symbol, uint32_t> symbols;
+    
+    // Tables referenced by the code, by index once linked.
+    Arena::vector<Table> tables;
+    
+    // Stack usage of each symbol's function, as computed by the compiler. Derived from
+    // the code, so neither compared nor serialized, and absent from hand-written packages.
+    Arena::unordered_map<Symbol, StackDepth> stackDepths;
   };
 }
@@ -27,7 +27,7 @@ namespace vm {
         
         return state
         >> match("{") >> optionalWhitespace
-        >> delimited(real<float>(collect(&value)), whitespace)
+        >> delimited(signedReal<float>(collect(&value)), whitespace)
         >> optionalWhitespace >> match("}")
         >> inject([&]{ result = Data(Data::F32Value, value.begin(), value.end()); })
         >> emit(&result, out)
@@ -12,9 +12,15 @@ namespace vm {
         
         return state
         >> match("f32") >> spaces
-        >> real(receive(&result.f32))
+        >> signedReal<float>(receive(&result.f32))
         >> emitValue(Data::F32Value, typeOut)
         >> emit(&result, valueOut)
+        
+        ?: state
+        >> match("u32") >> spaces
+        >> integer<uint32_t>(receive(&result.u32))
+        >> emitValue(Data::U32Value, typeOut)
+        >> emit(&result, valueOut)
         ;
       };
     }
@@ -25,6 +31,8 @@ namespace vm {
           return str << "f32 " << inst.operand.f32;
           
         case Data::U32Value:
+          return str << "u32 " << inst.operand.u32;
+          
         case Data::SymbolValue:
           throw std::logic_error("Unsupported operand type");
       }
@@ -44,7 +52,7 @@ namespace vm {
         Instruction result;
         
         auto opcode = [&](Instruction::Opcode op) {
-          return inject([&]{ result.operation = op; });
+          return inject([&result, op]{ result.operation = op; });
         };
         
         auto intOperand = integer<uint32_t>(receive(&result.operand.u32));
@@ -85,6 +93,24 @@ namespace vm {
         >> require("slot offset as operand for drop_v op", spaces >> intOperand)
         >> opcode(Instruction::DROP_V) >> emit(&result, out)
         
+        // In-place ops are matched first, since their names extend the plain ops' names.
+#define InPlaceOp(OPCODE, STR) \
+?: state \
+>> match(STR) \
+>> opcode(Instruction::OPCODE) \
+>> emit(&result, out)
+        
+        InPlaceOp(ADD_VV_INPLACE, "add_vv_inplace")
+        InPlaceOp(ADD_VS_INPLACE, "add_vs_inplace")
+        InPlaceOp(MUL_VV_INPLACE, "mul_vv_inplace")
+        InPlaceOp(MUL_VS_INPLACE, "mul_vs_inplace")
+        InPlaceOp(FMA_VVV_INPLACE, "fma_vvv_inplace")
+        InPlaceOp(FMA_VSV_INPLACE, "fma_vsv_inplace")
+        InPlaceOp(FMA_VVS_INPLACE, "fma_vvs_inplace")
+        InPlaceOp(FMA_VSS_INPLACE, "fma_vss_inplace")
+        
+#undef InPlaceOp
+
 #define BinaryOpType(OPCODE_PREFIX, STR_PREFIX) \
 ?: state \
 >> match(STR_PREFIX "_vv") \
@@ -109,11 +135,83 @@ namespace vm {
 >> require("return offset as operand for " STR_PREFIX "_ss op", spaces >> intOperand) \
 >> opcode(Instruction::OPCODE_PREFIX##_SS) \
 >> emit(&result, out) \
-
+        
         BinaryOpType(ADD, "add")
         BinaryOpType(MUL, "mul")
+        BinaryOpType(POW, "pow")
+        BinaryOpType(FAST_POW, "fast_pow")
+        BinaryOpType(NOISE, "noise")
+        BinaryOpType(NOISE_BIPOLAR, "noise_bipolar")
+        BinaryOpType(MIN, "min")
+        BinaryOpType(MAX, "max")
+        BinaryOpType(CLIP, "clip")
         
 #undef BinaryOpType
+
+#define UnaryOpType(OPCODE_PREFIX, STR_PREFIX) \
+?: state \
+>> match(STR_PREFIX "_v") \
+>> require("return offset as operand for " STR_PREFIX "_v op", spaces >> intOperand) \
+>> opcode(Instruction::OPCODE_PREFIX##_V) \
+>> emit(&result, out) \
+\
+?: state \
+>> match(STR_PREFIX "_s") \
+>> require("return offset as operand for " STR_PREFIX "_s op", spaces >> intOperand) \
+>> opcode(Instruction::OPCODE_PREFIX##_S) \
+>> emit(&result, out) \
+        
+        UnaryOpType(SIN, "sin")
+        UnaryOpType(COS, "cos")
+        UnaryOpType(EXP, "exp")
+        UnaryOpType(LOG, "log")
+        UnaryOpType(TANH, "tanh")
+        UnaryOpType(FAST_SIN, "fast_sin")
+        UnaryOpType(FAST_COS, "fast_cos")
+        UnaryOpType(FAST_EXP, "fast_exp")
+        UnaryOpType(FAST_LOG, "fast_log")
+        UnaryOpType(FAST_TANH, "fast_tanh")
+        UnaryOpType(TABLE_NEAREST, "table_nearest")
+        UnaryOpType(TABLE_LINEAR, "table_linear")
+        UnaryOpType(TABLE_CUBIC, "table_cubic")
+        UnaryOpType(ABS, "abs")
+        
+#undef UnaryOpType
+
+#define TernaryOpVariant(OPCODE, STR) \
+?: state \
+>> match(STR) \
+>> require("return offset as operand for " STR " op", spaces >> intOperand) \
+>> opcode(Instruction::OPCODE) \
+>> emit(&result, out)
+        
+        TernaryOpVariant(FMA_VVV, "fma_vvv")
+        TernaryOpVariant(FMA_VSV, "fma_vsv")
+        TernaryOpVariant(FMA_VVS, "fma_vvs")
+        TernaryOpVariant(FMA_VSS, "fma_vss")
+        TernaryOpVariant(SELECT_VVV, "select_vvv")
+        TernaryOpVariant(SELECT_VSV, "select_vsv")
+        TernaryOpVariant(SELECT_VVS, "select_vvs")
+        TernaryOpVariant(SELECT_VSS, "select_vss")
+        TernaryOpVariant(SELECT_SSS, "select_sss")
+        
+#undef TernaryOpVariant
+        
+        // Conditional jumps are matched first, since their names extend the plain jump's.
+        ?: state
+        >> match("jump_all_true")
+        >> require("instruction count as operand for jump_all_true op", spaces >> intOperand)
+        >> opcode(Instruction::JUMP_ALL_TRUE) >> emit(&result, out)
+        
+        ?: state
+        >> match("jump_all_false")
+        >> require("instruction count as operand for jump_all_false op", spaces >> intOperand)
+        >> opcode(Instruction::JUMP_ALL_FALSE) >> emit(&result, out)
+        
+        ?: state
+        >> match("jump")
+        >> require("instruction count as operand for jump op", spaces >> intOperand)
+        >> opcode(Instruction::JUMP) >> emit(&result, out)
         
         ?: state
         >> match("call")
@@ -131,10 +229,27 @@ namespace vm {
       };
     }
     
-    template <typename Symbol, typename Instruction>
-    auto packageLine(Symbol labelOut, Instruction instructionOut) {
+    // Table definition, eg. `table ramp {0 1 2 3}`
+    template <typename Action>
+    auto table(Action out) {
+      return [=](State const &state) -> Result {
+        Table result(state.arena, Symbol());
+        
+        return state
+        >> match("table") >> spaces
+        >> identifierString(receive(&result.name))
+        >> require("samples for table", spaces >> match("{") >> optionalWhitespace)
+        >> delimited(signedReal<float>(collect(&result.samples)), whitespace)
+        >> optionalWhitespace >> requiredMatch("}")
+        >> emit(&result, out);
+      };
+    }
+    
+    template <typename Symbol, typename Table, typename Instruction>
+    auto packageLine(Symbol labelOut, Table tableOut, Instruction instructionOut) {
       return [=](State const &state) -> Result {
         return state >> label(labelOut)
+        ?: state >> table(tableOut)
         ?: state >> instruction(instructionOut)
         ;
       };
@@ -154,9 +269,13 @@ namespace vm {
           result.symbols[sym] = offset;
         };
         
+        auto receiveTable = [&](Table const &table) {
+          result.tables.push_back(table);
+        };
+        
         return state
         >> optionalWhitespace
-        >> delimited(optionalWhitespace >> packageLine(receiveLabel, receiveInstruction), newline)
+        >> delimited(optionalWhitespace >> packageLine(receiveLabel, receiveTable, receiveInstruction), newline)
         >> optionalWhitespace
         >> emit(&result, out);
       };
@@ -200,9 +319,61 @@ case Instruction::OPCODE_PREFIX##_SS: return str << STR_PREFIX << "_ss" << " " <
       
       BinaryOpType(ADD, "add")
       BinaryOpType(MUL, "mul")
+      BinaryOpType(POW, "pow")
+      BinaryOpType(FAST_POW, "fast_pow")
+      BinaryOpType(NOISE, "noise")
+      BinaryOpType(NOISE_BIPOLAR, "noise_bipolar")
+      BinaryOpType(MIN, "min")
+      BinaryOpType(MAX, "max")
+      BinaryOpType(CLIP, "clip")
       
 #undef BinaryOpType
+
+#define UnaryOpType(OPCODE_PREFIX, STR_PREFIX) \
+case Instruction::OPCODE_PREFIX##_V: return str << STR_PREFIX << "_v" << " " << inst.operand.u32; \
+case Instruction::OPCODE_PREFIX##_S: return str << STR_PREFIX << "_s" << " " << inst.operand.u32;
       
+      UnaryOpType(SIN, "sin")
+      UnaryOpType(COS, "cos")
+      UnaryOpType(EXP, "exp")
+      UnaryOpType(LOG, "log")
+      UnaryOpType(TANH, "tanh")
+      UnaryOpType(FAST_SIN, "fast_sin")
+      UnaryOpType(FAST_COS, "fast_cos")
+      UnaryOpType(FAST_EXP, "fast_exp")
+      UnaryOpType(FAST_LOG, "fast_log")
+      UnaryOpType(FAST_TANH, "fast_tanh")
+      UnaryOpType(TABLE_NEAREST, "table_nearest")
+      UnaryOpType(TABLE_LINEAR, "table_linear")
+      UnaryOpType(TABLE_CUBIC, "table_cubic")
+      UnaryOpType(ABS, "abs")
+      
+#undef UnaryOpType
+    
+    case Instruction::FMA_VVV: return str << "fma_vvv " << inst.operand.u32;
+    case Instruction::FMA_VSV: return str << "fma_vsv " << inst.operand.u32;
+    case Instruction::FMA_VVS: return str << "fma_vvs " << inst.operand.u32;
+    case Instruction::FMA_VSS: return str << "fma_vss " << inst.operand.u32;
+    
+    case Instruction::SELECT_VVV: return str << "select_vvv " << inst.operand.u32;
+    case Instruction::SELECT_VSV: return str << "select_vsv " << inst.operand.u32;
+    case Instruction::SELECT_VVS: return str << "select_vvs " << inst.operand.u32;
+    case Instruction::SELECT_VSS: return str << "select_vss " << inst.operand.u32;
+    case Instruction::SELECT_SSS: return str << "select_sss " << inst.operand.u32;
+    
+    case Instruction::ADD_VV_INPLACE: return str << "add_vv_inplace";
+    case Instruction::ADD_VS_INPLACE: return str << "add_vs_inplace";
+    case Instruction::MUL_VV_INPLACE: return str << "mul_vv_inplace";
+    case Instruction::MUL_VS_INPLACE: return str << "mul_vs_inplace";
+    case Instruction::FMA_VVV_INPLACE: return str << "fma_vvv_inplace";
+    case Instruction::FMA_VSV_INPLACE: return str << "fma_vsv_inplace";
+    case Instruction::FMA_VVS_INPLACE: return str << "fma_vvs_inplace";
+    case Instruction::FMA_VSS_INPLACE: return str << "fma_vss_inplace";
+    
+    case Instruction::JUMP: return str << "jump " << inst.operand.u32;
+    case Instruction::JUMP_ALL_TRUE: return str << "jump_all_true " << inst.operand.u32;
+    case Instruction::JUMP_ALL_FALSE: return str << "jump_all_false " << inst.operand.u32;
+    
     case Instruction::CALL:
       str << "call" << " " << inst.operand.u32;
       return str;
@@ -223,6 +394,20 @@ std::ostream &operator <<(std::ostream &str, vm::Package const &package) {
     symbols.insert(std::make_pair(s.second, s.first));
   }
   
+  for (auto &table : package.tables) {
+    str << "table " << table.name << " {";
+    
+    bool first = true;
+    for (auto x : table.samples) {
+      if (!first) str << " ";
+      str << x;
+      
+      first = false;
+    }
+    
+    str << "}\n";
+  }
+  
   uint32_t i = 0;
   for (auto inst : package.code) {
     auto range = symbols.equal_range(i);
@@ -0,0 +1,129 @@
+#include "VMAbstractEval.hpp"
+
+#include <cstring>
+
+namespace vm {
+  namespace {
+    // Operands typed as by an instruction's suffix, with a letter per operand from the top
+    // ("V" for a vector and "S" for a scalar). The result is a vector if any operand is.
+    OperandTypes suffix(char const *flavour, bool isInPlace = false, bool isLookUp = false) {
+      OperandTypes types = {(uint32_t)std::strlen(flavour), {false, false, false}, false, isInPlace, isLookUp};
+      
+      for (uint32_t i = 0; i < types.count; ++i) {
+        types.isVector[i] = flavour[i] == 'V';
+        types.isVectorResult = types.isVectorResult || types.isVector[i];
+      }
+      
+      return types;
+    }
+  }
+  
+  bool operandTypes(Instruction::Opcode opcode, OperandTypes *types) {
+    switch (opcode) {
+      case Instruction::SIN_V:
+      case Instruction::COS_V:
+      case Instruction::EXP_V:
+      case Instruction::LOG_V:
+      case Instruction::TANH_V:
+      case Instruction::FAST_SIN_V:
+      case Instruction::FAST_COS_V:
+      case Instruction::FAST_EXP_V:
+      case Instruction::FAST_LOG_V:
+      case Instruction::FAST_TANH_V:
+      case Instruction::ABS_V:
+        *types = suffix("V");
+        return true;
+      
+      case Instruction::SIN_S:
+      case Instruction::COS_S:
+      case Instruction::EXP_S:
+      case Instruction::LOG_S:
+      case Instruction::TANH_S:
+      case Instruction::FAST_SIN_S:
+      case Instruction::FAST_COS_S:
+      case Instruction::FAST_EXP_S:
+      case Instruction::FAST_LOG_S:
+      case Instruction::FAST_TANH_S:
+      case Instruction::ABS_S:
+        *types = suffix("S");
+        return true;
+      
+      case Instruction::ADD_VV:
+      case Instruction::MUL_VV:
+      case Instruction::POW_VV:
+      case Instruction::FAST_POW_VV:
+      case Instruction::NOISE_VV:
+      case Instruction::NOISE_BIPOLAR_VV:
+      case Instruction::MIN_VV:
+      case Instruction::MAX_VV:
+      case Instruction::CLIP_VV:
+        *types = suffix("VV");
+        return true;
+      
+      case Instruction::ADD_SV:
+      case Instruction::MUL_SV:
+      case Instruction::POW_SV:
+      case Instruction::FAST_POW_SV:
+      case Instruction::NOISE_SV:
+      case Instruction::NOISE_BIPOLAR_SV:
+      case Instruction::MIN_SV:
+      case Instruction::MAX_SV:
+      case Instruction::CLIP_SV:
+        *types = suffix("SV");
+        return true;
+      
+      case Instruction::ADD_VS:
+      case Instruction::MUL_VS:
+      case Instruction::POW_VS:
+      case Instruction::FAST_POW_VS:
+      case Instruction::NOISE_VS:
+      case Instruction::NOISE_BIPOLAR_VS:
+      case Instruction::MIN_VS:
+      case Instruction::MAX_VS:
+      case Instruction::CLIP_VS:
+        *types = suffix("VS");
+        return true;
+      
+      case Instruction::ADD_SS:
+      case Instruction::MUL_SS:
+      case Instruction::POW_SS:
+      case Instruction::FAST_POW_SS:
+      case Instruction::NOISE_SS:
+      case Instruction::NOISE_BIPOLAR_SS:
+      case Instruction::MIN_SS:
+      case Instruction::MAX_SS:
+      case Instruction::CLIP_SS:
+        *types = suffix("SS");
+        return true;
+      
+      case Instruction::FMA_VVV: case Instruction::SELECT_VVV: *types = suffix("VVV"); return true;
+      case Instruction::FMA_VSV: case Instruction::SELECT_VSV: *types = suffix("VSV"); return true;
+      case Instruction::FMA_VVS: case Instruction::SELECT_VVS: *types = suffix("VVS"); return true;
+      case Instruction::FMA_VSS: case Instruction::SELECT_VSS: *types = suffix("VSS"); return true;
+      case Instruction::SELECT_SSS: *types = suffix("SSS"); return true;
+      
+      // The phase is the top operand, and the table index beneath it.
+      case Instruction::TABLE_NEAREST_V:
+      case Instruction::TABLE_LINEAR_V:
+      case Instruction::TABLE_CUBIC_V:
+        *types = suffix("VS", false, true);
+        return true;
+      
+      case Instruction::TABLE_NEAREST_S:
+      case Instruction::TABLE_LINEAR_S:
+      case Instruction::TABLE_CUBIC_S:
+        *types = suffix("SS", false, true);
+        return true;
+      
+      case Instruction::ADD_VV_INPLACE: case Instruction::MUL_VV_INPLACE: *types = suffix("VV", true); return true;
+      case Instruction::ADD_VS_INPLACE: case Instruction::MUL_VS_INPLACE: *types = suffix("VS", true); return true;
+      case Instruction::FMA_VVV_INPLACE: *types = suffix("VVV", true); return true;
+      case Instruction::FMA_VSV_INPLACE: *types = suffix("VSV", true); return true;
+      case Instruction::FMA_VVS_INPLACE: *types = suffix("VVS", true); return true;
+      case Instruction::FMA_VSS_INPLACE: *types = suffix("VSS", true); return true;
+      
+      default:
+        return false;
+    }
+  }
+}
@@ -0,0 +1,346 @@
+#pragma once
+
+#include "Instruction.hpp"
+#include "Symbol.hpp"
+#include "VMStackDepth.hpp"
+#include "VMState.hpp"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vm {
+  /**
+   Abstract Evaluation
+   
+   Code is straight-line apart from forward jumps, so evaluating a function executes
+   one of a few paths through it, depending on the conditions tested by conditional
+   jumps. Analyses follow every path exactly as evaluation would, tracking an abstract
+   value in place of each scalar slot. Paths meet again where jumps land, so each state
+   reaching a jump target is only followed once.
+   
+   AbstractEval evaluates the control flow (jumps, calls and returns) and the operand
+   counts of each instruction. Each analysis derives from it, supplying its slot type and
+   what instructions do with slots, through these members:
+   
+      * push(slot) and pop(count), which keep `vectors` as the # strong references.
+      * at(offset), the slot n-th from the top, and get(offset, isVector) for an operand
+        of that type.
+      * constant(value) and linkedSymbol(symbol), the slots pushed by PUSH and PUSH_SYM.
+      * copy(slot), reference(slot) and dropVector(slot), the slots pushed by COPY,
+        REF_VEC and DROP_V.
+      * isUniform(slot), whether a vector operand is uniform.
+      * pushResult(isVector, isUniform), pushing the result of an operation.
+      * collapse(count), writing a result in place (see VMState::collapse).
+      * lookUp(slot), checking the table looked up by an operation.
+      * callTarget(slot, &address), the address a call jumps to. Returns false to give up.
+      * enteredCall() after pushing a call frame, and exited() as a path exits.
+      * fail(reason), which throws.
+   */
+  
+  // Operand types of an operation, which pops its operands from the top of the stack and
+  // pushes its result.
+  struct OperandTypes {
+    // # operands, popped along with those the instruction's operand counts.
+    uint32_t count;
+    
+    // Whether each operand (the top first) is a vector.
+    bool isVector[3];
+    
+    bool isVectorResult;
+    
+    // True if the result is written over the top operand, when it can be. Only the
+    // operands are popped.
+    bool isInPlace;
+    
+    // True if the second operand is the index of a table looked up.
+    bool isLookUp;
+  };
+  
+  // Describe the operands of an arithmetic, math, select or table operation into `types`.
+  // Returns false for other instructions.
+  bool operandTypes(Instruction::Opcode opcode, OperandTypes *types);
+  
+  
+  template <class Analysis, class Slot>
+  class AbstractEval {
+  public:
+    // Follow every path through the function, evaluated against a vector input as Context
+    // does. Returns false if the analysis gave up on a call.
+    bool run();
+    
+  protected:
+    AbstractEval(Package const *package_, Symbol symbol_, uint32_t entry, Slot input)
+    : package(package_)
+    , symbol(symbol_)
+    , stack{input}
+    , vectors(1)
+    , instPtr(entry)
+    , resultOffset(0)
+    , popCount(0) {
+    }
+    
+    Package const *package;
+    Symbol symbol;
+    
+    std::vector<Slot> stack;
+    std::vector<CallFrame> frames;
+    uint32_t vectors;
+    
+    uint32_t instPtr;
+    uint32_t resultOffset;
+    uint32_t popCount;
+    
+  private:
+    // State of evaluation at an instruction, where paths through the code fork or meet.
+    struct Path {
+      std::vector<Slot> stack;
+      std::vector<CallFrame> frames;
+      uint32_t vectors;
+      uint32_t instPtr;
+      uint32_t resultOffset;
+      uint32_t popCount;
+    };
+    
+    // Paths taking conditional jumps, followed once the current path exits.
+    std::vector<Path> forks;
+    
+    // States that reached each jump target so far. Paths meet where jumps land, and
+    // following one from a state already seen there would analyse the same code again.
+    std::unordered_map<uint32_t, std::vector<Path>> landed;
+    
+    Analysis &analysis() {
+      return *static_cast<Analysis *>(this);
+    }
+    
+    Path save(uint32_t target) const {
+      return Path{stack, frames, vectors, target, resultOffset, popCount};
+    }
+    
+    // Continue with the last forked path. Returns false if every path has been followed.
+    bool resume();
+    
+    bool isSameState(Path const &path) const;
+    
+    // True if the current state already reached this jump target, otherwise records it.
+    bool hasLanded(std::vector<Path> *states);
+    
+    // Return the instruction a jump lands at, which must be further on in the code.
+    uint32_t jumpTarget(uint32_t distance);
+  };
+  
+  
+  template <class Analysis, class Slot>
+  inline bool AbstractEval<Analysis, Slot>::resume() {
+    if (forks.empty()) {
+      return false;
+    }
+    
+    auto &path = forks.back();
+    stack = std::move(path.stack);
+    frames = std::move(path.frames);
+    vectors = path.vectors;
+    instPtr = path.instPtr;
+    resultOffset = path.resultOffset;
+    popCount = path.popCount;
+    
+    forks.pop_back();
+    return true;
+  }
+  
+  template <class Analysis, class Slot>
+  inline bool AbstractEval<Analysis, Slot>::isSameState(Path const &path) const {
+    return path.stack == stack && path.resultOffset == resultOffset && path.popCount == popCount
+    && std::equal(path.frames.begin(), path.frames.end(), frames.begin(), frames.end(), [](CallFrame const &a, CallFrame const &b) {
+      return a.returnAddress == b.returnAddress && a.resultOffset == b.resultOffset && a.popCount == b.popCount;
+    });
+  }
+  
+  template <class Analysis, class Slot>
+  inline bool AbstractEval<Analysis, Slot>::hasLanded(std::vector<Path> *states) {
+    if (std::any_of(states->begin(), states->end(), [this](Path const &path) { return isSameState(path); })) {
+      return true;
+    }
+    
+    states->push_back(save(instPtr));
+    return false;
+  }
+  
+  template <class Analysis, class Slot>
+  inline uint32_t AbstractEval<Analysis, Slot>::jumpTarget(uint32_t distance) {
+    if (distance == 0 || distance >= package->code.size() - instPtr) {
+      analysis().fail("jumps outside the code");
+    }
+    
+    auto target = instPtr + distance;
+    landed[target];
+    
+    return target;
+  }
+  
+  template <class Analysis, class Slot>
+  inline bool AbstractEval<Analysis, Slot>::run() {
+    auto &self = analysis();
+    
+    for (size_t step = 0; step < MaxStackDepthSteps; ++step) {
+      if (instPtr >= package->code.size()) {
+        self.fail("runs past the end of the code");
+      }
+      
+      if (!landed.empty()) {
+        auto target = landed.find(instPtr);
+        
+        if (target != landed.end() && hasLanded(&target->second)) {
+          if (!resume()) {
+            return true;
+          }
+          
+          continue;
+        }
+      }
+      
+      auto inst = package->code[instPtr];
+      auto pops = inst.operand.u32 + resultOffset;
+      
+      OperandTypes types;
+      
+      if (operandTypes(inst.operation, &types)) {
+        auto uniform = true;
+        
+        for (uint32_t i = 0; i < types.count; ++i) {
+          auto operand = self.get(i + 1, types.isVector[i]);
+          uniform = uniform && (!types.isVector[i] || self.isUniform(operand));
+        }
+        
+        if (types.isLookUp) {
+          self.lookUp(self.get(2, false));
+        }
+        
+        // Uniform vectors have no buffer to write in place, so their results are
+        // allocated (or uniform) as usual.
+        if (!types.isInPlace) {
+          self.pop(pops + types.count);
+          self.pushResult(types.isVectorResult, uniform);
+          
+        } else if (self.isUniform(self.get(1, true))) {
+          self.pop(types.count);
+          self.pushResult(true, uniform);
+          
+        } else {
+          self.collapse(types.count);
+        }
+        
+        ++instPtr;
+        continue;
+      }
+      
+      switch (inst.operation) {
+        case Instruction::PUSH:
+          self.push(self.constant(inst.operand.u32));
+          break;
+        
+        case Instruction::PUSH_SYM:
+          self.push(self.linkedSymbol(inst.operand.sym));
+          break;
+        
+        case Instruction::COPY:
+          self.push(self.copy(self.at(inst.operand.u32)));
+          break;
+        
+        case Instruction::REF_VEC:
+          self.push(self.reference(self.get(inst.operand.u32, true)));
+          break;
+        
+        case Instruction::DROP_S: {
+          auto src = self.get(1, false);
+          self.pop(pops + 1);
+          self.push(src);
+          break;
+        }
+        
+        case Instruction::DROP_V: {
+          auto src = self.get(1, true);
+          self.pop(pops + 1);
+          self.push(self.dropVector(src));
+          break;
+        }
+        
+        case Instruction::FILL:
+          self.get(1, false);
+          self.pop(1);
+          self.pushResult(true, true);
+          break;
+        
+        case Instruction::JUMP:
+          instPtr = jumpTarget(inst.operand.u32);
+          continue;
+        
+        // The path taking the jump pops the condition, and is followed later.
+        case Instruction::JUMP_ALL_TRUE:
+        case Instruction::JUMP_ALL_FALSE: {
+          auto condition = self.at(1);
+          auto target = jumpTarget(inst.operand.u32);
+          
+          self.pop(1);
+          forks.push_back(save(target));
+          
+          self.push(condition);
+          break;
+        }
+        
+        case Instruction::CALL: {
+          auto target = self.get(1, false);
+          self.pop(1);
+          
+          uint32_t address;
+          
+          if (!self.callTarget(target, &address)) {
+            return false;
+          }
+          
+          if (instPtr + 1 >= package->code.size() || package->code[instPtr + 1].operation != Instruction::EXIT) {
+            frames.push_back({instPtr + 1, resultOffset, popCount});
+            self.enteredCall();
+          }
+          
+          instPtr = address;
+          resultOffset = 0;
+          popCount = pops;
+          
+          continue;
+        }
+        
+        case Instruction::RET:
+          resultOffset = popCount;
+          break;
+        
+        case Instruction::EXIT:
+          if (frames.empty()) {
+            self.exited();
+          
+            if (resume()) {
+              continue;
+            }
+          
+            return true;
+          }
+        
+          instPtr = frames.back().returnAddress;
+          resultOffset = frames.back().resultOffset;
+          popCount = frames.back().popCount;
+          frames.pop_back();
+        
+          continue;
+        
+        default:
+          self.fail("unknown instruction");
+      }
+      
+      ++instPtr;
+    }
+    
+    self.fail("doesn't exit within " + std::to_string(MaxStackDepthSteps) + " instructions");
+    return false;
+  }
+}
@@ -1,25 +1,93 @@
 #include "VMEval.hpp"
+#include "VMJit.hpp"
+#include "VMLink.hpp"
 #include "VMOps.hpp"
+#include "VMStackDepth.hpp"
 #include "VMState.hpp"
+#include "VMVerify.hpp"
 #include "Instruction.hpp"
 #include "SerializeInstruction.hpp"
 
+#include <algorithm>
+#include <type_traits>
+
+#include <cstdlib>
+#include <sys/mman.h>
+
+// Computed goto (used for threaded dispatch) is a GNU extension, also supported by Clang.
+#if defined(__GNUC__) && !defined(TEMPO_NO_THREADED_DISPATCH)
+#define TEMPO_THREADED_DISPATCH 1
+#endif
+
 namespace vm {
-  template <typename Op>
-  void vectorVectorOp(VMState *vm, uint32_t pop, Op op);
+  template <class VM, typename Op>
+  void vectorVectorOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void vectorScalarOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void scalarVectorOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void scalarScalarOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void uniformOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void vectorUnaryOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void scalarUnaryOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void vectorTableOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void scalarTableOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  bool shortCircuitOp(VM *vm, uint32_t pop, Op op, ScalarStackSlot scalar, uint32_t vectorOffset);
+  
+  template <bool VectorMul, bool VectorAdd, class VM, typename Op>
+  void multiplyAddOp(VM *vm, uint32_t pop, Op op);
+  
+  template <bool VectorMul, bool VectorAdd, class VM>
+  void uniformMultiplyAddOp(VM *vm, uint32_t pop);
+  
+  template <bool VectorTrue, bool VectorFalse, class VM, typename Op>
+  void selectOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void scalarSelectOp(VM *vm, uint32_t pop, Op op);
   
-  template <typename Op>
-  void vectorScalarOp(VMState *vm, uint32_t pop, Op op);
+  template <bool AllTrue, class VM, typename Op>
+  bool jumpOp(VM *vm, Op op);
   
-  template <typename Op>
-  void scalarVectorOp(VMState *vm, uint32_t pop, Op op);
+  template <class VM, typename Op>
+  void vectorVectorOpInPlace(VM *vm, Op op);
   
-  template <typename Op>
-  void scalarScalarOp(VMState *vm, uint32_t pop, Op op);
+  template <class VM, typename Op>
+  void vectorScalarOpInPlace(VM *vm, Op op);
+  
+  template <bool VectorMul, bool VectorAdd, class VM, typename Op>
+  void multiplyAddOpInPlace(VM *vm, Op op);
+  
+  template <class VM>
+  void dropScalar(VM *vm, uint32_t offset);
+  
+  template <class VM>
+  void dropVector(VM *vm, uint32_t offset);
+  
+  template <class VM>
+  void fill(VM *vm);
+  
+  [[noreturn]] void unlinkedSymbol(Symbol sym);
   
   
   // Lookup a symbol from package and return the instruction pointer
-  uint32_t lookup(Package *package, Symbol sym) {
+  uint32_t lookup(Package const *package, Symbol sym) {
     auto hit = package->symbols.find(sym);
     
     if (hit == package->symbols.end()) {
@@ -34,14 +102,21 @@ namespace vm {
   
   // Main VM evaluation loop
   //
+  // Calls are evaluated within the loop, with the caller's state saved to the VM's
+  // call stack, so evaluation uses constant native stack space.
+  //
   // vm:        VM state object.
-  // package:   Package containing code and symbol definitions.
+  // package:   Linked package containing code and symbol definitions.
   // InstPtr:   Pointer to first instruction.
-  // popCount:  Overwrite n-many values from stack when returning.
   
-  void eval(VMState *vm, Package *package, uint32_t instPtr, uint32_t popCount) {
+  template <class VM>
+  void eval(VM *vm, Package const *package, uint32_t instPtr) {
+    // Offset applied to popping instructions. Set to popCount by RET.
     uint32_t resultOffset = 0;
     
+    // Overwrite n-many values from stack when the current function returns.
+    uint32_t popCount = 0;
+    
     while (true) {
       auto inst = package->code[instPtr];
       
@@ -50,17 +125,9 @@ namespace vm {
           vm->push({ScalarFP, inst.operand});
           break;
           
-        case Instruction::PUSH_SYM: {
-          auto sym = inst.operand.sym;
-          auto fPtr = lookup(package, sym);
-          
-          vm->push({ScalarFP, fPtr});
+        case Instruction::PUSH_SYM:
+          unlinkedSymbol(inst.operand.sym);
           
-          // Fixup the instruction so future calls skip the symbol lookup
-          package->code[instPtr] = Instruction(Instruction::PUSH, fPtr, Data::U32Value);
-          
-          break;
-        }
         case Instruction::COPY:
           vm->push(vm->get(inst.operand.u32));
           break;
@@ -69,63 +136,34 @@ namespace vm {
           vm->push(vm->reference(vm->get(inst.operand.u32)));
           break;
           
-        case Instruction::DROP_S: {
-          // Consume the top slot + specified offset + return offset
-          auto offset = inst.operand.u32 + resultOffset + 1;
-          auto src = vm->get(1);
-          
-          vm->pop(offset);
-          vm->push(src);
-          
+        case Instruction::DROP_S:
+          dropScalar(vm, inst.operand.u32 + resultOffset);
           break;
-        }
-        case Instruction::DROP_V: {
-          // Consume the top slot + specified offset + return offset
-          auto offset = inst.operand.u32 + resultOffset + 1;
-          auto src = vm->get(1);
-          
-          auto newTop = 1 + vm->stackTop() - offset;
-          
-          if (newTop < src.payload.u32) {
-            // Dropping a vector to below the location of its strong ref requires a copy.
-            //
-            // This should only happen in very rare cases, such as when a parameter
-            // to a function invoked via polymorphic dispatch is returned immediately without
-            // being modified.
-            
-            auto srcVec = vm->dereference(src);
-            vm->pop(offset);
-            
-            auto destVec = vm->dereference(vm->alloc());
-            std::copy_n(srcVec, vm->frameSamples(), destVec);
-            
-          } else if (newTop > src.payload.u32) {
-            // Dropping a vector to a slot above the location of its strong ref just pushes a
-            // an additional ref.
-            
-            vm->pop(offset);
-            vm->push(vm->reference(src));
-          }
           
+        case Instruction::DROP_V:
+          dropVector(vm, inst.operand.u32 + resultOffset);
           break;
-        }
-        case Instruction::FILL: {
-          auto val = vm->get(1);
-          vm->pop();
-          
-          auto ref = vm->alloc();
-          std::fill_n(vm->dereference(ref), vm->frameSamples(), val.payload);
           
+        case Instruction::FILL:
+          fill(vm);
           break;
-        }
+          
         case Instruction::CALL: {
           auto fnPtr = vm->get(1).payload.u32;
           auto retSlot = inst.operand.u32 + resultOffset;
           
           vm->pop();
-          eval(vm, package, fnPtr, retSlot);
           
-          break;
+          // Tail calls return directly to the caller's caller, so don't need a frame.
+          if (package->code[instPtr + 1].operation != Instruction::EXIT) {
+            vm->pushFrame({instPtr + 1, resultOffset, popCount});
+          }
+          
+          instPtr = fnPtr;
+          resultOffset = 0;
+          popCount = retSlot;
+          
+          continue;
         }
           
           // Handler for each variant of each binary operation:
@@ -137,15 +175,102 @@ case Instruction::OPCODE_PREFIX##_SS: scalarScalarOp(vm, inst.operand.u32 + resu
           
           BINARY_OP_VARIANTS(ADD, Add);
           BINARY_OP_VARIANTS(MUL, Multiply);
+          BINARY_OP_VARIANTS(POW, Pow<Accuracy::Precise>);
+          BINARY_OP_VARIANTS(FAST_POW, Pow<Accuracy::Fast>);
+          BINARY_OP_VARIANTS(NOISE, Noise<false>);
+          BINARY_OP_VARIANTS(NOISE_BIPOLAR, Noise<true>);
+          BINARY_OP_VARIANTS(MIN, Min);
+          BINARY_OP_VARIANTS(MAX, Max);
+          BINARY_OP_VARIANTS(CLIP, Clip);
           
 #undef BINARY_OP_VARIANTS
           
+          // Handler for each variant of each math operation of one operand:
+#define UNARY_OP_VARIANTS(OPCODE_PREFIX, OPERATION) \
+case Instruction::OPCODE_PREFIX##_V: vectorUnaryOp(vm, inst.operand.u32 + resultOffset, OPERATION()); break; \
+case Instruction::OPCODE_PREFIX##_S: scalarUnaryOp(vm, inst.operand.u32 + resultOffset, OPERATION()); break;
+          
+          UNARY_OP_VARIANTS(SIN, Sin<Accuracy::Precise>);
+          UNARY_OP_VARIANTS(COS, Cos<Accuracy::Precise>);
+          UNARY_OP_VARIANTS(EXP, Exp<Accuracy::Precise>);
+          UNARY_OP_VARIANTS(LOG, Log<Accuracy::Precise>);
+          UNARY_OP_VARIANTS(TANH, Tanh<Accuracy::Precise>);
+          UNARY_OP_VARIANTS(FAST_SIN, Sin<Accuracy::Fast>);
+          UNARY_OP_VARIANTS(FAST_COS, Cos<Accuracy::Fast>);
+          UNARY_OP_VARIANTS(FAST_EXP, Exp<Accuracy::Fast>);
+          UNARY_OP_VARIANTS(FAST_LOG, Log<Accuracy::Fast>);
+          UNARY_OP_VARIANTS(FAST_TANH, Tanh<Accuracy::Fast>);
+          UNARY_OP_VARIANTS(ABS, Abs);
+          
+#undef UNARY_OP_VARIANTS
+          
+          // Handler for each variant of each table lookup:
+#define TABLE_OP_VARIANTS(OPCODE_PREFIX, OPERATION) \
+case Instruction::OPCODE_PREFIX##_V: vectorTableOp(vm, inst.operand.u32 + resultOffset, OPERATION()); break; \
+case Instruction::OPCODE_PREFIX##_S: scalarTableOp(vm, inst.operand.u32 + resultOffset, OPERATION()); break;
+          
+          TABLE_OP_VARIANTS(TABLE_NEAREST, TableLookup<Interpolation::Nearest>);
+          TABLE_OP_VARIANTS(TABLE_LINEAR, TableLookup<Interpolation::Linear>);
+          TABLE_OP_VARIANTS(TABLE_CUBIC, TableLookup<Interpolation::Cubic>);
+          
+#undef TABLE_OP_VARIANTS
+        
+        case Instruction::FMA_VVV: multiplyAddOp<true, true>(vm, inst.operand.u32 + resultOffset, MultiplyAdd()); break;
+        case Instruction::FMA_VSV: multiplyAddOp<false, true>(vm, inst.operand.u32 + resultOffset, MultiplyAdd()); break;
+        case Instruction::FMA_VVS: multiplyAddOp<true, false>(vm, inst.operand.u32 + resultOffset, MultiplyAdd()); break;
+        case Instruction::FMA_VSS: multiplyAddOp<false, false>(vm, inst.operand.u32 + resultOffset, MultiplyAdd()); break;
+        
+        case Instruction::SELECT_VVV: selectOp<true, true>(vm, inst.operand.u32 + resultOffset, Select()); break;
+        case Instruction::SELECT_VSV: selectOp<false, true>(vm, inst.operand.u32 + resultOffset, Select()); break;
+        case Instruction::SELECT_VVS: selectOp<true, false>(vm, inst.operand.u32 + resultOffset, Select()); break;
+        case Instruction::SELECT_VSS: selectOp<false, false>(vm, inst.operand.u32 + resultOffset, Select()); break;
+        case Instruction::SELECT_SSS: scalarSelectOp(vm, inst.operand.u32 + resultOffset, Select()); break;
+        
+        case Instruction::ADD_VV_INPLACE: vectorVectorOpInPlace(vm, Add()); break;
+        case Instruction::ADD_VS_INPLACE: vectorScalarOpInPlace(vm, Add()); break;
+        case Instruction::MUL_VV_INPLACE: vectorVectorOpInPlace(vm, Multiply()); break;
+        case Instruction::MUL_VS_INPLACE: vectorScalarOpInPlace(vm, Multiply()); break;
+        case Instruction::FMA_VVV_INPLACE: multiplyAddOpInPlace<true, true>(vm, MultiplyAdd()); break;
+        case Instruction::FMA_VSV_INPLACE: multiplyAddOpInPlace<false, true>(vm, MultiplyAdd()); break;
+        case Instruction::FMA_VVS_INPLACE: multiplyAddOpInPlace<true, false>(vm, MultiplyAdd()); break;
+        case Instruction::FMA_VSS_INPLACE: multiplyAddOpInPlace<false, false>(vm, MultiplyAdd()); break;
+        
+        case Instruction::JUMP:
+          instPtr += inst.operand.u32;
+          continue;
+          
+        case Instruction::JUMP_ALL_TRUE:
+          if (jumpOp<true>(vm, Select())) {
+            instPtr += inst.operand.u32;
+            continue;
+          }
+          
+          break;
+          
+        case Instruction::JUMP_ALL_FALSE:
+          if (jumpOp<false>(vm, Select())) {
+            instPtr += inst.operand.u32;
+            continue;
+          }
+          
+          break;
+          
         case Instruction::RET:
           resultOffset = popCount;
           break;
           
-        case Instruction::EXIT:
-          return;
+        case Instruction::EXIT: {
+          CallFrame frame;
+          if (!vm->popFrame(&frame)) {
+            return;
+          }
+          
+          instPtr = frame.returnAddress;
+          resultOffset = frame.resultOffset;
+          popCount = frame.popCount;
+          
+          continue;
+        }
       }
       
       ++instPtr;
@@ -153,127 +278,1669 @@ case Instruction::OPCODE_PREFIX##_SS: scalarScalarOp(vm, inst.operand.u32 + resu
   }
   
   
-  // Test function.
+  // Pre-decoded instruction for direct-threaded dispatch.
+  //
+  // Replaces the opcode with the address of its handler in `evalThreaded`, so that
+  // each handler can jump straight to the next without going through a switch.
+  struct ThreadedInstruction {
+    void const *handler;
+    Data::Value operand;
+  };
+  
+  
+#ifdef TEMPO_THREADED_DISPATCH
+  
+  // Direct-threaded VM evaluation loop.
   //
-  // Push a vector parameter onto the stack, execute a function and return the value.
+  // Behaves exactly as `eval`, but runs code pre-decoded by `decodeThreaded`.
   //
-  //   package:     Package containing code.
-  //   symbol:      Name of function to execute.
-  //   param:       Parameter for the function.
-  //   stackSize:   Stack sizes to use for evaluation (default 16k)
+  // vm:          VM state object.
+  // code:        Decoded instructions.
+  // instPtr:     Pointer to first instruction.
+  // handlersOut: If non-null, receives the opcode -> handler address table instead of
+  //              executing any code. Label addresses are only visible in this function.
   
-  Data eval(Package *package, Symbol symbol, Data const &param, size_t stackSize) {
-    std::vector<ScalarStackSlot> scalarStack;
-    scalarStack.resize(stackSize);
+  template <class VM>
+  void evalThreaded(VM *vm, ThreadedInstruction const *code, uint32_t instPtr, void const *const **handlersOut = nullptr) {
+    // Handler addresses, indexed by opcode
+    static void const *const handlers[] = {
+      &&PUSH,
+      &&PUSH_SYM,
+      &&COPY,
+      &&REF_VEC,
+      &&DROP_S,
+      &&DROP_V,
+      &&FILL,
+      &&ADD_VV, &&ADD_SV, &&ADD_VS, &&ADD_SS,
+      &&MUL_VV, &&MUL_SV, &&MUL_VS, &&MUL_SS,
+      &&FMA_VVV, &&FMA_VSV, &&FMA_VVS, &&FMA_VSS,
+      &&SIN_V, &&SIN_S, &&COS_V, &&COS_S, &&EXP_V, &&EXP_S, &&LOG_V, &&LOG_S, &&TANH_V, &&TANH_S,
+      &&POW_VV, &&POW_SV, &&POW_VS, &&POW_SS,
+      &&FAST_SIN_V, &&FAST_SIN_S, &&FAST_COS_V, &&FAST_COS_S, &&FAST_EXP_V, &&FAST_EXP_S,
+      &&FAST_LOG_V, &&FAST_LOG_S, &&FAST_TANH_V, &&FAST_TANH_S,
+      &&FAST_POW_VV, &&FAST_POW_SV, &&FAST_POW_VS, &&FAST_POW_SS,
+      &&NOISE_VV, &&NOISE_SV, &&NOISE_VS, &&NOISE_SS,
+      &&NOISE_BIPOLAR_VV, &&NOISE_BIPOLAR_SV, &&NOISE_BIPOLAR_VS, &&NOISE_BIPOLAR_SS,
+      &&TABLE_NEAREST_V, &&TABLE_NEAREST_S, &&TABLE_LINEAR_V, &&TABLE_LINEAR_S, &&TABLE_CUBIC_V, &&TABLE_CUBIC_S,
+      &&MIN_VV, &&MIN_SV, &&MIN_VS, &&MIN_SS,
+      &&MAX_VV, &&MAX_SV, &&MAX_VS, &&MAX_SS,
+      &&CLIP_VV, &&CLIP_SV, &&CLIP_VS, &&CLIP_SS,
+      &&ABS_V, &&ABS_S,
+      &&SELECT_VVV, &&SELECT_VSV, &&SELECT_VVS, &&SELECT_VSS, &&SELECT_SSS,
+      &&ADD_VV_INPLACE, &&ADD_VS_INPLACE,
+      &&MUL_VV_INPLACE, &&MUL_VS_INPLACE,
+      &&FMA_VVV_INPLACE, &&FMA_VSV_INPLACE, &&FMA_VVS_INPLACE, &&FMA_VSS_INPLACE,
+      &&JUMP, &&JUMP_ALL_TRUE, &&JUMP_ALL_FALSE,
+      &&CALL,
+      &&RET,
+      &&EXIT
+    };
     
-    std::vector<VectorStackSlot> vectorStack;
-    vectorStack.resize(stackSize);
+    static_assert(sizeof(handlers) / sizeof(*handlers) == Instruction::EXIT + 1, "Every opcode should have a handler");
     
-    VMState state(scalarStack.data(), 0, vectorStack.data(), 0, param.sampleCount());
-    auto ref = state.alloc();
+    if (handlersOut) {
+      *handlersOut = handlers;
+      return;
+    }
     
-    std::copy_n(param.values.begin(), param.sampleCount(), state.dereference(ref));
+    uint32_t resultOffset = 0;
+    uint32_t popCount = 0;
     
-    eval(&state, package, lookup(package, symbol), 0);
+#define DISPATCH() goto *code[instPtr].handler
+#define NEXT() ++instPtr; DISPATCH()
+#define OPERAND (code[instPtr].operand)
     
-    Data result(param.type, param.sampleCount());
-    std::copy_n(state.dereference(ref), param.sampleCount(), result.values.begin());
-   
-    return result;
+    DISPATCH();
+    
+  PUSH:
+    vm->push({ScalarFP, OPERAND});
+    NEXT();
+    
+  PUSH_SYM:
+    unlinkedSymbol(OPERAND.sym);
+    
+  COPY:
+    vm->push(vm->get(OPERAND.u32));
+    NEXT();
+    
+  REF_VEC:
+    vm->push(vm->reference(vm->get(OPERAND.u32)));
+    NEXT();
+    
+  DROP_S:
+    dropScalar(vm, OPERAND.u32 + resultOffset);
+    NEXT();
+    
+  DROP_V:
+    dropVector(vm, OPERAND.u32 + resultOffset);
+    NEXT();
+    
+  FILL:
+    fill(vm);
+    NEXT();
+    
+  CALL: {
+    auto fnPtr = vm->get(1).payload.u32;
+    auto retSlot = OPERAND.u32 + resultOffset;
+    
+    vm->pop();
+    
+    if (code[instPtr + 1].handler != &&EXIT) {
+      vm->pushFrame({instPtr + 1, resultOffset, popCount});
+    }
+    
+    instPtr = fnPtr;
+    resultOffset = 0;
+    popCount = retSlot;
+    
+    DISPATCH();
   }
+    
+    // Handler for each variant of each binary operation:
+#define BINARY_OP_VARIANTS(OPCODE_PREFIX, OPERATION) \
+OPCODE_PREFIX##_VV: vectorVectorOp(vm, OPERAND.u32 + resultOffset, OPERATION()); NEXT(); \
+OPCODE_PREFIX##_VS: vectorScalarOp(vm, OPERAND.u32 + resultOffset, OPERATION()); NEXT(); \
+OPCODE_PREFIX##_SV: scalarVectorOp(vm, OPERAND.u32 + resultOffset, OPERATION()); NEXT(); \
+OPCODE_PREFIX##_SS: scalarScalarOp(vm, OPERAND.u32 + resultOffset, OPERATION()); NEXT();
+    
+    BINARY_OP_VARIANTS(ADD, Add);
+    BINARY_OP_VARIANTS(MUL, Multiply);
+    BINARY_OP_VARIANTS(POW, Pow<Accuracy::Precise>);
+    BINARY_OP_VARIANTS(FAST_POW, Pow<Accuracy::Fast>);
+    BINARY_OP_VARIANTS(NOISE, Noise<false>);
+    BINARY_OP_VARIANTS(NOISE_BIPOLAR, Noise<true>);
+    BINARY_OP_VARIANTS(MIN, Min);
+    BINARY_OP_VARIANTS(MAX, Max);
+    BINARY_OP_VARIANTS(CLIP, Clip);
+    
+#undef BINARY_OP_VARIANTS
+    
+    // Handler for each variant of each math operation of one operand:
+#define UNARY_OP_VARIANTS(OPCODE_PREFIX, OPERATION) \
+OPCODE_PREFIX##_V: vectorUnaryOp(vm, OPERAND.u32 + resultOffset, OPERATION()); NEXT(); \
+OPCODE_PREFIX##_S: scalarUnaryOp(vm, OPERAND.u32 + resultOffset, OPERATION()); NEXT();
+    
+    UNARY_OP_VARIANTS(SIN, Sin<Accuracy::Precise>);
+    UNARY_OP_VARIANTS(COS, Cos<Accuracy::Precise>);
+    UNARY_OP_VARIANTS(EXP, Exp<Accuracy::Precise>);
+    UNARY_OP_VARIANTS(LOG, Log<Accuracy::Precise>);
+    UNARY_OP_VARIANTS(TANH, Tanh<Accuracy::Precise>);
+    UNARY_OP_VARIANTS(FAST_SIN, Sin<Accuracy::Fast>);
+    UNARY_OP_VARIANTS(FAST_COS, Cos<Accuracy::Fast>);
+    UNARY_OP_VARIANTS(FAST_EXP, Exp<Accuracy::Fast>);
+    UNARY_OP_VARIANTS(FAST_LOG, Log<Accuracy::Fast>);
+    UNARY_OP_VARIANTS(FAST_TANH, Tanh<Accuracy::Fast>);
+    UNARY_OP_VARIANTS(ABS, Abs);
+    
+#undef UNARY_OP_VARIANTS
+    
+    // Handler for each variant of each table lookup:
+#define TABLE_OP_VARIANTS(OPCODE_PREFIX, OPERATION) \
+OPCODE_PREFIX##_V: vectorTableOp(vm, OPERAND.u32 + resultOffset, OPERATION()); NEXT(); \
+OPCODE_PREFIX##_S: scalarTableOp(vm, OPERAND.u32 + resultOffset, OPERATION()); NEXT();
+    
+    TABLE_OP_VARIANTS(TABLE_NEAREST, TableLookup<Interpolation::Nearest>);
+    TABLE_OP_VARIANTS(TABLE_LINEAR, TableLookup<Interpolation::Linear>);
+    TABLE_OP_VARIANTS(TABLE_CUBIC, TableLookup<Interpolation::Cubic>);
+    
+#undef TABLE_OP_VARIANTS
   
+  FMA_VVV: multiplyAddOp<true, true>(vm, OPERAND.u32 + resultOffset, MultiplyAdd()); NEXT();
+  FMA_VSV: multiplyAddOp<false, true>(vm, OPERAND.u32 + resultOffset, MultiplyAdd()); NEXT();
+  FMA_VVS: multiplyAddOp<true, false>(vm, OPERAND.u32 + resultOffset, MultiplyAdd()); NEXT();
+  FMA_VSS: multiplyAddOp<false, false>(vm, OPERAND.u32 + resultOffset, MultiplyAdd()); NEXT();
   
-  /** Primitive Operation Helpers **/
+  SELECT_VVV: selectOp<true, true>(vm, OPERAND.u32 + resultOffset, Select()); NEXT();
+  SELECT_VSV: selectOp<false, true>(vm, OPERAND.u32 + resultOffset, Select()); NEXT();
+  SELECT_VVS: selectOp<true, false>(vm, OPERAND.u32 + resultOffset, Select()); NEXT();
+  SELECT_VSS: selectOp<false, false>(vm, OPERAND.u32 + resultOffset, Select()); NEXT();
+  SELECT_SSS: scalarSelectOp(vm, OPERAND.u32 + resultOffset, Select()); NEXT();
   
-  // Vector-Vector operation. Overwrite top 2 operands with the result of the
-  // binary operation's vector-vector variant.
-  //
-  //   vm:        VM state object.
-  //   pop:       Overwrite an additional n-many values from stack when returning.
-  //   op:        Callable object defining the operation.
+  ADD_VV_INPLACE: vectorVectorOpInPlace(vm, Add()); NEXT();
+  ADD_VS_INPLACE: vectorScalarOpInPlace(vm, Add()); NEXT();
+  MUL_VV_INPLACE: vectorVectorOpInPlace(vm, Multiply()); NEXT();
+  MUL_VS_INPLACE: vectorScalarOpInPlace(vm, Multiply()); NEXT();
+  FMA_VVV_INPLACE: multiplyAddOpInPlace<true, true>(vm, MultiplyAdd()); NEXT();
+  FMA_VSV_INPLACE: multiplyAddOpInPlace<false, true>(vm, MultiplyAdd()); NEXT();
+  FMA_VVS_INPLACE: multiplyAddOpInPlace<true, false>(vm, MultiplyAdd()); NEXT();
+  FMA_VSS_INPLACE: multiplyAddOpInPlace<false, false>(vm, MultiplyAdd()); NEXT();
   
-  template <typename Op>
-  void vectorVectorOp(VMState *vm, uint32_t pop, Op op) {
-    auto lhs = vm->get(1);
-    auto rhs = vm->get(2);
+  JUMP:
+    instPtr += OPERAND.u32;
+    DISPATCH();
     
-    vm->pop(2 + pop);
+  JUMP_ALL_TRUE:
+    if (jumpOp<true>(vm, Select())) {
+      instPtr += OPERAND.u32;
+      DISPATCH();
+    }
     
-    auto slot = vm->alloc();
-    vm->push(slot);
+    NEXT();
     
-    op((float const *)vm->dereference(lhs),
-       (float const *)vm->dereference(rhs),
-       (float *)vm->dereference(slot),
-       vm->frameSamples());
+  JUMP_ALL_FALSE:
+    if (jumpOp<false>(vm, Select())) {
+      instPtr += OPERAND.u32;
+      DISPATCH();
+    }
+    
+    NEXT();
+    
+  RET:
+    resultOffset = popCount;
+    NEXT();
+    
+  EXIT: {
+    CallFrame frame;
+    if (!vm->popFrame(&frame)) {
+      return;
+    }
+    
+    instPtr = frame.returnAddress;
+    resultOffset = frame.resultOffset;
+    popCount = frame.popCount;
+    
+    DISPATCH();
+  }
+  
+#undef OPERAND
+#undef NEXT
+#undef DISPATCH
   }
   
   
-  // Vector-Scalar operation. Overwrite top 2 operands with the result of the
-  // binary operation's vector-scalar variant.
+  // Translate a linked package's code into threaded instructions.
   //
-  //   vm:        VM state object.
-  //   pop:       Overwrite an additional n-many values from stack when returning.
-  //   op:        Callable object defining the operation.
+  // Instruction pointers are preserved, so function addresses in the decoded
+  // code are the same as in the package. Handlers are specific to the VM state
+  // type, so the code must be evaluated with the same type.
   
-  template <typename Op>
-  void vectorScalarOp(VMState *vm, uint32_t pop, Op op) {
-    auto lhs = vm->get(1);
-    auto rhs = vm->get(2);
+  template <class VM>
+  std::vector<ThreadedInstruction> decodeThreaded(Package const *package) {
+    void const *const *handlers;
+    evalThreaded<VM>(nullptr, nullptr, 0, &handlers);
     
-    vm->pop(2 + pop);
+    std::vector<ThreadedInstruction> code;
+    code.reserve(package->code.size());
     
-    auto slot = vm->alloc();
-    vm->push(slot);
+    for (auto inst : package->code) {
+      code.push_back({handlers[inst.operation], inst.operand});
+    }
     
-    op((float const *)vm->dereference(lhs),
-       rhs.payload.f32,
-       (float *)vm->dereference(slot),
-       vm->frameSamples());
+    return code;
   }
   
+#endif
   
-  // Scalar-Vector operation. Overwrite top 2 operands with the result of the
-  // binary operation's scalar-vector variant.
+  
+  /** Closure Compilation **/
+  
+  // Evaluation state shared by compiled closures. Mirrors the locals of `eval`.
+  struct ClosureState {
+    VMState *vm;
+    
+    // Compiled code, indexed by instruction pointer.
+    Closure const *code;
+    
+    // Offset applied to popping instructions. Set to popCount by RET.
+    uint32_t resultOffset;
+    
+    // Overwrite n-many values from stack when the current function returns.
+    uint32_t popCount;
+  };
+  
+  // Execute a closure, returning the next closure to execute or null to stop.
+  typedef Closure const *(*ClosureFn)(ClosureState *state, Closure const *self);
+  
+  // Instruction compiled to a function specialised for its opcode and operand types, with
+  // its operand pre-bound.
   //
-  //   vm:        VM state object.
-  //   pop:       Overwrite an additional n-many values from stack when returning.
-  //   op:        Callable object defining the operation.
+  // Closures are stored in instruction order, so each falls through to the next and
+  // instruction pointers index them directly.
+  struct Closure {
+    ClosureFn fn;
+    Data::Value operand;
+    
+    // Function entered by a call whose target is known at compile time.
+    Closure const *target;
+  };
   
-  template <typename Op>
-  void scalarVectorOp(VMState *vm, uint32_t pop, Op op) {
-    auto lhs = vm->get(1);
-    auto rhs = vm->get(2);
+  
+  // Evaluate code compiled by `compileClosures`.
+  //
+  // Behaves exactly as `eval`, but each instruction is a single indirect call, without
+  // any decoding. Needs neither computed goto nor executable memory, so works anywhere.
+  //
+  // vm:          VM state object.
+  // code:        Compiled closures.
+  // instPtr:     Pointer to first instruction.
+  
+  void evalClosures(VMState *vm, Closure const *code, uint32_t instPtr) {
+    ClosureState state = {vm, code, 0, 0};
     
-    vm->pop(2 + pop);
+    auto next = code + instPtr;
+    while (next) {
+      next = next->fn(&state, next);
+    }
+  }
+  
+  
+  // Closures for each opcode.
+  
+  Closure const *pushClosure(ClosureState *state, Closure const *self) {
+    state->vm->push({ScalarFP, self->operand});
+    return self + 1;
+  }
+  
+  Closure const *pushSymbolClosure(ClosureState *state, Closure const *self) {
+    unlinkedSymbol(self->operand.sym);
+  }
+  
+  Closure const *copyClosure(ClosureState *state, Closure const *self) {
+    state->vm->push(state->vm->get(self->operand.u32));
+    return self + 1;
+  }
+  
+  Closure const *referenceClosure(ClosureState *state, Closure const *self) {
+    state->vm->push(state->vm->reference(state->vm->get(self->operand.u32)));
+    return self + 1;
+  }
+  
+  Closure const *dropScalarClosure(ClosureState *state, Closure const *self) {
+    dropScalar(state->vm, self->operand.u32 + state->resultOffset);
+    return self + 1;
+  }
+  
+  Closure const *dropVectorClosure(ClosureState *state, Closure const *self) {
+    dropVector(state->vm, self->operand.u32 + state->resultOffset);
+    return self + 1;
+  }
+  
+  Closure const *fillClosure(ClosureState *state, Closure const *self) {
+    fill(state->vm);
+    return self + 1;
+  }
+  
+  template <typename Op, bool VectorLhs, bool VectorRhs>
+  Closure const *binaryOpClosure(ClosureState *state, Closure const *self) {
+    auto pop = self->operand.u32 + state->resultOffset;
     
-    auto slot = vm->alloc();
-    vm->push(slot);
+    if (VectorLhs && VectorRhs) {
+      vectorVectorOp(state->vm, pop, Op());
+      
+    } else if (VectorLhs) {
+      vectorScalarOp(state->vm, pop, Op());
+      
+    } else if (VectorRhs) {
+      scalarVectorOp(state->vm, pop, Op());
+      
+    } else {
+      scalarScalarOp(state->vm, pop, Op());
+    }
     
-    op(lhs.payload.f32,
-       (float const *)vm->dereference(rhs),
-       (float *)vm->dereference(slot),
-       vm->frameSamples());
+    return self + 1;
   }
   
+  template <typename Op, bool Vector>
+  Closure const *unaryOpClosure(ClosureState *state, Closure const *self) {
+    auto pop = self->operand.u32 + state->resultOffset;
+    
+    if (Vector) {
+      vectorUnaryOp(state->vm, pop, Op());
+      
+    } else {
+      scalarUnaryOp(state->vm, pop, Op());
+    }
+    
+    return self + 1;
+  }
   
-  // Scalar-Scalar operation. Overwrite top 2 operands with the result of the
-  // binary operation's scalar-scalar variant.
+  template <typename Op, bool Vector>
+  Closure const *tableOpClosure(ClosureState *state, Closure const *self) {
+    auto pop = self->operand.u32 + state->resultOffset;
+    
+    if (Vector) {
+      vectorTableOp(state->vm, pop, Op());
+      
+    } else {
+      scalarTableOp(state->vm, pop, Op());
+    }
+    
+    return self + 1;
+  }
+  
+  template <bool VectorMul, bool VectorAdd>
+  Closure const *multiplyAddClosure(ClosureState *state, Closure const *self) {
+    multiplyAddOp<VectorMul, VectorAdd>(state->vm, self->operand.u32 + state->resultOffset, MultiplyAdd());
+    return self + 1;
+  }
+  
+  template <bool VectorTrue, bool VectorFalse>
+  Closure const *selectClosure(ClosureState *state, Closure const *self) {
+    selectOp<VectorTrue, VectorFalse>(state->vm, self->operand.u32 + state->resultOffset, Select());
+    return self + 1;
+  }
+  
+  Closure const *scalarSelectClosure(ClosureState *state, Closure const *self) {
+    scalarSelectOp(state->vm, self->operand.u32 + state->resultOffset, Select());
+    return self + 1;
+  }
+  
+  template <typename Op, bool VectorRhs>
+  Closure const *binaryOpInPlaceClosure(ClosureState *state, Closure const *self) {
+    if (VectorRhs) {
+      vectorVectorOpInPlace(state->vm, Op());
+      
+    } else {
+      vectorScalarOpInPlace(state->vm, Op());
+    }
+    
+    return self + 1;
+  }
+  
+  template <bool VectorMul, bool VectorAdd>
+  Closure const *multiplyAddInPlaceClosure(ClosureState *state, Closure const *self) {
+    multiplyAddOpInPlace<VectorMul, VectorAdd>(state->vm, MultiplyAdd());
+    return self + 1;
+  }
+  
+  Closure const *jumpClosure(ClosureState *state, Closure const *self) {
+    return self + self->operand.u32;
+  }
+  
+  template <bool AllTrue>
+  Closure const *conditionalJumpClosure(ClosureState *state, Closure const *self) {
+    return jumpOp<AllTrue>(state->vm, Select()) ? self + self->operand.u32 : self + 1;
+  }
+  
+  // Enter `target` from the CALL instruction `call`. Tail calls return directly to the
+  // caller's caller, so don't need a frame.
+  template <bool TailCall>
+  Closure const *enterFunction(ClosureState *state, Closure const *call, Closure const *target) {
+    auto retSlot = call->operand.u32 + state->resultOffset;
+    
+    if (!TailCall) {
+      state->vm->pushFrame({(uint32_t)(call + 1 - state->code), state->resultOffset, state->popCount});
+    }
+    
+    state->resultOffset = 0;
+    state->popCount = retSlot;
+    
+    return target;
+  }
+  
+  template <bool TailCall>
+  Closure const *callClosure(ClosureState *state, Closure const *self) {
+    auto fnPtr = state->vm->get(1).payload.u32;
+    state->vm->pop();
+    
+    return enterFunction<TailCall>(state, self, state->code + fnPtr);
+  }
+  
+  // Call compiled from a PUSH of the function's address and the CALL that follows it.
+  // Replaces the PUSH, entering the function without going through the stack.
+  template <bool TailCall>
+  Closure const *staticCallClosure(ClosureState *state, Closure const *self) {
+    return enterFunction<TailCall>(state, self + 1, self->target);
+  }
+  
+  Closure const *retClosure(ClosureState *state, Closure const *self) {
+    state->resultOffset = state->popCount;
+    return self + 1;
+  }
+  
+  Closure const *exitClosure(ClosureState *state, Closure const *self) {
+    CallFrame frame;
+    if (!state->vm->popFrame(&frame)) {
+      return nullptr;
+    }
+    
+    state->resultOffset = frame.resultOffset;
+    state->popCount = frame.popCount;
+    
+    return state->code + frame.returnAddress;
+  }
+  
+  
+  // Compile a linked package's code into closures.
   //
-  //   vm:        VM state object.
-  //   pop:       Overwrite an additional n-many values from stack when returning.
-  //   op:        Callable object defining the operation.
+  // Instruction pointers are preserved, so function addresses in the compiled
+  // code are the same as in the package.
   
-  template <typename Op>
-  void scalarScalarOp(VMState *vm, uint32_t pop, Op op) {
-    auto lhs = vm->get(1);
-    auto rhs = vm->get(2);
+  std::vector<Closure> compileClosures(Package const *package) {
+    // Closure for each opcode, indexed by opcode. Calls are specialised further below.
+    static ClosureFn const closures[] = {
+      &pushClosure,
+      &pushSymbolClosure,
+      &copyClosure,
+      &referenceClosure,
+      &dropScalarClosure,
+      &dropVectorClosure,
+      &fillClosure,
+      &binaryOpClosure<Add, true, true>, &binaryOpClosure<Add, false, true>,
+      &binaryOpClosure<Add, true, false>, &binaryOpClosure<Add, false, false>,
+      &binaryOpClosure<Multiply, true, true>, &binaryOpClosure<Multiply, false, true>,
+      &binaryOpClosure<Multiply, true, false>, &binaryOpClosure<Multiply, false, false>,
+      &multiplyAddClosure<true, true>, &multiplyAddClosure<false, true>,
+      &multiplyAddClosure<true, false>, &multiplyAddClosure<false, false>,
+      &unaryOpClosure<Sin<Accuracy::Precise>, true>, &unaryOpClosure<Sin<Accuracy::Precise>, false>,
+      &unaryOpClosure<Cos<Accuracy::Precise>, true>, &unaryOpClosure<Cos<Accuracy::Precise>, false>,
+      &unaryOpClosure<Exp<Accuracy::Precise>, true>, &unaryOpClosure<Exp<Accuracy::Precise>, false>,
+      &unaryOpClosure<Log<Accuracy::Precise>, true>, &unaryOpClosure<Log<Accuracy::Precise>, false>,
+      &unaryOpClosure<Tanh<Accuracy::Precise>, true>, &unaryOpClosure<Tanh<Accuracy::Precise>, false>,
+      &binaryOpClosure<Pow<Accuracy::Precise>, true, true>, &binaryOpClosure<Pow<Accuracy::Precise>, false, true>,
+      &binaryOpClosure<Pow<Accuracy::Precise>, true, false>, &binaryOpClosure<Pow<Accuracy::Precise>, false, false>,
+      &unaryOpClosure<Sin<Accuracy::Fast>, true>, &unaryOpClosure<Sin<Accuracy::Fast>, false>,
+      &unaryOpClosure<Cos<Accuracy::Fast>, true>, &unaryOpClosure<Cos<Accuracy::Fast>, false>,
+      &unaryOpClosure<Exp<Accuracy::Fast>, true>, &unaryOpClosure<Exp<Accuracy::Fast>, false>,
+      &unaryOpClosure<Log<Accuracy::Fast>, true>, &unaryOpClosure<Log<Accuracy::Fast>, false>,
+      &unaryOpClosure<Tanh<Accuracy::Fast>, true>, &unaryOpClosure<Tanh<Accuracy::Fast>, false>,
+      &binaryOpClosure<Pow<Accuracy::Fast>, true, true>, &binaryOpClosure<Pow<Accuracy::Fast>, false, true>,
+      &binaryOpClosure<Pow<Accuracy::Fast>, true, false>, &binaryOpClosure<Pow<Accuracy::Fast>, false, false>,
+      &binaryOpClosure<Noise<false>, true, true>, &binaryOpClosure<Noise<false>, false, true>,
+      &binaryOpClosure<Noise<false>, true, false>, &binaryOpClosure<Noise<false>, false, false>,
+      &binaryOpClosure<Noise<true>, true, true>, &binaryOpClosure<Noise<true>, false, true>,
+      &binaryOpClosure<Noise<true>, true, false>, &binaryOpClosure<Noise<true>, false, false>,
+      &tableOpClosure<TableLookup<Interpolation::Nearest>, true>, &tableOpClosure<TableLookup<Interpolation::Nearest>, false>,
+      &tableOpClosure<TableLookup<Interpolation::Linear>, true>, &tableOpClosure<TableLookup<Interpolation::Linear>, false>,
+      &tableOpClosure<TableLookup<Interpolation::Cubic>, true>, &tableOpClosure<TableLookup<Interpolation::Cubic>, false>,
+      &binaryOpClosure<Min, true, true>, &binaryOpClosure<Min, false, true>,
+      &binaryOpClosure<Min, true, false>, &binaryOpClosure<Min, false, false>,
+      &binaryOpClosure<Max, true, true>, &binaryOpClosure<Max, false, true>,
+      &binaryOpClosure<Max, true, false>, &binaryOpClosure<Max, false, false>,
+      &binaryOpClosure<Clip, true, true>, &binaryOpClosure<Clip, false, true>,
+      &binaryOpClosure<Clip, true, false>, &binaryOpClosure<Clip, false, false>,
+      &unaryOpClosure<Abs, true>, &unaryOpClosure<Abs, false>,
+      &selectClosure<true, true>, &selectClosure<false, true>,
+      &selectClosure<true, false>, &selectClosure<false, false>,
+      &scalarSelectClosure,
+      &binaryOpInPlaceClosure<Add, true>, &binaryOpInPlaceClosure<Add, false>,
+      &binaryOpInPlaceClosure<Multiply, true>, &binaryOpInPlaceClosure<Multiply, false>,
+      &multiplyAddInPlaceClosure<true, true>, &multiplyAddInPlaceClosure<false, true>,
+      &multiplyAddInPlaceClosure<true, false>, &multiplyAddInPlaceClosure<false, false>,
+      &jumpClosure, &conditionalJumpClosure<true>, &conditionalJumpClosure<false>,
+      &callClosure<false>,
+      &retClosure,
+      &exitClosure
+    };
     
-    vm->pop(2 + pop);
+    static_assert(sizeof(closures) / sizeof(*closures) == Instruction::EXIT + 1, "Every opcode should have a closure");
     
-    float result;
-    op(lhs.payload.f32, rhs.payload.f32, &result);
+    auto const &source = package->code;
     
-    vm->push({ScalarFP, result});
+    std::vector<Closure> code;
+    code.reserve(source.size());
+    
+    for (size_t i = 0; i < source.size(); ++i) {
+      code.push_back({closures[source[i].operation], source[i].operand, nullptr});
+    }
+    
+    for (size_t i = 0; i < source.size(); ++i) {
+      if (source[i].operation != Instruction::CALL) {
+        continue;
+      }
+      
+      bool tailCall = i + 1 < source.size() && source[i + 1].operation == Instruction::EXIT;
+      code[i].fn = tailCall ? &callClosure<true> : &callClosure<false>;
+      
+      // Bind calls to a pushed address directly to the function.
+      if (i > 0 && source[i - 1].operation == Instruction::PUSH && source[i - 1].operand.u32 < source.size()) {
+        code[i - 1].fn = tailCall ? &staticCallClosure<true> : &staticCallClosure<false>;
+        code[i - 1].target = code.data() + source[i - 1].operand.u32;
+      }
+    }
+    
+    return code;
   }
+  
+  
+  // Test function.
+  //
+  // Link the package, push a vector parameter onto the stack, execute a function
+  // and return the value.
+  //
+  //   package:     Package containing code.
+  //   symbol:      Name of function to execute.
+  //   param:       Parameter for the function.
+  //   stackSize:   Stack sizes to use for evaluation (see Context).
+  //   dispatch:    Instruction dispatch strategy.
+  
+  Data eval(Package const *package, Symbol symbol, Data const &param, size_t stackSize, Dispatch dispatch) {
+    static_assert(sizeof(Data::Value) == sizeof(float), "Data values should be layout-compatible with float");
+    
+    Arena arena;
+    auto linked = link(package, &arena);
+    
+    // Single use, so not worth faulting in the entire stack by locking it.
+    Context context(&linked, stackSize, dispatch, false);
+    Data result(param.type, param.sampleCount());
+    
+    context.render(symbol, (float const *)param.values.data(), (float *)result.values.data(), param.sampleCount());
+    
+    return result;
+  }
+  
+  
+  /** Context **/
+  
+  // Block length that AutoStackSize contexts rendering whole blocks size their vector stack
+  // for. Longer blocks are rendered in several passes.
+  uint32_t const AutoStackBlockSamples = 4096;
+  
+  Context::Context(Package const *package_, size_t stackSize_, Dispatch dispatch_, bool lock, uint32_t tileSamples_)
+  : package(package_)
+  , dispatch(dispatch_)
+  , tileSamples(tileSamples_)
+  , stats({0, 0})
+  {
+    if (!isLinked(package)) {
+      throw std::runtime_error("Context requires a linked package");
+    }
+    
+    if (tileSamples == AutoTileSize) {
+      tileSamples = tileSize(package);
+    }
+    
+    // Tiles start on vector slot boundaries, so that every tile but the last fills
+    // its vectors.
+    if (tileSamples != WholeBlock) {
+      tileSamples = std::max<uint32_t>(tileSamples / VectorStackSlot::SampleCount, 1) * VectorStackSlot::SampleCount;
+    }
+    
+    std::unordered_map<Symbol, StackDepth> depths;
+    StackDepth deepest = {1, 1, 1};
+    
+    // Functions calling addresses passed to them can only be called, not rendered, so are
+    // bounded as part of their callers.
+    for (auto sym : package->symbols) {
+      StackDepth depth;
+      
+      if (!stackDepth(package, sym.first, &depth)) {
+        continue;
+      }
+      
+      depths[sym.first] = depth;
+      
+      deepest.scalars = std::max(deepest.scalars, depth.scalars);
+      deepest.vectors = std::max(deepest.vectors, depth.vectors);
+      deepest.calls = std::max(deepest.calls, depth.calls);
+    }
+    
+    if (stackSize_ == AutoStackSize) {
+      auto blockSamples = std::min(tileSamples, AutoStackBlockSamples);
+      
+      vectorStackSize = deepest.vectors * (blockSamples / VectorStackSlot::SampleCount);
+      scalarStackSize = deepest.scalars;
+      callStackSize = deepest.calls;
+      
+    } else {
+      vectorStackSize = scalarStackSize = callStackSize = (uint32_t)stackSize_;
+    }
+    
+    // Check that every function fits, splitting blocks so that its vectors fit in the vector stack.
+    for (auto &depth : depths) {
+      if (depth.second.scalars > scalarStackSize || depth.second.calls > callStackSize || depth.second.vectors > vectorStackSize) {
+        auto err = std::stringstream() << "VM stack too small for `" << depth.first << "`: needs "
+        << depth.second.scalars << " scalar slots, "
+        << depth.second.vectors << " vectors and "
+        << depth.second.calls << " call frames";
+        
+        throw std::runtime_error(err.str());
+      }
+      
+      uint64_t passSamples = uint64_t(vectorStackSize / depth.second.vectors) * VectorStackSlot::SampleCount;
+      entries[depth.first] = {package->symbols.at(depth.first), (uint32_t)std::min<uint64_t>(tileSamples, passSamples), false};
+    }
+    
+    // Page-align the allocation so that locking it doesn't affect neighbouring heap objects.
+    // The vector stack goes first to inherit the alignment.
+    size_t const pageSize = 4096;
+    
+    memorySize = vectorStackSize * sizeof(VectorStackSlot) + scalarStackSize * sizeof(ScalarStackSlot) + callStackSize * sizeof(CallFrame);
+    memorySize = (memorySize + pageSize - 1) / pageSize * pageSize;
+    
+    if (posix_memalign(&memory, pageSize, memorySize) != 0) {
+      auto err = std::stringstream() << "Failed to allocate VM stacks (" << memorySize << " bytes)";
+      throw std::runtime_error(err.str());
+    }
+    
+    // Locking may be refused by resource limits. Evaluation still works, it just may page fault.
+    locked = lock && (mlock(memory, memorySize) == 0);
+    
+    vectorStack = (VectorStackSlot *)memory;
+    scalarStack = (ScalarStackSlot *)(vectorStack + vectorStackSize);
+    callStack = (CallFrame *)(scalarStack + scalarStackSize);
+    
+    if (dispatch == ClosureDispatch) {
+      closures = compileClosures(package);
+    }
+    
+    if (dispatch == JitDispatch) {
+      compiled = jit::compile(package);
+      
+      if (!compiled) {
+        dispatch = ThreadedDispatch;
+      }
+    }
+    
+#ifndef TEMPO_THREADED_DISPATCH
+    if (dispatch == ThreadedDispatch) {
+      dispatch = SwitchDispatch;
+    }
+#endif
+    
+    // The interpreters evaluate verified functions without checks. Closures and the JIT
+    // share helpers, so always check. Any function may be rendered, but some (such as
+    // those taking scalars) are only valid when called, and fail verification.
+    bool checked = false;
+    bool unchecked = false;
+    
+    for (auto &entry : entries) {
+      if (dispatch == SwitchDispatch || dispatch == ThreadedDispatch) {
+        try {
+          verify(package, entry.first);
+          entry.second.verified = true;
+          
+        } catch (std::runtime_error const &) {
+          // Evaluated with checks, so that violations are caught as before.
+        }
+      }
+      
+      checked |= !entry.second.verified;
+      unchecked |= entry.second.verified;
+    }
+    
+#ifdef TEMPO_THREADED_DISPATCH
+    if (dispatch == ThreadedDispatch && checked) {
+      decoded = decodeThreaded<VMState>(package);
+    }
+    
+    if (dispatch == ThreadedDispatch && unchecked) {
+      decodedUnchecked = decodeThreaded<UncheckedVMState>(package);
+    }
+#endif
+  }
+  
+  Context::~Context() {
+    if (locked) {
+      munlock(memory, memorySize);
+    }
+    
+    free(memory);
+  }
+  
+  bool Context::isVerified(Symbol symbol) const {
+    auto entry = entries.find(symbol);
+    return entry != entries.end() && entry->second.verified;
+  }
+  
+  template <class VM>
+  void Context::renderTile(uint32_t instPtr, float const *input, float *output, uint32_t sampleCount) {
+    VM state(scalarStack, 0, vectorStack, 0, callStack, callStackSize, sampleCount,
+             package->tables.data(), (uint32_t)package->tables.size());
+    
+    // Inputs with the same value throughout (typically silence) are pushed as uniform
+    // vectors, so that operations derived only from them skip their vector passes.
+    if (std::all_of(input, input + sampleCount, [&](float sample) { return sample == input[0]; })) {
+      state.push({UniformVec, input[0]});
+      ++stats.uniformTiles;
+      
+    } else {
+      auto ref = state.alloc();
+      std::copy_n(input, sampleCount, (float *)state.dereference(ref));
+    }
+    
+    evalTile(&state, instPtr);
+    stats.skippedOps += state.getSkippedOps();
+    
+    // The result replaces the input at the bottom of the stack. Unless uniform, it's then
+    // the only vector, so occupies the first vector slot.
+    auto result = state.get(state.stackTop() + 1);
+    
+    if (result.type == UniformVec) {
+      std::fill_n(output, sampleCount, result.payload.f32);
+      
+    } else {
+      std::copy_n((float const *)vectorStack, sampleCount, output);
+    }
+  }
+  
+  template <>
+  void Context::evalTile(VMState *vm, uint32_t instPtr) {
+    switch (dispatch) {
+      case JitDispatch:
+        compiled->run(vm, instPtr, callStackSize);
+        break;
+        
+      case ClosureDispatch:
+        evalClosures(vm, closures.data(), instPtr);
+        break;
+        
+#ifdef TEMPO_THREADED_DISPATCH
+      case ThreadedDispatch:
+        evalThreaded(vm, decoded.data(), instPtr);
+        break;
+#endif
+      
+      default:
+        eval(vm, package, instPtr);
+        break;
+    }
+  }
+  
+  template <>
+  void Context::evalTile(UncheckedVMState *vm, uint32_t instPtr) {
+    switch (dispatch) {
+#ifdef TEMPO_THREADED_DISPATCH
+      case ThreadedDispatch:
+        evalThreaded(vm, decodedUnchecked.data(), instPtr);
+        break;
+#endif
+      
+      default:
+        eval(vm, package, instPtr);
+        break;
+    }
+  }
+  
+  void Context::render(Symbol symbol, float const *input, float *output, uint32_t sampleCount) {
+    auto entry = entries.find(symbol);
+    
+    if (entry == entries.end() && package->symbols.count(symbol)) {
+      auto err = std::stringstream() << "Can't render `" << symbol << "`: it calls an address passed to it";
+      throw std::runtime_error(err.str());
+    }
+    
+    if (entry == entries.end()) {
+      auto err = std::stringstream() << "Undefined symbol: `" << symbol << "`";
+      throw std::runtime_error(err.str());
+    }
+    
+    // Each tile reads its input before writing its output, so `output` may still alias `input`.
+    uint32_t offset = 0;
+    
+    while (offset < sampleCount) {
+      auto count = std::min(entry->second.tileSamples, sampleCount - offset);
+      if (entry->second.verified) {
+        renderTile<UncheckedVMState>(entry->second.instPtr, input + offset, output + offset, count);
+        
+      } else {
+        renderTile<VMState>(entry->second.instPtr, input + offset, output + offset, count);
+      }
+      
+      offset += count;
+    }
+  }
+  
+  
+  /** Tiling **/
+  
+  // L1 data cache budget for the vectors live while evaluating a tile. Typical of
+  // current x86-64 and ARM cores.
+  size_t const TileCacheBytes = 32 * 1024;
+  
+  // Tile size limits. Below the minimum, the overhead of dispatching each instruction
+  // once per tile outweighs the cache savings.
+  uint32_t const MinTileSamples = 256;
+  uint32_t const MaxTileSamples = 4096;
+  
+  uint32_t tileSize(Package const *package) {
+    // Any symbol may be rendered, so size tiles for the one needing the most vectors.
+    size_t vectors = 1;
+    
+    for (auto sym : package->symbols) {
+      StackDepth depth;
+      
+      if (stackDepth(package, sym.first, &depth)) {
+        vectors = std::max<size_t>(vectors, depth.vectors);
+      }
+    }
+    
+    auto samples = TileCacheBytes / (vectors * sizeof(float));
+    
+    // Round down to a power of two, so tiles divide power-of-two block sizes evenly.
+    uint32_t tile = MinTileSamples;
+    while (tile * 2 <= samples && tile * 2 <= MaxTileSamples) {
+      tile *= 2;
+    }
+    
+    return tile;
+  }
+  
+  
+  /** Primitive Operation Helpers **/
+  
+  // Vector-Vector operation. Overwrite top 2 operands with the result of the
+  // binary operation's vector-vector variant.
+  //
+  //   vm:        VM state object.
+  //   pop:       Overwrite an additional n-many values from stack when returning.
+  //   op:        Callable object defining the operation.
+  
+  template <class VM, typename Op>
+  void vectorVectorOp(VM *vm, uint32_t pop, Op op) {
+    auto lhs = vm->get(1);
+    auto rhs = vm->get(2);
+    
+    // Uniform operands hold their value as a scalar would, so take the scalar variants.
+    if (lhs.type == UniformVec) {
+      if (rhs.type == UniformVec) {
+        uniformOp(vm, pop, op);
+        
+      } else {
+        scalarVectorOp(vm, pop, op);
+      }
+      
+      return;
+    }
+    
+    if (rhs.type == UniformVec) {
+      vectorScalarOp(vm, pop, op);
+      return;
+    }
+    
+    vm->pop(2 + pop);
+    
+    auto slot = vm->alloc();
+    
+    op((float const *)vm->dereference(lhs),
+       (float const *)vm->dereference(rhs),
+       (float *)vm->dereference(slot),
+       vm->frameSamples());
+  }
+  
+  
+  // Vector-Scalar operation. Overwrite top 2 operands with the result of the
+  // binary operation's vector-scalar variant.
+  //
+  //   vm:        VM state object.
+  //   pop:       Overwrite an additional n-many values from stack when returning.
+  //   op:        Callable object defining the operation.
+  
+  template <class VM, typename Op>
+  void vectorScalarOp(VM *vm, uint32_t pop, Op op) {
+    auto lhs = vm->get(1);
+    auto rhs = vm->get(2);
+    
+    if (lhs.type == UniformVec) {
+      uniformOp(vm, pop, op);
+      return;
+    }
+    
+    if (shortCircuitOp(vm, pop, op, rhs, 1)) {
+      return;
+    }
+    
+    vm->pop(2 + pop);
+    
+    auto slot = vm->alloc();
+    
+    op((float const *)vm->dereference(lhs),
+       rhs.payload.f32,
+       (float *)vm->dereference(slot),
+       vm->frameSamples());
+  }
+  
+  
+  // Scalar-Vector operation. Overwrite top 2 operands with the result of the
+  // binary operation's scalar-vector variant.
+  //
+  //   vm:        VM state object.
+  //   pop:       Overwrite an additional n-many values from stack when returning.
+  //   op:        Callable object defining the operation.
+  
+  template <class VM, typename Op>
+  void scalarVectorOp(VM *vm, uint32_t pop, Op op) {
+    auto lhs = vm->get(1);
+    auto rhs = vm->get(2);
+    
+    if (rhs.type == UniformVec) {
+      uniformOp(vm, pop, op);
+      return;
+    }
+    
+    if (shortCircuitOp(vm, pop, op, lhs, 2)) {
+      return;
+    }
+    
+    vm->pop(2 + pop);
+    
+    auto slot = vm->alloc();
+    
+    op(lhs.payload.f32,
+       (float const *)vm->dereference(rhs),
+       (float *)vm->dereference(slot),
+       vm->frameSamples());
+  }
+  
+  
+  // Scalar-Scalar operation. Overwrite top 2 operands with the result of the
+  // binary operation's scalar-scalar variant.
+  //
+  //   vm:        VM state object.
+  //   pop:       Overwrite an additional n-many values from stack when returning.
+  //   op:        Callable object defining the operation.
+  
+  template <class VM, typename Op>
+  void scalarScalarOp(VM *vm, uint32_t pop, Op op) {
+    auto lhs = vm->get(1);
+    auto rhs = vm->get(2);
+    
+    vm->pop(2 + pop);
+    
+    float result;
+    op(lhs.payload.f32, rhs.payload.f32, &result);
+    
+    vm->push({ScalarFP, result});
+  }
+  
+  
+  // Uniform-Uniform operation. Overwrite top 2 operands, which are uniform vectors or
+  // scalars, with a uniform vector holding the result of the binary operation's
+  // scalar-scalar variant.
+  //
+  //   vm:        VM state object.
+  //   pop:       Overwrite an additional n-many values from stack when returning.
+  //   op:        Callable object defining the operation.
+  
+  template <class VM, typename Op>
+  void uniformOp(VM *vm, uint32_t pop, Op op) {
+    scalarScalarOp(vm, pop, op);
+    vm->get(1).type = UniformVec;
+    vm->countSkipped();
+  }
+  
+  
+  // Vector operation of one operand. Overwrite the top operand with the result of the
+  // operation's vector variant.
+  //
+  //   vm:        VM state object.
+  //   pop:       Overwrite an additional n-many values from stack when returning.
+  //   op:        Callable object defining the operation.
+  
+  template <class VM, typename Op>
+  void vectorUnaryOp(VM *vm, uint32_t pop, Op op) {
+    auto input = vm->get(1);
+    
+    // Uniform operands give uniform results, computed by the scalar variant.
+    if (input.type == UniformVec) {
+      scalarUnaryOp(vm, pop, op);
+      vm->get(1).type = UniformVec;
+      vm->countSkipped();
+      return;
+    }
+    
+    vm->pop(1 + pop);
+    
+    auto slot = vm->alloc();
+    
+    op((float const *)vm->dereference(input),
+       (float *)vm->dereference(slot),
+       vm->frameSamples());
+  }
+  
+  
+  // Scalar operation of one operand. Overwrite the top operand with the result of the
+  // operation's scalar variant.
+  //
+  //   vm:        VM state object.
+  //   pop:       Overwrite an additional n-many values from stack when returning.
+  //   op:        Callable object defining the operation.
+  
+  template <class VM, typename Op>
+  void scalarUnaryOp(VM *vm, uint32_t pop, Op op) {
+    auto input = vm->get(1);
+    
+    vm->pop(1 + pop);
+    
+    float result;
+    op(input.payload.f32, &result);
+    
+    vm->push({ScalarFP, result});
+  }
+  
+  
+  // Vector table lookup. Overwrite the phase at the top of the stack and the table index
+  // beneath it with the result of the lookup's vector variant.
+  //
+  //   vm:        VM state object.
+  //   pop:       Overwrite an additional n-many values from stack when returning.
+  //   op:        Callable object defining the lookup.
+  
+  template <class VM, typename Op>
+  void vectorTableOp(VM *vm, uint32_t pop, Op op) {
+    auto phase = vm->get(1);
+    
+    // Uniform phases give uniform results, computed by the scalar variant.
+    if (phase.type == UniformVec) {
+      scalarTableOp(vm, pop, op);
+      vm->get(1).type = UniformVec;
+      vm->countSkipped();
+      return;
+    }
+    
+    auto const &table = vm->table(vm->get(2).payload.u32);
+    vm->pop(2 + pop);
+    
+    auto slot = vm->alloc();
+    
+    op(table,
+       (float const *)vm->dereference(phase),
+       (float *)vm->dereference(slot),
+       vm->frameSamples());
+  }
+  
+  
+  // Scalar table lookup. Overwrite the phase at the top of the stack and the table index
+  // beneath it with the result of the lookup's scalar variant.
+  //
+  //   vm:        VM state object.
+  //   pop:       Overwrite an additional n-many values from stack when returning.
+  //   op:        Callable object defining the lookup.
+  
+  template <class VM, typename Op>
+  void scalarTableOp(VM *vm, uint32_t pop, Op op) {
+    auto phase = vm->get(1);
+    auto const &table = vm->table(vm->get(2).payload.u32);
+    
+    vm->pop(2 + pop);
+    
+    float result;
+    op(table, phase.payload.f32, &result);
+    
+    vm->push({ScalarFP, result});
+  }
+  
+  
+  // Short-circuit a binary operation with a vector and a scalar operand, if the scalar's
+  // value makes the result uniform or the same as the vector operand (see VMOps.hpp).
+  // Overwrite the top 2 operands with that result and return true, otherwise return false.
+  //
+  //   vm:            VM state object.
+  //   pop:           Overwrite an additional n-many values from stack when returning.
+  //   op:            Callable object defining the operation.
+  //   scalar:        Scalar operand.
+  //   vectorOffset:  Offset from the top of the stack of the vector operand (1 or 2).
+  
+  template <class VM, typename Op>
+  bool shortCircuitOp(VM *vm, uint32_t pop, Op op, ScalarStackSlot scalar, uint32_t vectorOffset) {
+    if (op.isAbsorbing(scalar.payload.f32)) {
+      vm->pop(2 + pop);
+      vm->push({UniformVec, scalar.payload});
+      
+    } else if (op.isIdentity(scalar.payload.f32)) {
+      // Drop the scalar, then drop the slots beneath the vector as DROP_V does. This only
+      // copies the vector if it was allocated for the operation, and popped with it.
+      if (vectorOffset == 2) {
+        vm->pop();
+        dropVector(vm, pop);
+        
+      } else {
+        dropVector(vm, pop + 1);
+      }
+      
+    } else {
+      return false;
+    }
+    
+    vm->countSkipped();
+    return true;
+  }
+  
+  
+  // Read an operand of a ternary operation, as either a pointer to the vector it
+  // references or its scalar value.
+  
+  template <class VM>
+  float const *operandValue(VM *vm, ScalarStackSlot slot, std::true_type isVector) {
+    return (float const *)vm->dereference(slot);
+  }
+  
+  template <class VM>
+  float operandValue(VM *vm, ScalarStackSlot slot, std::false_type isVector) {
+    return slot.payload.f32;
+  }
+  
+  
+  // Multiply-add operation. Overwrite top 3 operands with the result of multiplying the
+  // top (vector) operand by the second and adding the third.
+  //
+  //   VectorMul: True if the second operand is a vector, false if a scalar.
+  //   VectorAdd: True if the third operand is a vector, false if a scalar.
+  //   vm:        VM state object.
+  //   pop:       Overwrite an additional n-many values from stack when returning.
+  //   op:        Callable object defining the operation.
+  
+  template <bool VectorMul, bool VectorAdd, class VM, typename Op>
+  void multiplyAddOp(VM *vm, uint32_t pop, Op op) {
+    auto lhs = vm->get(1);
+    auto mul = vm->get(2);
+    auto add = vm->get(3);
+    
+    // Uniform operands take the variant treating them as scalars.
+    if (VectorMul && mul.type == UniformVec) {
+      multiplyAddOp<false, VectorAdd>(vm, pop, op);
+      return;
+    }
+    
+    if (VectorAdd && add.type == UniformVec) {
+      multiplyAddOp<VectorMul, false>(vm, pop, op);
+      return;
+    }
+    
+    if (lhs.type == UniformVec) {
+      uniformMultiplyAddOp<VectorMul, VectorAdd>(vm, pop);
+      return;
+    }
+    
+    // A zero product leaves the addend, as a uniform vector if it's a scalar.
+    if (!VectorMul && Multiply::isAbsorbing(mul.payload.f32)) {
+      vm->pop(2);
+      
+      if (VectorAdd) {
+        dropVector(vm, pop);
+        
+      } else {
+        vm->get(1).type = UniformVec;
+        dropScalar(vm, pop);
+      }
+      
+      vm->countSkipped();
+      return;
+    }
+    
+    vm->pop(3 + pop);
+    
+    auto slot = vm->alloc();
+    
+    op((float const *)vm->dereference(lhs),
+       operandValue(vm, mul, std::integral_constant<bool, VectorMul>()),
+       operandValue(vm, add, std::integral_constant<bool, VectorAdd>()),
+       (float *)vm->dereference(slot),
+       vm->frameSamples());
+  }
+  
+  
+  // Multiply-add operation whose top operand is a uniform vector, and whose other
+  // operands aren't. The kernels round the product before adding, so this is exactly
+  // equivalent to a separate multiply and add.
+  //
+  //   VectorMul: True if the second operand is a vector, false if a scalar.
+  //   VectorAdd: True if the third operand is a vector, false if a scalar.
+  //   vm:        VM state object.
+  //   pop:       Overwrite an additional n-many values from stack when returning.
+  
+  template <bool VectorMul, bool VectorAdd, class VM>
+  void uniformMultiplyAddOp(VM *vm, uint32_t pop) {
+    if (VectorMul) {
+      // Multiplication commutes, so the vector multiplier can take the top operand's place.
+      std::swap(vm->get(1), vm->get(2));
+      multiplyAddOp<false, VectorAdd>(vm, pop, MultiplyAdd());
+      return;
+    }
+    
+    // Otherwise the product is uniform, so replace the top two operands with it and add.
+    float product;
+    Multiply()(vm->get(1).payload.f32, vm->get(2).payload.f32, &product);
+    
+    vm->pop();
+    vm->get(1) = {ScalarFP, product};
+    
+    if (VectorAdd) {
+      scalarVectorOp(vm, pop, Add());
+      
+    } else {
+      uniformOp(vm, pop, Add());
+    }
+  }
+  
+  
+  // Select operation. Overwrite top 3 operands with the second operand for each sample
+  // where the top (vector) operand is greater than zero, and the third elsewhere.
+  //
+  //   VectorTrue:  True if the second operand is a vector, false if a scalar.
+  //   VectorFalse: True if the third operand is a vector, false if a scalar.
+  //   vm:          VM state object.
+  //   pop:         Overwrite an additional n-many values from stack when returning.
+  //   op:          Callable object defining the operation.
+  
+  template <bool VectorTrue, bool VectorFalse, class VM, typename Op>
+  void selectOp(VM *vm, uint32_t pop, Op op) {
+    auto condition = vm->get(1);
+    auto ifTrue = vm->get(2);
+    auto ifFalse = vm->get(3);
+    
+    // Uniform operands take the variant treating them as scalars.
+    if (VectorTrue && ifTrue.type == UniformVec) {
+      selectOp<false, VectorFalse>(vm, pop, op);
+      return;
+    }
+    
+    if (VectorFalse && ifFalse.type == UniformVec) {
+      selectOp<VectorTrue, false>(vm, pop, op);
+      return;
+    }
+    
+    // A uniform condition chooses the same operand for every sample, so drop the other
+    // without a pass over the vectors.
+    if (condition.type == UniformVec) {
+      auto chooseTrue = op.isTrue(condition.payload.f32);
+      auto offset = chooseTrue ? pop + 1 : pop;
+      
+      vm->pop(chooseTrue ? 1 : 2);
+      
+      if (chooseTrue ? VectorTrue : VectorFalse) {
+        dropVector(vm, offset);
+        
+      } else {
+        vm->get(1).type = UniformVec;
+        dropScalar(vm, offset);
+      }
+      
+      vm->countSkipped();
+      return;
+    }
+    
+    vm->pop(3 + pop);
+    
+    auto slot = vm->alloc();
+    
+    op((float const *)vm->dereference(condition),
+       operandValue(vm, ifTrue, std::integral_constant<bool, VectorTrue>()),
+       operandValue(vm, ifFalse, std::integral_constant<bool, VectorFalse>()),
+       (float *)vm->dereference(slot),
+       vm->frameSamples());
+  }
+  
+  
+  // Scalar select operation. Overwrite top 3 operands with the result of the select's
+  // scalar variant.
+  //
+  //   vm:          VM state object.
+  //   pop:         Overwrite an additional n-many values from stack when returning.
+  //   op:          Callable object defining the operation.
+  
+  template <class VM, typename Op>
+  void scalarSelectOp(VM *vm, uint32_t pop, Op op) {
+    auto condition = vm->get(1);
+    auto ifTrue = vm->get(2);
+    auto ifFalse = vm->get(3);
+    
+    vm->pop(3 + pop);
+    
+    float result;
+    op(condition.payload.f32, ifTrue.payload.f32, ifFalse.payload.f32, &result);
+    
+    vm->push({ScalarFP, result});
+  }
+  
+  
+  // Conditional jump. Test whether the top operand, a scalar or vector, is true in every
+  // sample (if `AllTrue`) or in none, and if so pop it and return true to take the jump.
+  //
+  // Scalars and uniform vectors are tested directly. Other vectors need a pass, which
+  // stops at the first cache line deciding the result.
+  //
+  //   AllTrue:   True to test for a condition true in every sample, false for none.
+  //   vm:        VM state object.
+  //   op:        Callable object defining how conditions are tested.
+  
+  template <bool AllTrue, class VM, typename Op>
+  bool jumpOp(VM *vm, Op op) {
+    auto condition = vm->get(1);
+    bool isUniform;
+    
+    if (condition.type == ScalarFP || condition.type == UniformVec) {
+      isUniform = op.isTrue(condition.payload.f32) == AllTrue;
+      
+    } else {
+      auto samples = (float const *)vm->dereference(condition);
+      
+      isUniform = AllTrue
+      ? op.isAllTrue(samples, vm->sampleCount())
+      : !op.isAnyTrue(samples, vm->sampleCount());
+    }
+    
+    // The code jumped over is work skipped for this tile.
+    if (isUniform) {
+      vm->pop();
+      vm->countSkipped();
+    }
+    
+    return isUniform;
+  }
+  
+  
+  // In-place Vector-Vector operation. Overwrite the top operand's buffer with the result
+  // of the binary operation's vector-vector variant, and replace both operands with it.
+  //
+  //   vm:        VM state object.
+  //   op:        Callable object defining the operation.
+  
+  template <class VM, typename Op>
+  void vectorVectorOpInPlace(VM *vm, Op op) {
+    auto lhs = vm->get(1);
+    auto rhs = vm->get(2);
+    
+    // Uniform vectors and references have no buffer to write in place, so their results
+    // are allocated (or uniform) as usual.
+    if (lhs.type != StrongVecRef) {
+      vectorVectorOp(vm, 0, op);
+      return;
+    }
+    
+    if (rhs.type == UniformVec) {
+      vectorScalarOpInPlace(vm, op);
+      return;
+    }
+    
+    auto output = (float *)vm->dereference(lhs);
+    
+    op(output,
+       (float const *)vm->dereference(rhs),
+       output,
+       vm->frameSamples());
+       
+    vm->collapse(2);
+  }
+  
+  
+  // In-place Vector-Scalar operation. Overwrite the top operand's buffer with the result
+  // of the binary operation's vector-scalar variant, and replace both operands with it.
+  //
+  //   vm:        VM state object.
+  //   op:        Callable object defining the operation.
+  
+  template <class VM, typename Op>
+  void vectorScalarOpInPlace(VM *vm, Op op) {
+    auto lhs = vm->get(1);
+    auto rhs = vm->get(2);
+    
+    if (lhs.type != StrongVecRef || op.isAbsorbing(rhs.payload.f32)) {
+      vectorScalarOp(vm, 0, op);
+      return;
+    }
+    
+    if (op.isIdentity(rhs.payload.f32)) {
+      vm->collapse(2);
+      vm->countSkipped();
+      return;
+    }
+    
+    auto output = (float *)vm->dereference(lhs);
+    
+    op(output,
+       rhs.payload.f32,
+       output,
+       vm->frameSamples());
+       
+    vm->collapse(2);
+  }
+  
+  
+  // In-place Multiply-add operation. Overwrite the top operand's buffer with the result
+  // of the multiply-add, and replace all three operands with it.
+  //
+  //   VectorMul: True if the second operand is a vector, false if a scalar.
+  //   VectorAdd: True if the third operand is a vector, false if a scalar.
+  //   vm:        VM state object.
+  //   op:        Callable object defining the operation.
+  
+  template <bool VectorMul, bool VectorAdd, class VM, typename Op>
+  void multiplyAddOpInPlace(VM *vm, Op op) {
+    auto lhs = vm->get(1);
+    auto mul = vm->get(2);
+    auto add = vm->get(3);
+    
+    if (lhs.type != StrongVecRef || (!VectorMul && Multiply::isAbsorbing(mul.payload.f32))) {
+      multiplyAddOp<VectorMul, VectorAdd>(vm, 0, op);
+      return;
+    }
+    
+    if (VectorMul && mul.type == UniformVec) {
+      multiplyAddOpInPlace<false, VectorAdd>(vm, op);
+      return;
+    }
+    
+    if (VectorAdd && add.type == UniformVec) {
+      multiplyAddOpInPlace<VectorMul, false>(vm, op);
+      return;
+    }
+    
+    auto output = (float *)vm->dereference(lhs);
+    
+    op(output,
+       operandValue(vm, mul, std::integral_constant<bool, VectorMul>()),
+       operandValue(vm, add, std::integral_constant<bool, VectorAdd>()),
+       output,
+       vm->frameSamples());
+       
+    vm->collapse(3);
+  }
+  
+  
+  // Drop operation. Consume the top slot + `offset` slots beneath it, then
+  // push the top slot's scalar value back.
+  //
+  //   vm:        VM state object.
+  //   offset:    Number of slots below the top to drop.
+  
+  template <class VM>
+  void dropScalar(VM *vm, uint32_t offset) {
+    auto count = offset + 1;
+    auto src = vm->get(1);
+    
+    vm->pop(count);
+    vm->push(src);
+  }
+  
+  
+  // Drop operation. Consume the top slot + `offset` slots beneath it, then
+  // push a reference to the top slot's vector (or the uniform vector itself) back.
+  //
+  //   vm:        VM state object.
+  //   offset:    Number of slots below the top to drop.
+  
+  template <class VM>
+  void dropVector(VM *vm, uint32_t offset) {
+    auto src = vm->get(1);
+    
+    if (src.type == UniformVec) {
+      dropScalar(vm, offset);
+      return;
+    }
+    
+    auto srcVec = vm->dereference(src);
+    
+    vm->pop(offset + 1);
+    
+    if (vm->isAllocated(src)) {
+      // The vector's strong ref is below the dropped slots, so just push another ref.
+      vm->push(vm->reference(src));
+      
+    } else {
+      // Dropping a vector to below the location of its strong ref requires a copy. The
+      // popped vector is still intact, and at or above the one allocated for the copy.
+      //
+      // This should only happen in very rare cases, such as when a parameter
+      // to a function invoked via polymorphic dispatch is returned immediately without
+      // being modified.
+      
+      auto destVec = vm->dereference(vm->alloc());
+      std::copy_n(srcVec, vm->frameSamples(), destVec);
+    }
+  }
+  
+  
+  // Fill operation. Replace the scalar at the top of the stack with a uniform vector
+  // containing the scalar's value in every sample. Nothing is written to the vector
+  // stack unless the vector is rendered.
+  //
+  //   vm:        VM state object.
+  
+  template <class VM>
+  void fill(VM *vm) {
+    vm->get(1).type = UniformVec;
+    vm->countSkipped();
+  }
+  
+  
+  // Report a symbol reference left unresolved by the linker.
+  //
+  // Evaluation never resolves symbols itself, since that would require modifying code
+  // shared between threads.
+  //
+  //   sym:       Unresolved symbol.
+  
+  void unlinkedSymbol(Symbol sym) {
+    auto err = std::stringstream() << "Unlinked symbol: `" << sym << "`";
+    throw std::runtime_error(err.str());
+  }
+  
+  
+  // Helpers called by JIT-compiled code (see VMJit.cpp), which also evaluates operations
+  // on uniform vectors with them.
+  template void dropScalar(VMState *vm, uint32_t offset);
+  template void dropVector(VMState *vm, uint32_t offset);
+  template void fill(VMState *vm);
+  
+#define JIT_BINARY_OP_HELPERS(OPERATION) \
+template void vectorVectorOp(VMState *vm, uint32_t pop, OPERATION op); \
+template void vectorScalarOp(VMState *vm, uint32_t pop, OPERATION op); \
+template void scalarVectorOp(VMState *vm, uint32_t pop, OPERATION op); \
+template void vectorVectorOpInPlace(VMState *vm, OPERATION op); \
+template void vectorScalarOpInPlace(VMState *vm, OPERATION op);
+  
+  JIT_BINARY_OP_HELPERS(Add);
+  JIT_BINARY_OP_HELPERS(Multiply);
+  
+#undef JIT_BINARY_OP_HELPERS
+  
+  // Math operations have no vector instructions, so compiled code calls these for
+  // every variant.
+#define JIT_MATH_OP_HELPERS(TIER) \
+template void vectorUnaryOp(VMState *vm, uint32_t pop, Sin<TIER> op); \
+template void vectorUnaryOp(VMState *vm, uint32_t pop, Cos<TIER> op); \
+template void vectorUnaryOp(VMState *vm, uint32_t pop, Exp<TIER> op); \
+template void vectorUnaryOp(VMState *vm, uint32_t pop, Log<TIER> op); \
+template void vectorUnaryOp(VMState *vm, uint32_t pop, Tanh<TIER> op); \
+template void scalarUnaryOp(VMState *vm, uint32_t pop, Sin<TIER> op); \
+template void scalarUnaryOp(VMState *vm, uint32_t pop, Cos<TIER> op); \
+template void scalarUnaryOp(VMState *vm, uint32_t pop, Exp<TIER> op); \
+template void scalarUnaryOp(VMState *vm, uint32_t pop, Log<TIER> op); \
+template void scalarUnaryOp(VMState *vm, uint32_t pop, Tanh<TIER> op); \
+template void vectorVectorOp(VMState *vm, uint32_t pop, Pow<TIER> op); \
+template void vectorScalarOp(VMState *vm, uint32_t pop, Pow<TIER> op); \
+template void scalarVectorOp(VMState *vm, uint32_t pop, Pow<TIER> op);
+  
+  JIT_MATH_OP_HELPERS(Accuracy::Precise);
+  JIT_MATH_OP_HELPERS(Accuracy::Fast);
+  
+#undef JIT_MATH_OP_HELPERS
+  
+  // Likewise for noise.
+  template void vectorVectorOp(VMState *vm, uint32_t pop, Noise<false> op);
+  template void vectorScalarOp(VMState *vm, uint32_t pop, Noise<false> op);
+  template void scalarVectorOp(VMState *vm, uint32_t pop, Noise<false> op);
+  template void vectorVectorOp(VMState *vm, uint32_t pop, Noise<true> op);
+  template void vectorScalarOp(VMState *vm, uint32_t pop, Noise<true> op);
+  template void scalarVectorOp(VMState *vm, uint32_t pop, Noise<true> op);
+  
+  // And for table lookups.
+  template void vectorTableOp(VMState *vm, uint32_t pop, TableLookup<Interpolation::Nearest> op);
+  template void scalarTableOp(VMState *vm, uint32_t pop, TableLookup<Interpolation::Nearest> op);
+  template void vectorTableOp(VMState *vm, uint32_t pop, TableLookup<Interpolation::Linear> op);
+  template void scalarTableOp(VMState *vm, uint32_t pop, TableLookup<Interpolation::Linear> op);
+  template void vectorTableOp(VMState *vm, uint32_t pop, TableLookup<Interpolation::Cubic> op);
+  template void scalarTableOp(VMState *vm, uint32_t pop, TableLookup<Interpolation::Cubic> op);
+  
+  template void multiplyAddOp<true, true>(VMState *vm, uint32_t pop, MultiplyAdd op);
+  template void multiplyAddOp<false, true>(VMState *vm, uint32_t pop, MultiplyAdd op);
+  template void multiplyAddOp<true, false>(VMState *vm, uint32_t pop, MultiplyAdd op);
+  template void multiplyAddOp<false, false>(VMState *vm, uint32_t pop, MultiplyAdd op);
+  
+  // And for clamping and selection.
+  template void vectorVectorOp(VMState *vm, uint32_t pop, Min op);
+  template void vectorScalarOp(VMState *vm, uint32_t pop, Min op);
+  template void scalarVectorOp(VMState *vm, uint32_t pop, Min op);
+  template void vectorVectorOp(VMState *vm, uint32_t pop, Max op);
+  template void vectorScalarOp(VMState *vm, uint32_t pop, Max op);
+  template void scalarVectorOp(VMState *vm, uint32_t pop, Max op);
+  template void vectorVectorOp(VMState *vm, uint32_t pop, Clip op);
+  template void vectorScalarOp(VMState *vm, uint32_t pop, Clip op);
+  template void scalarVectorOp(VMState *vm, uint32_t pop, Clip op);
+  template void vectorUnaryOp(VMState *vm, uint32_t pop, Abs op);
+  template void scalarUnaryOp(VMState *vm, uint32_t pop, Abs op);
+  
+  template void selectOp<true, true>(VMState *vm, uint32_t pop, Select op);
+  template void selectOp<false, true>(VMState *vm, uint32_t pop, Select op);
+  template void selectOp<true, false>(VMState *vm, uint32_t pop, Select op);
+  template void selectOp<false, false>(VMState *vm, uint32_t pop, Select op);
+  template void scalarSelectOp(VMState *vm, uint32_t pop, Select op);
+  template bool jumpOp<true>(VMState *vm, Select op);
+  template bool jumpOp<false>(VMState *vm, Select op);
+  
+  template void multiplyAddOpInPlace<true, true>(VMState *vm, MultiplyAdd op);
+  template void multiplyAddOpInPlace<false, true>(VMState *vm, MultiplyAdd op);
+  template void multiplyAddOpInPlace<true, false>(VMState *vm, MultiplyAdd op);
+  template void multiplyAddOpInPlace<false, false>(VMState *vm, MultiplyAdd op);
 }
@@ -3,8 +3,186 @@
 #include "Symbol.hpp"
 #include "Data.hpp"
 
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 namespace vm {
   struct Package;
+  struct ScalarStackSlot;
+  struct VectorStackSlot;
+  struct CallFrame;
+  struct ThreadedInstruction;
+  struct Closure;
+  
+  namespace jit {
+    class Program;
+  }
+  
+  // Strategy used by the evaluation loop to dispatch instructions.
+  enum Dispatch {
+    // Switch on each instruction's opcode.
+    SwitchDispatch,
+    
+    // Pre-decode instructions into handler addresses and jump directly between
+    // handlers. Requires computed goto, so falls back to SwitchDispatch on
+    // compilers without it.
+    ThreadedDispatch,
+    
+    // Compile each function into pre-bound closures, specialised for each instruction's
+    // opcode and operand types, and call each in turn. Avoids decoding instructions
+    // without relying on computed goto or executable memory.
+    ClosureDispatch,
+    
+    // Compile the package to native code (see VMJit.hpp). Falls back to
+    // ThreadedDispatch on unsupported hosts, or for packages the JIT can't compile.
+    JitDispatch
+  };
+  
+  // Stack size for Context and eval, sizing each stack to fit the deepest function in the
+  // package (see vm::stackDepth).
+  uint32_t const AutoStackSize = 0;
+  
+  Data eval(Package const *package, Symbol symbol, Data const &param, size_t stackSize = AutoStackSize, Dispatch dispatch = ThreadedDispatch);
+  
+  
+  // Tile sizes for Context, other than an explicit # samples.
+  //
+  //   AutoTileSize:  Choose a tile size for the package (see tileSize).
+  //   WholeBlock:    Evaluate each block in one pass.
+  uint32_t const AutoTileSize = 0;
+  uint32_t const WholeBlock = UINT32_MAX;
+  
+  // Choose the # samples to evaluate at a time when rendering blocks of `package`.
+  //
+  // Every operation is element-wise, so a block can be rendered as a sequence of smaller
+  // tiles. Smaller tiles keep intermediate vectors resident in L1 cache, at the cost of
+  // dispatching each instruction once per tile. The tile size is chosen so that the
+  // vectors live at any one time fit in L1.
+  uint32_t tileSize(Package const *package);
+  
+  
+  // Work a Context skipped by evaluating uniform vectors (such as silent blocks) without
+  // passes over their samples. See VMState.hpp.
+  struct RenderStats {
+    // # tiles whose input had the same value in every sample, so started out uniform.
+    uint64_t uniformTiles;
+    
+    // # vector operations that skipped their pass over a tile.
+    uint64_t skippedOps;
+  };
+  
   
-  Data eval(Package *package, Symbol symbol, Data const &param, size_t stackSize = 16 * 1024);
+  // Reusable evaluation context for rendering a package block-by-block.
+  //
+  // Owns the VM's stacks, allocated up front and (where permitted) locked into
+  // physical memory, along with any pre-decoded code. Rendering a block performs
+  // no heap allocation.
+  //
+  // A context may only be used by one thread at a time, but any number of contexts
+  // may share a linked package. The package must outlive the context.
+  class Context {
+  public:
+    //   package:     Linked package to evaluate (see vm::link).
+    //   stackSize:   # slots in each stack, or AutoStackSize. Throws if any function in the
+    //                package needs more scalar slots, call frames or vectors than this.
+    //   dispatch:    Instruction dispatch strategy.
+    //   lock:        Lock the stacks into physical memory, so that rendering never page faults.
+    //   tileSamples: # samples to evaluate at a time (rounded down to a whole vector slot),
+    //                AutoTileSize or WholeBlock. Tiling pays off when a block's intermediate
+    //                vectors don't fit in the L2 cache.
+    explicit Context(Package const *package, size_t stackSize = AutoStackSize, Dispatch dispatch = ThreadedDispatch, bool lock = true, uint32_t tileSamples = WholeBlock);
+    ~Context();
+    
+    Context(Context const &) = delete;
+    Context &operator=(Context const &) = delete;
+    
+    // Evaluate a function over one block of samples, writing the result to `output`.
+    //
+    // Blocks larger than the context's tile size are evaluated one tile at a time. So are
+    // blocks whose vectors don't all fit in the vector stack at once, in tiles as large as
+    // the stack allows.
+    //
+    //   symbol:      Name of function to execute.
+    //   input:       Parameter for the function (sampleCount samples).
+    //   output:      Buffer receiving the result (sampleCount samples). May alias input.
+    //   sampleCount: # samples in the block.
+    void render(Symbol symbol, float const *input, float *output, uint32_t sampleCount);
+    
+    // True if the stacks could be locked into physical memory.
+    bool isLocked() const {
+      return locked;
+    }
+    
+    // # samples evaluated at a time.
+    uint32_t getTileSamples() const {
+      return tileSamples;
+    }
+    
+    // Dispatch strategy in use, after any fallback from the one requested.
+    Dispatch getDispatch() const {
+      return dispatch;
+    }
+    
+    // True if rendering `symbol` skips the VM state's invariant checks, having passed
+    // verification (see vm::verify). Only switch and threaded dispatch skip them.
+    bool isVerified(Symbol symbol) const;
+    
+    // Work skipped for uniform vectors, accumulated over every render.
+    RenderStats const &getStats() const {
+      return stats;
+    }
+    
+  private:
+    // Evaluate the function at `instPtr` over a single tile, using VM state type `VM`.
+    template <class VM>
+    void renderTile(uint32_t instPtr, float const *input, float *output, uint32_t sampleCount);
+    
+    // Evaluate the function at `instPtr` against `vm` using the context's dispatch strategy.
+    template <class VM>
+    void evalTile(VM *vm, uint32_t instPtr);
+    
+    // Function that may be rendered.
+    struct Entry {
+      uint32_t instPtr;
+      
+      // # samples evaluated at a time, so that the function's vectors fit in the vector stack.
+      uint32_t tileSamples;
+      
+      // True if the function passed verification, so is evaluated without checks.
+      bool verified;
+    };
+    
+    Package const *package;
+    Dispatch dispatch;
+    uint32_t tileSamples;
+    RenderStats stats;
+    
+    std::unordered_map<Symbol, Entry> entries;
+    
+    // Code decoded for threaded dispatch, with checked and unchecked VM states.
+    std::vector<ThreadedInstruction> decoded;
+    std::vector<ThreadedInstruction> decodedUnchecked;
+    
+    // Code compiled for closure dispatch.
+    std::vector<Closure> closures;
+    
+    // Code compiled for JIT dispatch.
+    std::unique_ptr<jit::Program> compiled;
+    
+    // Single allocation holding all stacks.
+    void *memory;
+    size_t memorySize;
+    bool locked;
+    
+    VectorStackSlot *vectorStack;
+    ScalarStackSlot *scalarStack;
+    CallFrame *callStack;
+    
+    // Capacity of each stack (in slots).
+    uint32_t vectorStackSize;
+    uint32_t scalarStackSize;
+    uint32_t callStackSize;
+  };
 }
@@ -0,0 +1,1003 @@
+#include "VMJit.hpp"
+#include "VMOps.hpp"
+#include "VMState.hpp"
+#include "Instruction.hpp"
+
+#include <cstddef>
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Compiled code follows the System V calling convention, so needs an x86-64 host
+// other than Windows.
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(TEMPO_NO_JIT)
+#define TEMPO_JIT 1
+#endif
+
+namespace vm {
+  template <class VM>
+  void dropScalar(VM *vm, uint32_t offset);
+  
+  template <class VM>
+  void dropVector(VM *vm, uint32_t offset);
+  
+  template <class VM>
+  void fill(VM *vm);
+  
+  template <class VM, typename Op>
+  void vectorVectorOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void vectorScalarOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void scalarVectorOp(VM *vm, uint32_t pop, Op op);
+  
+  template <bool VectorMul, bool VectorAdd, class VM, typename Op>
+  void multiplyAddOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void vectorUnaryOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void scalarUnaryOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void vectorTableOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void scalarTableOp(VM *vm, uint32_t pop, Op op);
+  
+  template <bool VectorTrue, bool VectorFalse, class VM, typename Op>
+  void selectOp(VM *vm, uint32_t pop, Op op);
+  
+  template <class VM, typename Op>
+  void scalarSelectOp(VM *vm, uint32_t pop, Op op);
+  
+  template <bool AllTrue, class VM, typename Op>
+  bool jumpOp(VM *vm, Op op);
+  
+  template <class VM, typename Op>
+  void vectorVectorOpInPlace(VM *vm, Op op);
+  
+  template <class VM, typename Op>
+  void vectorScalarOpInPlace(VM *vm, Op op);
+  
+  template <bool VectorMul, bool VectorAdd, class VM, typename Op>
+  void multiplyAddOpInPlace(VM *vm, Op op);
+}
+
+namespace {
+  using namespace vm;
+  
+  /**
+   Register Conventions
+   
+   Compiled code keeps the interpreter's evaluation state in callee-saved registers,
+   so that it survives calls to helpers:
+      
+      * rbx: VMState being evaluated.
+      * r12: Operands block, through which helpers return their operands.
+      * r13d: Offset applied to popping instructions (resultOffset).
+      * r14d: # values the current function pops when it returns (popCount).
+      * ebp: Current call depth.
+      * r15: Stack pointer on entry, restored to unwind on error.
+   
+   Each function body runs with the stack pointer 16-byte aligned, so that helpers can
+   be called directly. VM calls push the caller's resultOffset and popCount (plus
+   padding) before making a native call, and EXIT is a native return.
+   */
+  
+  // Block through which helpers pass arithmetic operands to compiled code.
+  struct Operands {
+    // Vector operand, then the remaining operands in stack order. Scalar operands
+    // point into `scalars`.
+    float const *sources[3];
+    
+    // Buffer receiving the result.
+    float *output;
+    
+    // Length of each vector (in bytes).
+    uint64_t bytes;
+    
+    // Maximum call depth.
+    uint32_t callStackSize;
+    
+    float scalars[2];
+  };
+  
+  // Status returned from compiled code.
+  enum Status : uint32_t {
+    Finished,
+    CallStackOverflow,
+    InvalidCallTarget,
+    UndefinedTable
+  };
+  
+  // Entry point into compiled code.
+  typedef Status (*Trampoline)(VMState *vm, void const *entry, Operands *operands);
+  
+  
+  /** Helpers called from compiled code **/
+  
+  void push(VMState *vm, uint32_t value) {
+    Data::Value payload;
+    payload.u32 = value;
+    
+    vm->push({ScalarFP, payload});
+  }
+  
+  void copy(VMState *vm, uint32_t offset) {
+    vm->push(vm->get(offset));
+  }
+  
+  void referenceVector(VMState *vm, uint32_t offset) {
+    vm->push(vm->reference(vm->get(offset)));
+  }
+  
+  // Pop the function address for a call and return it.
+  uint32_t callTarget(VMState *vm) {
+    auto fnPtr = vm->get(1).payload.u32;
+    vm->pop();
+    
+    return fnPtr;
+  }
+  
+  // Index of the table a lookup reads, checked before the lookup so that an undefined
+  // table stops compiled code with a status rather than throwing through it.
+  uint32_t tableIndex(VMState *vm) {
+    return vm->get(2).payload.u32;
+  }
+  
+  // Point `sources[index]` at an operand's vector, or at a copy of its scalar value.
+  void setSource(VMState *vm, Operands *operands, size_t index, ScalarStackSlot slot, bool isVector) {
+    if (isVector) {
+      operands->sources[index] = (float const *)vm->dereference(slot);
+      
+    } else {
+      operands->scalars[index - 1] = slot.payload.f32;
+      operands->sources[index] = &operands->scalars[index - 1];
+    }
+  }
+  
+  // True if a vector operand (as given by `isVector`) is uniform.
+  bool isUniform(ScalarStackSlot slot, bool isVector) {
+    return isVector && slot.type == UniformVec;
+  }
+  
+  // True if the interpreter's helpers may skip a binary operation's pass over its vector
+  // operand, because of its other operand (see VMOps.hpp).
+  template <typename Op>
+  bool isShortCircuit(ScalarStackSlot slot, bool isVector) {
+    return isVector ? slot.type == UniformVec : Op::isIdentity(slot.payload.f32) || Op::isAbsorbing(slot.payload.f32);
+  }
+  
+  // Arithmetic helpers return true if they evaluated the operation themselves, because an
+  // operand is a uniform vector or a value that short-circuits it, so compiled code skips
+  // its loop. These operations are evaluated by the interpreter's helpers.
+  
+  // Binary operation with at least one vector operand. Pops the operands, allocates the
+  // result, and returns the vector operand first, as the kernels take them.
+  template <typename Op, bool VectorLhs, bool VectorRhs>
+  bool binaryOp(VMState *vm, uint32_t pop, Operands *operands) {
+    auto lhs = vm->get(1);
+    auto rhs = vm->get(2);
+    
+    if (isShortCircuit<Op>(lhs, VectorLhs) || isShortCircuit<Op>(rhs, VectorRhs)) {
+      if (VectorLhs && VectorRhs) {
+        vm::vectorVectorOp(vm, pop, Op());
+        
+      } else if (VectorLhs) {
+        vm::vectorScalarOp(vm, pop, Op());
+        
+      } else {
+        vm::scalarVectorOp(vm, pop, Op());
+      }
+      
+      return true;
+    }
+    
+    vm->pop(2 + pop);
+    
+    auto slot = vm->alloc();
+    
+    if (VectorLhs) {
+      setSource(vm, operands, 0, lhs, true);
+      setSource(vm, operands, 1, rhs, VectorRhs);
+      
+    } else {
+      setSource(vm, operands, 0, rhs, true);
+      setSource(vm, operands, 1, lhs, false);
+    }
+    
+    operands->output = (float *)vm->dereference(slot);
+    operands->bytes = vm->frameSamples() * sizeof(float);
+    
+    return false;
+  }
+  
+  // Multiply-add operation. Pops the operands and allocates the result.
+  template <bool VectorMul, bool VectorAdd>
+  bool multiplyAddOp(VMState *vm, uint32_t pop, Operands *operands) {
+    auto lhs = vm->get(1);
+    auto mul = vm->get(2);
+    auto add = vm->get(3);
+    
+    if (isUniform(lhs, true) || isShortCircuit<Multiply>(mul, VectorMul) || isUniform(add, VectorAdd)) {
+      vm::multiplyAddOp<VectorMul, VectorAdd>(vm, pop, MultiplyAdd());
+      return true;
+    }
+    
+    vm->pop(3 + pop);
+    
+    auto slot = vm->alloc();
+    
+    setSource(vm, operands, 0, lhs, true);
+    setSource(vm, operands, 1, mul, VectorMul);
+    setSource(vm, operands, 2, add, VectorAdd);
+    
+    operands->output = (float *)vm->dereference(slot);
+    operands->bytes = vm->frameSamples() * sizeof(float);
+    
+    return false;
+  }
+  
+  // Return the operands of an in-place operation on `Count` operands. The result
+  // overwrites the top operand's buffer, which then replaces the operands.
+  template <size_t Count, bool VectorMul, bool VectorAdd>
+  void setInPlaceSources(VMState *vm, Operands *operands) {
+    setSource(vm, operands, 0, vm->get(1), true);
+    setSource(vm, operands, 1, vm->get(2), VectorMul);
+    
+    if (Count == 3) {
+      setSource(vm, operands, 2, vm->get(3), VectorAdd);
+    }
+    
+    operands->output = (float *)vm->dereference(vm->get(1));
+    operands->bytes = vm->frameSamples() * sizeof(float);
+    
+    // Operands are read before collapsing, which leaves their buffers intact.
+    vm->collapse(Count);
+  }
+  
+  template <typename Op, bool VectorRhs>
+  bool binaryOpInPlace(VMState *vm, Operands *operands) {
+    if (vm->get(1).type != StrongVecRef || isShortCircuit<Op>(vm->get(2), VectorRhs)) {
+      if (VectorRhs) {
+        vm::vectorVectorOpInPlace(vm, Op());
+        
+      } else {
+        vm::vectorScalarOpInPlace(vm, Op());
+      }
+      
+      return true;
+    }
+    
+    setInPlaceSources<2, VectorRhs, false>(vm, operands);
+    return false;
+  }
+  
+  template <bool VectorMul, bool VectorAdd>
+  bool multiplyAddOpInPlace(VMState *vm, Operands *operands) {
+    if (vm->get(1).type != StrongVecRef || isShortCircuit<Multiply>(vm->get(2), VectorMul) || isUniform(vm->get(3), VectorAdd)) {
+      vm::multiplyAddOpInPlace<VectorMul, VectorAdd>(vm, MultiplyAdd());
+      return true;
+    }
+    
+    setInPlaceSources<3, VectorMul, VectorAdd>(vm, operands);
+    return false;
+  }
+  
+  template <typename Op>
+  void scalarScalarOp(VMState *vm, uint32_t pop) {
+    auto lhs = vm->get(1);
+    auto rhs = vm->get(2);
+    
+    vm->pop(2 + pop);
+    
+    float result;
+    Op()(lhs.payload.f32, rhs.payload.f32, &result);
+    
+    vm->push({ScalarFP, result});
+  }
+  
+  // Math operations have no packed instructions, so are evaluated entirely by the
+  // interpreter's helpers, which call the kernels (see VMKernels.hpp).
+  template <typename Op, bool Vector>
+  void unaryMathOp(VMState *vm, uint32_t pop) {
+    if (Vector) {
+      vm::vectorUnaryOp(vm, pop, Op());
+      
+    } else {
+      vm::scalarUnaryOp(vm, pop, Op());
+    }
+  }
+  
+  // Likewise for table lookups, which gather from the table.
+  template <typename Op, bool Vector>
+  void tableLookupOp(VMState *vm, uint32_t pop) {
+    if (Vector) {
+      vm::vectorTableOp(vm, pop, Op());
+      
+    } else {
+      vm::scalarTableOp(vm, pop, Op());
+    }
+  }
+  
+  // And for selection, which has no packed instruction either.
+  template <bool VectorTrue, bool VectorFalse>
+  void selectMathOp(VMState *vm, uint32_t pop) {
+    vm::selectOp<VectorTrue, VectorFalse>(vm, pop, Select());
+  }
+  
+  void scalarSelectMathOp(VMState *vm, uint32_t pop) {
+    vm::scalarSelectOp(vm, pop, Select());
+  }
+  
+  // Test a conditional jump's condition, popping it and returning true if the jump is taken.
+  template <bool AllTrue>
+  bool jumpCondition(VMState *vm) {
+    return vm::jumpOp<AllTrue>(vm, Select());
+  }
+  
+  template <typename Op, bool VectorLhs, bool VectorRhs>
+  void binaryMathOp(VMState *vm, uint32_t pop) {
+    if (VectorLhs && VectorRhs) {
+      vm::vectorVectorOp(vm, pop, Op());
+      
+    } else if (VectorLhs) {
+      vm::vectorScalarOp(vm, pop, Op());
+      
+    } else if (VectorRhs) {
+      vm::scalarVectorOp(vm, pop, Op());
+      
+    } else {
+      scalarScalarOp<Op>(vm, pop);
+    }
+  }
+  
+  
+  /** Assembler **/
+  
+  // General purpose registers, by encoding.
+  enum Register : uint8_t {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+  };
+  
+  // Packed single-precision arithmetic opcodes (following 0F).
+  enum PackedOp : uint8_t {
+    AddPS = 0x58,
+    MulPS = 0x59
+  };
+  
+  // Appends x86-64 machine code to a buffer. Provides only the instructions the JIT
+  // emits, with operands fixed wherever the JIT doesn't need to vary them.
+  class Assembler {
+  public:
+    // Current offset into the code.
+    size_t offset() const {
+      return code.size();
+    }
+    
+    void emit(std::initializer_list<uint8_t> bytes) {
+      code.insert(code.end(), bytes);
+    }
+    
+    void emit32(uint32_t value) {
+      for (int i = 0; i < 4; ++i) {
+        code.push_back((uint8_t)(value >> (i * 8)));
+      }
+    }
+    
+    void emit64(uint64_t value) {
+      emit32((uint32_t)value);
+      emit32((uint32_t)(value >> 32));
+    }
+    
+    // Emit a jump or branch opcode with a 32-bit displacement to `target`, or to a
+    // later target if it is omitted. Returns the displacement's offset for `patch`.
+    size_t jump(std::initializer_list<uint8_t> opcode, size_t target = SIZE_MAX) {
+      emit(opcode);
+      
+      auto fixup = offset();
+      emit32(0);
+      
+      if (target != SIZE_MAX) {
+        patch(fixup, target);
+      }
+      
+      return fixup;
+    }
+    
+    // Point the displacement at `fixup` to `target`.
+    void patch(size_t fixup, size_t target) {
+      auto rel = (int32_t)(target - (fixup + 4));
+      memcpy(&code[fixup], &rel, 4);
+    }
+    
+    // mov reg32, imm32
+    void movImm32(Register reg, uint32_t value) {
+      if (reg >= R8) emit({0x41});
+      emit({(uint8_t)(0xB8 | (reg & 7))});
+      emit32(value);
+    }
+    
+    // mov reg64, imm64
+    void movImm64(Register reg, uint64_t value) {
+      emit({(uint8_t)(reg >= R8 ? 0x49 : 0x48), (uint8_t)(0xB8 | (reg & 7))});
+      emit64(value);
+    }
+    
+    // mov reg64, [r12 + disp8]
+    void loadOperand(Register reg, size_t disp) {
+      emit({(uint8_t)(reg >= R8 ? 0x4D : 0x49), 0x8B, (uint8_t)(0x44 | (reg & 7) << 3), 0x24, (uint8_t)disp});
+    }
+    
+    // Call a helper, passing the VM state as the first argument.
+    void callHelper(void const *fn) {
+      emit({0x48, 0x89, 0xDF}); // mov rdi, rbx
+      movImm64(RAX, (uint64_t)fn);
+      emit({0xFF, 0xD0}); // call rax
+    }
+    
+    // Emit multi-byte NOPs until the offset is a multiple of `alignment`.
+    void align(size_t alignment) {
+      static uint8_t const nops[][9] = {
+        {0x90},
+        {0x66, 0x90},
+        {0x0F, 0x1F, 0x00},
+        {0x0F, 0x1F, 0x40, 0x00},
+        {0x0F, 0x1F, 0x44, 0x00, 0x00},
+        {0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00},
+        {0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00},
+        {0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00}
+      };
+      
+      while (offset() % alignment) {
+        auto size = std::min<size_t>(alignment - offset() % alignment, 9);
+        code.insert(code.end(), nops[size - 1], nops[size - 1] + size);
+      }
+    }
+    
+    // Width of vector registers used by the vector instructions (in bytes).
+    size_t vectorBytes() const {
+      return avx ? 32 : 16;
+    }
+    
+    // Load or store (`opcode` 0x10 or 0x11) vector register `reg` at [base + r9 + disp8].
+    void vectorIndexed(uint8_t opcode, uint8_t reg, Register base, uint8_t disp) {
+      if (avx) {
+        emit({0xC4, 0xA1, 0x7C, opcode}); // vmovups ymm (VEX.256.0F, index extended)
+        
+      } else {
+        emit({0x42, 0x0F, opcode});       // movups xmm
+      }
+      
+      emit({(uint8_t)(0x44 | reg << 3), (uint8_t)(0x08 | base), disp});
+    }
+    
+    // Apply `op` to the vector in register 0 and register `reg`, leaving the result in 0.
+    void vectorOp(PackedOp op, uint8_t reg) {
+      if (avx) {
+        emit({0xC5, 0xFC, op, (uint8_t)(0xC0 | reg)}); // vop ymm0, ymm0, ymm
+        
+      } else {
+        emit({0x0F, op, (uint8_t)(0xC0 | reg)});       // op xmm0, xmm
+      }
+    }
+    
+    // Broadcast the float at [base] to every lane of vector register `reg`.
+    void broadcast(uint8_t reg, Register base) {
+      if (avx) {
+        emit({0xC4, 0xE2, 0x7D, 0x18, (uint8_t)(reg << 3 | base)}); // vbroadcastss ymm, [base]
+        
+      } else {
+        emit({0xF3, 0x0F, 0x10, (uint8_t)(reg << 3 | base)});      // movss xmm, [base]
+        emit({0x0F, 0xC6, (uint8_t)(0xC0 | reg << 3 | reg), 0x00}); // shufps xmm, xmm, 0
+      }
+    }
+    
+    // Finish a sequence of vector instructions, before calling or returning to code
+    // that may use legacy SSE encodings.
+    void endVector() {
+      if (avx) {
+        emit({0xC5, 0xF8, 0x77}); // vzeroupper
+      }
+    }
+    
+    // Use 256-bit AVX encodings for vector instructions, rather than SSE.
+    bool avx = false;
+    
+    std::vector<uint8_t> code;
+  };
+  
+  
+  /** Code generation **/
+  
+  // Arithmetic applied to the accumulated value, with the next operand.
+  struct LoopStep {
+    PackedOp op;
+    bool isVector;
+  };
+  
+  // Emit a loop over the operands returned by a helper, applying each step in turn to
+  // the vector operand and writing the result to the output buffer.
+  //
+  // Vectors are a whole number of 64-byte slots, so each iteration processes a slot
+  // without needing to handle a remainder. The result is rounded after every step,
+  // exactly as by the kernels.
+  void emitLoop(Assembler &a, std::initializer_list<LoopStep> steps) {
+    // Pointer to each source, then the scalar lanes for each step.
+    Register const sources[] = {RAX, RCX, RDX};
+    uint8_t const scalarLanes[] = {6, 7};
+    
+    a.loadOperand(RAX, offsetof(Operands, sources[0]));
+    a.loadOperand(RSI, offsetof(Operands, output));
+    a.loadOperand(R8, offsetof(Operands, bytes));
+    
+    size_t index = 0;
+    for (auto step : steps) {
+      ++index;
+      a.loadOperand(sources[index], offsetof(Operands, sources) + index * sizeof(float const *));
+      
+      if (!step.isVector) {
+        a.broadcast(scalarLanes[index - 1], sources[index]);
+      }
+    }
+    
+    a.emit({0x4D, 0x85, 0xC0}); // test r8, r8
+    auto skip = a.jump({0x0F, 0x84}); // jz
+    
+    a.emit({0x45, 0x31, 0xC9}); // xor r9d, r9d
+    
+    // Many Intel cores can't cache decoded branches that cross or end on a 32-byte
+    // boundary, so keep the loop's branch within one.
+    size_t const branchBytes = 13; // add, cmp & jb
+    
+    a.align(32);
+    auto top = a.offset();
+    
+    for (size_t disp = 0; disp < 64; disp += a.vectorBytes()) {
+      a.vectorIndexed(0x10, 0, RAX, disp);
+      
+      index = 0;
+      for (auto step : steps) {
+        ++index;
+        
+        if (step.isVector) {
+          a.vectorIndexed(0x10, 1, sources[index], disp);
+          a.vectorOp(step.op, 1);
+          
+        } else {
+          a.vectorOp(step.op, scalarLanes[index - 1]);
+        }
+      }
+      
+      a.vectorIndexed(0x11, 0, RSI, disp);
+    }
+    
+    if (a.offset() % 32 + branchBytes >= 32) {
+      a.align(32);
+    }
+    
+    a.emit({0x49, 0x83, 0xC1, 0x40}); // add r9, 64
+    a.emit({0x4D, 0x39, 0xC1});       // cmp r9, r8
+    a.jump({0x0F, 0x82}, top);        // jb top
+    
+    a.patch(skip, a.offset());
+    a.endVector();
+  }
+  
+  // Emit code calling a helper that takes the VM state and a popping instruction's
+  // operand, adjusted by the current resultOffset.
+  void emitPopping(Assembler &a, void const *fn, uint32_t operand) {
+    a.movImm32(RSI, operand);
+    a.emit({0x44, 0x01, 0xEE}); // add esi, r13d
+    a.callHelper(fn);
+  }
+  
+  // Emit a loop following a call to an arithmetic helper, skipped if the helper
+  // evaluated the operation itself.
+  void emitHelperLoop(Assembler &a, std::initializer_list<LoopStep> steps) {
+    a.emit({0x84, 0xC0});                  // test al, al
+    auto evaluated = a.jump({0x0F, 0x85}); // jnz
+    
+    emitLoop(a, steps);
+    a.patch(evaluated, a.offset());
+  }
+  
+  // Emit a binary operation with a vector operand.
+  template <typename Op, bool VectorLhs, bool VectorRhs>
+  void emitBinaryOp(Assembler &a, PackedOp op, uint32_t operand) {
+    a.emit({0x4C, 0x89, 0xE2}); // mov rdx, r12
+    emitPopping(a, (void const *)&binaryOp<Op, VectorLhs, VectorRhs>, operand);
+    emitHelperLoop(a, {{op, VectorLhs && VectorRhs}});
+  }
+  
+  template <bool VectorMul, bool VectorAdd>
+  void emitMultiplyAdd(Assembler &a, uint32_t operand) {
+    a.emit({0x4C, 0x89, 0xE2}); // mov rdx, r12
+    emitPopping(a, (void const *)&multiplyAddOp<VectorMul, VectorAdd>, operand);
+    emitHelperLoop(a, {{MulPS, VectorMul}, {AddPS, VectorAdd}});
+  }
+  
+  template <typename Op, bool VectorRhs>
+  void emitBinaryOpInPlace(Assembler &a, PackedOp op) {
+    a.emit({0x4C, 0x89, 0xE6}); // mov rsi, r12
+    a.callHelper((void const *)&binaryOpInPlace<Op, VectorRhs>);
+    emitHelperLoop(a, {{op, VectorRhs}});
+  }
+  
+  template <bool VectorMul, bool VectorAdd>
+  void emitMultiplyAddInPlace(Assembler &a) {
+    a.emit({0x4C, 0x89, 0xE6}); // mov rsi, r12
+    a.callHelper((void const *)&multiplyAddOpInPlace<VectorMul, VectorAdd>);
+    emitHelperLoop(a, {{MulPS, VectorMul}, {AddPS, VectorAdd}});
+  }
+  
+  // Jump to an instruction whose code may not have been emitted yet, patched once all
+  // instructions have been.
+  struct JumpFixup {
+    size_t fixup;
+    uint32_t target;
+  };
+  
+  // Offsets of the shared entry and exit code emitted by `emitTrampoline`.
+  struct TrampolineLabels {
+    size_t overflow;
+    size_t invalidCall;
+    size_t undefinedTable;
+  };
+  
+  // Emit the entry point called from C++, which saves registers, sets up the evaluation
+  // state and calls the compiled function. Errors jump to a stub that unwinds the native
+  // stack to the entry point and returns a status.
+  TrampolineLabels emitTrampoline(Assembler &a) {
+    a.emit({0x55, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57}); // push rbp, rbx, r12-r15
+    a.emit({0x49, 0x89, 0xE7}); // mov r15, rsp
+    a.emit({0x48, 0x89, 0xFB}); // mov rbx, rdi
+    a.emit({0x49, 0x89, 0xD4}); // mov r12, rdx
+    a.emit({0x45, 0x31, 0xED}); // xor r13d, r13d
+    a.emit({0x45, 0x31, 0xF6}); // xor r14d, r14d
+    a.emit({0x31, 0xED});       // xor ebp, ebp
+    a.emit({0xFF, 0xD6});       // call rsi
+    a.emit({0x31, 0xC0});       // xor eax, eax
+    
+    auto done = a.offset();
+    a.emit({0x4C, 0x89, 0xFC}); // mov rsp, r15
+    a.emit({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0x5D}); // pop r15-r12, rbx, rbp
+    a.emit({0xC3});             // ret
+    
+    TrampolineLabels labels;
+    
+    labels.overflow = a.offset();
+    a.movImm32(RAX, CallStackOverflow);
+    a.jump({0xE9}, done);
+    
+    labels.invalidCall = a.offset();
+    a.movImm32(RAX, InvalidCallTarget);
+    a.jump({0xE9}, done);
+    
+    labels.undefinedTable = a.offset();
+    a.movImm32(RAX, UndefinedTable);
+    a.jump({0xE9}, done);
+    
+    return labels;
+  }
+  
+  // Emit a call to the function whose address is on top of the stack. Tail calls jump
+  // to the callee, which then returns directly to the caller's caller.
+  void emitCall(Assembler &a, TrampolineLabels const &labels, void const *const *entries, uint32_t codeSize, uint32_t operand, bool isTailCall) {
+    a.callHelper((void const *)&callTarget);
+    
+    a.emit({0x3D}); // cmp eax, imm32
+    a.emit32(codeSize);
+    a.jump({0x0F, 0x83}, labels.invalidCall); // jae
+    
+    if (!isTailCall) {
+      a.emit({0x41, 0x3B, 0x6C, 0x24, (uint8_t)offsetof(Operands, callStackSize)}); // cmp ebp, [r12 + callStackSize]
+      a.jump({0x0F, 0x83}, labels.overflow); // jae
+      a.emit({0xFF, 0xC5});                 // inc ebp
+      
+      a.emit({0x41, 0x55, 0x41, 0x56});     // push r13, r14
+      a.emit({0x48, 0x83, 0xEC, 0x08});     // sub rsp, 8
+    }
+    
+    a.movImm32(R14, operand);
+    a.emit({0x45, 0x01, 0xEE}); // add r14d, r13d
+    a.emit({0x45, 0x31, 0xED}); // xor r13d, r13d
+    a.movImm64(RCX, (uint64_t)entries);
+    
+    if (isTailCall) {
+      a.emit({0xFF, 0x24, 0xC1}); // jmp [rcx + rax * 8]
+      
+    } else {
+      a.emit({0xFF, 0x14, 0xC1});           // call [rcx + rax * 8]
+      a.emit({0x48, 0x83, 0xC4, 0x08});     // add rsp, 8
+      a.emit({0x41, 0x5E, 0x41, 0x5D});     // pop r14, r13
+      a.emit({0xFF, 0xCD});                 // dec ebp
+    }
+  }
+  
+  // Emit a table lookup, first checking that the table it reads is defined. The check
+  // leaves the operands on the stack, for the error to report the index.
+  void emitTableLookup(Assembler &a, TrampolineLabels const &labels, void const *fn, uint32_t tableCount, uint32_t operand) {
+    a.callHelper((void const *)&tableIndex);
+    
+    a.emit({0x3D}); // cmp eax, imm32
+    a.emit32(tableCount);
+    a.jump({0x0F, 0x83}, labels.undefinedTable); // jae
+    
+    emitPopping(a, fn, operand);
+  }
+  
+  // Emit code for an instruction. Returns false if the JIT can't compile it.
+  bool emitInstruction(Assembler &a, TrampolineLabels const &labels, Package const *package, void const *const *entries, std::vector<JumpFixup> *jumps, uint32_t instPtr) {
+    auto inst = package->code[instPtr];
+    auto operand = inst.operand.u32;
+    auto tableCount = (uint32_t)package->tables.size();
+    
+    switch (inst.operation) {
+      case Instruction::PUSH:
+        a.movImm32(RSI, operand);
+        a.callHelper((void const *)&push);
+        return true;
+        
+      case Instruction::COPY:
+        a.movImm32(RSI, operand);
+        a.callHelper((void const *)&copy);
+        return true;
+        
+      case Instruction::REF_VEC:
+        a.movImm32(RSI, operand);
+        a.callHelper((void const *)&referenceVector);
+        return true;
+        
+      case Instruction::DROP_S:
+        emitPopping(a, (void const *)&dropScalar<VMState>, operand);
+        return true;
+        
+      case Instruction::DROP_V:
+        emitPopping(a, (void const *)&dropVector<VMState>, operand);
+        return true;
+        
+      case Instruction::FILL:
+        a.callHelper((void const *)&fill<VMState>);
+        return true;
+        
+      case Instruction::ADD_VV: emitBinaryOp<Add, true, true>(a, AddPS, operand); return true;
+      case Instruction::ADD_VS: emitBinaryOp<Add, true, false>(a, AddPS, operand); return true;
+      case Instruction::ADD_SV: emitBinaryOp<Add, false, true>(a, AddPS, operand); return true;
+      case Instruction::ADD_SS: emitPopping(a, (void const *)&scalarScalarOp<Add>, operand); return true;
+      
+      case Instruction::MUL_VV: emitBinaryOp<Multiply, true, true>(a, MulPS, operand); return true;
+      case Instruction::MUL_VS: emitBinaryOp<Multiply, true, false>(a, MulPS, operand); return true;
+      case Instruction::MUL_SV: emitBinaryOp<Multiply, false, true>(a, MulPS, operand); return true;
+      case Instruction::MUL_SS: emitPopping(a, (void const *)&scalarScalarOp<Multiply>, operand); return true;
+      
+      case Instruction::FMA_VVV: emitMultiplyAdd<true, true>(a, operand); return true;
+      case Instruction::FMA_VSV: emitMultiplyAdd<false, true>(a, operand); return true;
+      case Instruction::FMA_VVS: emitMultiplyAdd<true, false>(a, operand); return true;
+      case Instruction::FMA_VSS: emitMultiplyAdd<false, false>(a, operand); return true;
+      
+#define UNARY_MATH_OP(OPCODE, OPERATION) \
+case Instruction::OPCODE##_V: emitPopping(a, (void const *)&unaryMathOp<OPERATION, true>, operand); return true; \
+case Instruction::OPCODE##_S: emitPopping(a, (void const *)&unaryMathOp<OPERATION, false>, operand); return true;
+
+#define BINARY_MATH_OP(OPCODE, OPERATION) \
+case Instruction::OPCODE##_VV: emitPopping(a, (void const *)&binaryMathOp<OPERATION, true, true>, operand); return true; \
+case Instruction::OPCODE##_VS: emitPopping(a, (void const *)&binaryMathOp<OPERATION, true, false>, operand); return true; \
+case Instruction::OPCODE##_SV: emitPopping(a, (void const *)&binaryMathOp<OPERATION, false, true>, operand); return true; \
+case Instruction::OPCODE##_SS: emitPopping(a, (void const *)&binaryMathOp<OPERATION, false, false>, operand); return true;
+      
+      UNARY_MATH_OP(SIN, Sin<Accuracy::Precise>)
+      UNARY_MATH_OP(COS, Cos<Accuracy::Precise>)
+      UNARY_MATH_OP(EXP, Exp<Accuracy::Precise>)
+      UNARY_MATH_OP(LOG, Log<Accuracy::Precise>)
+      UNARY_MATH_OP(TANH, Tanh<Accuracy::Precise>)
+      BINARY_MATH_OP(POW, Pow<Accuracy::Precise>)
+      
+      UNARY_MATH_OP(FAST_SIN, Sin<Accuracy::Fast>)
+      UNARY_MATH_OP(FAST_COS, Cos<Accuracy::Fast>)
+      UNARY_MATH_OP(FAST_EXP, Exp<Accuracy::Fast>)
+      UNARY_MATH_OP(FAST_LOG, Log<Accuracy::Fast>)
+      UNARY_MATH_OP(FAST_TANH, Tanh<Accuracy::Fast>)
+      BINARY_MATH_OP(FAST_POW, Pow<Accuracy::Fast>)
+      
+      BINARY_MATH_OP(NOISE, Noise<false>)
+      BINARY_MATH_OP(NOISE_BIPOLAR, Noise<true>)
+      
+      BINARY_MATH_OP(MIN, Min)
+      BINARY_MATH_OP(MAX, Max)
+      BINARY_MATH_OP(CLIP, Clip)
+      UNARY_MATH_OP(ABS, Abs)
+      
+      case Instruction::SELECT_VVV: emitPopping(a, (void const *)&selectMathOp<true, true>, operand); return true;
+      case Instruction::SELECT_VSV: emitPopping(a, (void const *)&selectMathOp<false, true>, operand); return true;
+      case Instruction::SELECT_VVS: emitPopping(a, (void const *)&selectMathOp<true, false>, operand); return true;
+      case Instruction::SELECT_VSS: emitPopping(a, (void const *)&selectMathOp<false, false>, operand); return true;
+      case Instruction::SELECT_SSS: emitPopping(a, (void const *)&scalarSelectMathOp, operand); return true;
+      
+#define TABLE_LOOKUP_OP(OPCODE, OPERATION) \
+case Instruction::OPCODE##_V: emitTableLookup(a, labels, (void const *)&tableLookupOp<OPERATION, true>, tableCount, operand); return true; \
+case Instruction::OPCODE##_S: emitTableLookup(a, labels, (void const *)&tableLookupOp<OPERATION, false>, tableCount, operand); return true;
+      
+      TABLE_LOOKUP_OP(TABLE_NEAREST, TableLookup<Interpolation::Nearest>)
+      TABLE_LOOKUP_OP(TABLE_LINEAR, TableLookup<Interpolation::Linear>)
+      TABLE_LOOKUP_OP(TABLE_CUBIC, TableLookup<Interpolation::Cubic>)
+      
+#undef TABLE_LOOKUP_OP
+#undef UNARY_MATH_OP
+#undef BINARY_MATH_OP
+      
+      case Instruction::ADD_VV_INPLACE: emitBinaryOpInPlace<Add, true>(a, AddPS); return true;
+      case Instruction::ADD_VS_INPLACE: emitBinaryOpInPlace<Add, false>(a, AddPS); return true;
+      case Instruction::MUL_VV_INPLACE: emitBinaryOpInPlace<Multiply, true>(a, MulPS); return true;
+      case Instruction::MUL_VS_INPLACE: emitBinaryOpInPlace<Multiply, false>(a, MulPS); return true;
+      case Instruction::FMA_VVV_INPLACE: emitMultiplyAddInPlace<true, true>(a); return true;
+      case Instruction::FMA_VSV_INPLACE: emitMultiplyAddInPlace<false, true>(a); return true;
+      case Instruction::FMA_VVS_INPLACE: emitMultiplyAddInPlace<true, false>(a); return true;
+      case Instruction::FMA_VSS_INPLACE: emitMultiplyAddInPlace<false, false>(a); return true;
+      
+      case Instruction::JUMP:
+        jumps->push_back({a.jump({0xE9}), instPtr + operand}); // jmp
+        return true;
+        
+      case Instruction::JUMP_ALL_TRUE:
+      case Instruction::JUMP_ALL_FALSE: {
+        auto allTrue = inst.operation == Instruction::JUMP_ALL_TRUE;
+        a.callHelper(allTrue ? (void const *)&jumpCondition<true> : (void const *)&jumpCondition<false>);
+        
+        a.emit({0x84, 0xC0}); // test al, al
+        jumps->push_back({a.jump({0x0F, 0x85}), instPtr + operand}); // jnz
+        return true;
+      }
+      
+      case Instruction::CALL: {
+        auto isTailCall = instPtr + 1 < package->code.size()
+        && package->code[instPtr + 1].operation == Instruction::EXIT;
+        
+        emitCall(a, labels, entries, (uint32_t)package->code.size(), operand, isTailCall);
+        return true;
+      }
+      
+      case Instruction::RET:
+        a.emit({0x45, 0x89, 0xF5}); // mov r13d, r14d
+        return true;
+        
+      case Instruction::EXIT:
+        a.emit({0xC3}); // ret
+        return true;
+        
+      // Linked packages contain no symbol references.
+      case Instruction::PUSH_SYM:
+        return false;
+    }
+    
+    return false;
+  }
+}
+
+namespace vm {
+  namespace jit {
+    // True if vector instructions should use AVX. Follows the active kernels, so that
+    // overriding them (see VMKernels.hpp) also narrows compiled code.
+    bool useAvx() {
+#ifdef TEMPO_JIT
+      auto kernels = kernels::active().name;
+      return strcmp(kernels, "generic") != 0 && strcmp(kernels, "sse2") != 0;
+#else
+      return false;
+#endif
+    }
+    
+    bool isHostSupported() {
+#ifdef TEMPO_JIT
+      return true;
+#else
+      return false;
+#endif
+    }
+    
+    std::unique_ptr<Program> compile(Package const *package) {
+      if (!isHostSupported()) {
+        return nullptr;
+      }
+      
+      std::unique_ptr<Program> program(new Program());
+      program->entries.resize(package->code.size());
+      
+      // Compiled calls read their targets from `entries`, which is filled in once the
+      // code's final address is known.
+      Assembler a;
+      
+      a.avx = useAvx();
+      
+      auto labels = emitTrampoline(a);
+      
+      std::vector<size_t> offsets;
+      offsets.reserve(package->code.size());
+      
+      std::vector<JumpFixup> jumps;
+      
+      for (uint32_t instPtr = 0; instPtr < package->code.size(); ++instPtr) {
+        offsets.push_back(a.offset());
+        
+        if (!emitInstruction(a, labels, package, program->entries.data(), &jumps, instPtr)) {
+          return nullptr;
+        }
+      }
+      
+      for (auto jump : jumps) {
+        if (jump.target >= offsets.size()) {
+          return nullptr;
+        }
+        
+        a.patch(jump.fixup, offsets[jump.target]);
+      }
+      
+      // Map the code writable, then swap to executable so that it is never both.
+      size_t pageSize = sysconf(_SC_PAGESIZE);
+      auto size = (a.code.size() + pageSize - 1) / pageSize * pageSize;
+      
+      auto memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (memory == MAP_FAILED) {
+        return nullptr;
+      }
+      
+      program->memory = memory;
+      program->memorySize = size;
+      
+      memcpy(memory, a.code.data(), a.code.size());
+      
+      if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        return nullptr;
+      }
+      
+      for (size_t i = 0; i < offsets.size(); ++i) {
+        program->entries[i] = (uint8_t const *)memory + offsets[i];
+      }
+      
+      return program;
+    }
+    
+    Program::~Program() {
+      if (memory) {
+        munmap(memory, memorySize);
+      }
+    }
+    
+    void Program::run(VMState *vm, uint32_t instPtr, uint32_t callStackSize) const {
+      Operands operands;
+      operands.callStackSize = callStackSize;
+      
+      auto trampoline = (Trampoline)memory;
+      auto status = trampoline(vm, entries[instPtr], &operands);
+      
+      switch (status) {
+        case Finished:
+          return;
+          
+        case CallStackOverflow: {
+          auto err = std::stringstream() << "Call stack overflow (depth: " << callStackSize << ")";
+          throw std::runtime_error(err.str());
+        }
+        
+        case InvalidCallTarget:
+          throw std::runtime_error("Invalid call target");
+          
+        case UndefinedTable: {
+          auto err = std::stringstream() << "Undefined table (index: " << tableIndex(vm) << ")";
+          throw std::runtime_error(err.str());
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vm {
+  struct Package;
+  
+  template <bool Checked>
+  class BasicVMState;
+  
+  typedef BasicVMState<true> VMState;
+  
+  namespace jit {
+    /**
+     Native Code Generation
+     
+     Translates a linked package's bytecode into x86-64 machine code, so that rendering
+     pays no per-instruction dispatch cost. Vector arithmetic is emitted as inline SSE
+     loops, while stack bookkeeping calls back into the same VMState operations that the
+     interpreter uses. Each sample is computed with the same single-precision operations
+     in the same order as the kernels, so results are bit-identical to the interpreter.
+     
+     Calls use the native stack rather than the VM's call stack, but are limited to the
+     same depth. Code is written to anonymous pages which are then made executable, so
+     hosts that forbid this fall back to the interpreter, as do other architectures and
+     packages using opcodes the JIT can't compile.
+     */
+    
+    // Native code compiled from a package.
+    class Program {
+    public:
+      ~Program();
+      
+      Program(Program const &) = delete;
+      Program &operator=(Program const &) = delete;
+      
+      // Evaluate the function at `instPtr` against `vm`.
+      //
+      // Throws if calls nest deeper than `callStackSize`, or a call targets an address
+      // outside the package's code.
+      void run(VMState *vm, uint32_t instPtr, uint32_t callStackSize) const;
+      
+    private:
+      friend std::unique_ptr<Program> compile(Package const *package);
+      
+      Program() {}
+      
+      // Executable mapping holding all compiled code.
+      void *memory = nullptr;
+      size_t memorySize = 0;
+      
+      // Native address of each instruction, indexed by instruction pointer.
+      std::vector<void const *> entries;
+    };
+    
+    // True if the host can run compiled code.
+    bool isHostSupported();
+    
+    // Compile a linked package. Returns null if the host isn't supported or the package
+    // contains an opcode the JIT can't compile.
+    std::unique_ptr<Program> compile(Package const *package);
+  }
+}
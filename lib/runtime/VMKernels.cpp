@@ -0,0 +1,1240 @@
+#include "VMKernels.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#define ALWAYS_INLINE __attribute__((always_inline)) inline
+
+namespace {
+  using namespace vm::kernels;
+  
+  // # samples in a 64-byte cache line. Matches VectorStackSlot::SampleCount.
+  size_t const LineSamples = 64 / sizeof(float);
+  
+  // Vector extension type holding `Width` floats.
+  //
+  // Operations on these types compile to instructions of whatever width the enclosing
+  // function's target supports, which lets one loop body serve every instruction set.
+  template <size_t Width>
+  struct Lanes {
+    typedef float type __attribute__((vector_size(Width * sizeof(float))));
+    
+    // The same # lanes holding 32-bit integers, doubles, and 64-bit integers, used by
+    // the math functions to manipulate floats' bits and compute in double precision.
+    // Unsigned integers are used where arithmetic should wrap, as when hashing.
+    typedef int32_t intType __attribute__((vector_size(Width * sizeof(int32_t))));
+    typedef uint32_t uintType __attribute__((vector_size(Width * sizeof(uint32_t))));
+    typedef double doubleType __attribute__((vector_size(Width * sizeof(double))));
+    typedef int64_t longType __attribute__((vector_size(Width * sizeof(int64_t))));
+  };
+  
+  // A single lane is a plain scalar, so that the math functions also serve the samples
+  // remaining after a loop's last cache line.
+  template <>
+  struct Lanes<1> {
+    typedef float type;
+    typedef int32_t intType;
+    typedef uint32_t uintType;
+    typedef double doubleType;
+    typedef int64_t longType;
+  };
+  
+  
+  /** Element-wise operations, applicable to both floats and lane vectors **/
+  
+  struct AddOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &lhs, T const &rhs, T *output) const {
+      *output = lhs + rhs;
+    }
+  };
+  
+  struct MulOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &lhs, T const &rhs, T *output) const {
+      *output = lhs * rhs;
+    }
+  };
+  
+  
+  /** Transcendental functions, applicable to both floats and lane vectors **/
+  
+  // Each function comes in two accuracy tiers (see VMOps.hpp), selected by `Precise`.
+  // Both are branch-free, computing every candidate result and selecting between them
+  // per lane, except for a slower path reducing huge operands to precise sin and cos.
+  // Lanes round after every operation exactly as scalars do, so each sample's result is
+  // the same whatever the width of the kernel computing it.
+  //
+  // Precise polynomials are minimax approximations from Cephes. Fast polynomials are
+  // shorter fits to the same ranges, and fast functions skip special cases, so their
+  // results are unspecified for infinite, NaN or subnormal operands, and outside their
+  // domain. Neither tier relies on undefined behaviour for any operand.
+  namespace math {
+    // Integer and double lanes matching float lanes `T`, and integer lanes matching
+    // double lanes `D`.
+    template <typename T>
+    using IntLanes = typename Lanes<sizeof(T) / sizeof(float)>::intType;
+    
+    template <typename T>
+    using DoubleLanes = typename Lanes<sizeof(T) / sizeof(float)>::doubleType;
+    
+    template <typename D>
+    using LongLanes = typename Lanes<sizeof(D) / sizeof(double)>::longType;
+    
+    float const Infinity = __builtin_huge_valf();
+    float const NaN = __builtin_nanf("");
+    
+    template <typename To, typename From>
+    ALWAYS_INLINE To bitCast(From const &value) {
+      static_assert(sizeof(To) == sizeof(From), "Bit casts should preserve size");
+      
+      To result;
+      __builtin_memcpy(&result, &value, sizeof(To));
+      return result;
+    }
+    
+    // Convert each lane to another element type, rounding to nearest.
+    template <typename To, typename From>
+    ALWAYS_INLINE To convert(From const &value, std::true_type isScalar) {
+      return (To)value;
+    }
+    
+    template <typename To, typename From>
+    ALWAYS_INLINE To convert(From const &value, std::false_type isScalar) {
+      return __builtin_convertvector(value, To);
+    }
+    
+    template <typename To, typename From>
+    ALWAYS_INLINE To convert(From const &value) {
+      return convert<To>(value, std::is_arithmetic<From>());
+    }
+    
+    // Round to the nearest integer (ties to even) by adding and subtracting 1.5 * 2^23,
+    // returning the integer both as a float and in `integer`. Requires |value| < 2^22.
+    template <typename T>
+    ALWAYS_INLINE T roundToInt(T value, IntLanes<T> *integer) {
+      T shifted = value + 12582912.0f;
+      *integer = bitCast<IntLanes<T>>(shifted) - 0x4B400000;
+      
+      return shifted - 12582912.0f;
+    }
+    
+    // Convert integers with magnitude below 2^22 to floats, as `roundToInt` in reverse.
+    template <typename T>
+    ALWAYS_INLINE T intToFloat(IntLanes<T> integer) {
+      return bitCast<T>(integer + 0x4B400000) - 12582912.0f;
+    }
+    
+    // Multiply by 2^n, for -150 <= n <= 128. Scales in two steps by normal powers of two,
+    // the first of which is exact, so the result rounds once even when it's subnormal.
+    template <typename T>
+    ALWAYS_INLINE T scaleByPowerOf2(T value, IntLanes<T> n) {
+      auto half = n >> 1;
+      return value * bitCast<T>((half + 127) << 23) * bitCast<T>((n - half + 127) << 23);
+    }
+    
+    // e^x. Precise within 1 ulp, fast within 1.3e-4 (relative).
+    template <bool Precise, typename T>
+    ALWAYS_INLINE T exp(T x) {
+      // Clamp to where results overflow or underflow, taking NaN to a finite value so
+      // that the integer arithmetic stays in range.
+      T clamped = x < 89.0f ? x : 89.0f;
+      clamped = clamped > -104.0f ? clamped : -104.0f;
+      
+      // x = n * ln(2) + r, with |r| <= ln(2) / 2. The high part of ln(2) has few enough
+      // bits that its product with n is exact.
+      IntLanes<T> n;
+      T nf = roundToInt(clamped * 1.44269504088896341f, &n);
+      T r = clamped - nf * 0.693359375f;
+      r = r + nf * 2.12194440e-4f;
+      
+      T p;
+      if (Precise) {
+        p = 1.9875691500e-4f * r + 1.3981999507e-3f;
+        p = p * r + 8.3334519073e-3f;
+        p = p * r + 4.1665795894e-2f;
+        p = p * r + 1.6666665459e-1f;
+        p = p * r + 5.0000001201e-1f;
+        
+      } else {
+        p = 0.167086029f * r + 0.504140183f;
+      }
+      
+      T result = scaleByPowerOf2(p * (r * r) + r + 1.0f, n);
+      return Precise ? (x == x ? result : x) : result;
+    }
+    
+    // Natural logarithm. Precise within 1 ulp, fast within 5e-6 (absolute).
+    template <bool Precise, typename T>
+    ALWAYS_INLINE T log(T x) {
+      typedef IntLanes<T> Int;
+      
+      if (!Precise) {
+        // x = m * 2^e with sqrt(1/2) <= m < sqrt(2), then ln(m) = 2 atanh(s).
+        Int bits = bitCast<Int>(x);
+        Int e = (bits >> 23) - 127;
+        T m = bitCast<T>((bits & 0x007FFFFF) | 0x3F800000);
+        
+        auto high = m > 1.41421356237309505f;
+        e = high ? e + 1 : e;
+        m = high ? m * 0.5f : m;
+        
+        T s = (m - 1.0f) / (m + 1.0f);
+        return s * (0.681717870f * (s * s) + 1.99988841f) + intToFloat<T>(e) * 0.693147180559945309f;
+      }
+      
+      // Scale subnormals into the normal range, compensating in the exponent.
+      auto subnormal = x < 1.17549435e-38f;
+      Int bits = bitCast<Int>(subnormal ? x * 8388608.0f : x);
+      
+      // x = (1 + m) * 2^e with sqrt(1/2) <= 1 + m < sqrt(2).
+      Int e = (bits >> 23) - (subnormal ? 149 : 126);
+      T m = bitCast<T>((bits & 0x007FFFFF) | 0x3F000000);
+      
+      auto low = m < 0.707106781186547524f;
+      e = low ? e - 1 : e;
+      m = low ? m + m - 1.0f : m - 1.0f;
+      
+      T z = m * m;
+      T y = 7.0376836292e-2f * m - 1.1514610310e-1f;
+      y = y * m + 1.1676998740e-1f;
+      y = y * m - 1.2420140846e-1f;
+      y = y * m + 1.4249322787e-1f;
+      y = y * m - 1.6668057665e-1f;
+      y = y * m + 2.0000714765e-1f;
+      y = y * m - 2.4999993993e-1f;
+      y = y * m + 3.3333331174e-1f;
+      y = y * m * z;
+      
+      // Add e * ln(2) in two parts, as for exp.
+      T ef = intToFloat<T>(e);
+      y = y - ef * 2.12194440e-4f;
+      y = y - 0.5f * z;
+      
+      T result = m + y + ef * 0.693359375f;
+      
+      result = x < Infinity ? result : x;
+      return x > 0.0f ? result : (x == 0.0f ? -Infinity : NaN);
+    }
+    
+    // Bits of 2 / pi, most significant first, preceded by a word of zeros (its integer
+    // part, and so on) so that reductions of small operands read zeros above it.
+    uint32_t const TwoOverPi[] = {
+      0x00000000,
+      0xA2F9836E, 0x4E441529, 0xFC2757D1, 0xF534DDC0, 0xDB629599, 0x3C439041, 0xFE5163AB
+    };
+    
+    // Reduce a finite float of any magnitude to x = q * pi / 2 + r, with |r| <= pi / 4,
+    // returning r and the quadrant (q mod 4).
+    //
+    // x = m * 2^e for an integer m of 24 bits, so bits of 2 / pi worth 4 or more in the
+    // product x * 2 / pi only add multiples of 4 to q, and are skipped. The 96 bits
+    // following them give the quadrant and r exactly enough for a float result.
+    inline double reduceLarge(float x, int32_t *quadrant) {
+      uint32_t bits;
+      memcpy(&bits, &x, sizeof(bits));
+      
+      int32_t e = int32_t((bits >> 23) & 0xFF) - 150;
+      uint64_t m = (bits & 0x007FFFFF) | 0x00800000;
+      
+      // Bit k of 2 / pi (the first fractional bit being 1) is worth 2^(e - k) in the
+      // product, so start from the bit worth 2, at index e + 30 in the table. Operands
+      // of 6e6 or more have -1 <= e <= 104, so the window lies within the table.
+      uint32_t start = uint32_t(e + 30);
+      uint32_t word = start / 32;
+      uint32_t shift = start % 32;
+      
+      unsigned __int128 window = 0;
+      for (uint32_t i = 0; i < 4; ++i) {
+        window = (window << 32) | TwoOverPi[word + i];
+      }
+      
+      // Each unit of the product is worth 2^-94, and the product is taken mod 4.
+      window = (window << shift) >> 32;
+      unsigned __int128 product = (window * m) & ((((unsigned __int128)1) << 96) - 1);
+      
+      // Round to the nearest quadrant, leaving a remainder of units worth 2^-126, which
+      // wraps to a signed value within half a quadrant.
+      uint32_t q = uint32_t((product + (((unsigned __int128)1) << 93)) >> 94);
+      auto remainder = (__int128)((product << 32) - ((unsigned __int128)q << 126));
+      
+      // Convert the remainder's top 64 bits (units worth 2^-62) from quadrants to radians.
+      // Negative operands reduce as their magnitude does, negated.
+      double r = double(int64_t(remainder >> 64)) * 3.40612158008655459e-19;
+      bool negative = (bits >> 31) != 0;
+      
+      *quadrant = int32_t((negative ? 0 - q : q) & 3);
+      return negative ? -r : r;
+    }
+    
+    // True if every lane of a comparison's result is set.
+    template <typename T, typename Mask>
+    ALWAYS_INLINE bool allLanes(Mask const &mask) {
+      int32_t lanes[sizeof(T) / sizeof(float)];
+      static_assert(sizeof(Mask) == sizeof(lanes), "Masks should have a 32-bit integer per lane");
+      
+      memcpy(lanes, &mask, sizeof(lanes));
+      
+      int32_t all = -1;
+      for (size_t i = 0; i < sizeof(T) / sizeof(float); ++i) {
+        all &= lanes[i];
+      }
+      
+      return all != 0;
+    }
+    
+    // sin(x + quadrant * pi / 2). Precise within 1.6 ulp for every finite x, reducing
+    // finite operands of magnitude 6e6 or more one lane at a time. Fast
+    // within 1.3e-5 (absolute) for |x| < 1e5, beyond which its error grows, and results
+    // for |x| >= 6e6 are unspecified.
+    template <bool Precise, typename T>
+    ALWAYS_INLINE T sinQuadrant(T x, int32_t quadrant) {
+      auto inRange = (x < 6.0e6f) & (x > -6.0e6f);
+      T clamped = inRange ? x : 0.0f;
+      
+      // x = q * pi / 2 + r, with |r| <= pi / 4, subtracting pi / 2 in parts whose high
+      // parts have few enough bits that their products with q are exact.
+      IntLanes<T> q;
+      T r;
+      
+      if (Precise) {
+        // Reduce in double precision, so that results near multiples of pi stay accurate,
+        // and q is the nearest quadrant even where x * 2 / pi rounds poorly as a float.
+        // The first two parts have 31 bits, and |q| < 2^22.
+        typedef DoubleLanes<T> D;
+        typedef LongLanes<D> Long;
+        
+        D xd = convert<D>(clamped);
+        D shifted = xd * 0.636619772367581343 + 6755399441055744.0;
+        D qd = shifted - 6755399441055744.0;
+        q = convert<IntLanes<T>>(bitCast<Long>(shifted) - 0x4338000000000000);
+        
+        D rd = xd - qd * 1.57079632673412561417;
+        rd = rd - qd * 6.07710050359346498e-11;
+        rd = rd - qd * 2.91273205609335598e-20;
+        r = convert<T>(rd);
+        
+        // Larger operands are rare, so are reduced exactly on a slower path.
+        if (!allLanes<T>(inRange)) {
+          float lanes[sizeof(T) / sizeof(float)], reduced[sizeof(T) / sizeof(float)];
+          int32_t quadrants[sizeof(T) / sizeof(float)];
+          
+          memcpy(lanes, &x, sizeof(T));
+          memcpy(reduced, &r, sizeof(T));
+          memcpy(quadrants, &q, sizeof(T));
+          
+          for (size_t i = 0; i < sizeof(T) / sizeof(float); ++i) {
+            if (!(lanes[i] < 6.0e6f && lanes[i] > -6.0e6f) && lanes[i] - lanes[i] == 0.0f) {
+              reduced[i] = (float)reduceLarge(lanes[i], &quadrants[i]);
+            }
+          }
+          
+          memcpy(&r, reduced, sizeof(T));
+          memcpy(&q, quadrants, sizeof(T));
+        }
+        
+      } else {
+        T qf = roundToInt(clamped * 0.636619772367581343f, &q);
+        r = clamped - qf * 1.5703125f;
+        r = r - qf * 4.83826794e-4f;
+      }
+      
+      q = q + quadrant;
+      
+      T z = r * r;
+      T sine, cosine;
+      
+      if (Precise) {
+        sine = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * r + r;
+        cosine = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+        
+      } else {
+        sine = (8.15158945e-3f * z - 0.166627561f) * z * r + r;
+        cosine = (4.04819928e-2f * z - 0.499772580f) * z + 1.0f;
+      }
+      
+      T result = (q & 1) != 0 ? cosine : sine;
+      result = (q & 2) != 0 ? -result : result;
+      
+      // Only infinite and NaN operands don't give zero when subtracted from themselves,
+      // and their results are NaN.
+      return Precise ? (x - x == 0.0f ? result : NaN) : result;
+    }
+    
+    template <bool Precise, typename T>
+    ALWAYS_INLINE T sin(T x) {
+      // The polynomial takes -0 to +0, where sin(-0) is -0.
+      T result = sinQuadrant<Precise>(x, 0);
+      return Precise ? (x == 0.0f ? x : result) : result;
+    }
+    
+    template <bool Precise, typename T>
+    ALWAYS_INLINE T cos(T x) {
+      return sinQuadrant<Precise>(x, 1);
+    }
+    
+    // Hyperbolic tangent. Precise within 2 ulp, fast within 1e-4 (absolute).
+    template <bool Precise, typename T>
+    ALWAYS_INLINE T tanh(T x) {
+      // tanh(|x|) = 1 - 2 / (e^2|x| + 1), which loses precision approaching zero.
+      T magnitude = x < 0.0f ? -x : x;
+      T result = 1.0f - 2.0f / (exp<Precise>(magnitude + magnitude) + 1.0f);
+      result = x < 0.0f ? -result : result;
+      
+      if (!Precise) {
+        return result;
+      }
+      
+      T z = x * x;
+      T y = -5.70498872745e-3f * z + 2.06390887954e-2f;
+      y = y * z - 5.37397155531e-2f;
+      y = y * z + 1.33314422036e-1f;
+      y = y * z - 3.33332819422e-1f;
+      y = y * z * x + x;
+      
+      return magnitude < 0.625f ? y : result;
+    }
+    
+    // Natural logarithm of positive, finite, normal doubles, within 2e-14 (relative).
+    template <typename D>
+    ALWAYS_INLINE D logDouble(D x) {
+      typedef LongLanes<D> Long;
+      
+      // x = m * 2^e with sqrt(1/2) <= m < sqrt(2), then ln(m) = 2 atanh(s).
+      Long bits = bitCast<Long>(x);
+      Long e = (bits >> 52) - 1023;
+      D m = bitCast<D>((bits & 0x000FFFFFFFFFFFFF) | 0x3FF0000000000000);
+      
+      auto high = m > 1.41421356237309505;
+      e = high ? e + 1 : e;
+      m = high ? m * 0.5 : m;
+      
+      D s = (m - 1.0) / (m + 1.0);
+      D s2 = s * s;
+      
+      D p = 2.0 / 15 * s2 + 2.0 / 13;
+      p = p * s2 + 2.0 / 11;
+      p = p * s2 + 2.0 / 9;
+      p = p * s2 + 2.0 / 7;
+      p = p * s2 + 2.0 / 5;
+      p = p * s2 + 2.0 / 3;
+      p = p * s2 + 2.0;
+      
+      D ef = bitCast<D>(e + 0x4338000000000000) - 6755399441055744.0;
+      return p * s + ef * 0.693147180559945309;
+    }
+    
+    // e^x for doubles, within 1e-14 (relative).
+    template <typename D>
+    ALWAYS_INLINE D expDouble(D x) {
+      typedef LongLanes<D> Long;
+      
+      D clamped = x < 1100.0 ? x : 1100.0;
+      clamped = clamped > -1100.0 ? clamped : -1100.0;
+      
+      // x = n * ln(2) + r as for floats, rounding by adding and subtracting 1.5 * 2^52.
+      D shifted = clamped * 1.44269504088896341 + 6755399441055744.0;
+      Long n = bitCast<Long>(shifted) - 0x4338000000000000;
+      D nf = shifted - 6755399441055744.0;
+      
+      D r = clamped - nf * 6.93147180369123816490e-01;
+      r = r - nf * 1.90821492927058770002e-10;
+      
+      // Taylor series, whose terms beyond r^11 / 11! are below 1e-14.
+      D p = 1.0 / 39916800 * r + 1.0 / 3628800;
+      p = p * r + 1.0 / 362880;
+      p = p * r + 1.0 / 40320;
+      p = p * r + 1.0 / 5040;
+      p = p * r + 1.0 / 720;
+      p = p * r + 1.0 / 120;
+      p = p * r + 1.0 / 24;
+      p = p * r + 1.0 / 6;
+      p = p * r + 0.5;
+      p = p * r + 1.0;
+      p = p * r + 1.0;
+      
+      // Scale by 2^n in two steps, as for floats.
+      auto half = n >> 1;
+      return p * bitCast<D>((half + 1023) << 52) * bitCast<D>((n - half + 1023) << 52);
+    }
+    
+    // x^y. Precise within 1 ulp, following C's pow for special operands, except that
+    // negative zero bases are treated as positive. Fast computes e^(y ln(x)) with the
+    // fast functions, so is only defined for positive x, and has relative error within
+    // 1.3e-4 + |y ln(x)| * 5e-6.
+    template <bool Precise, typename T>
+    ALWAYS_INLINE T pow(T x, T y) {
+      if (!Precise) {
+        return exp<false>(y * log<false>(x));
+      }
+      
+      // Compute in double precision, so that the error of ln(x) isn't magnified by y.
+      typedef DoubleLanes<T> D;
+      typedef LongLanes<D> Long;
+      
+      D xd = convert<D>(x);
+      D yd = convert<D>(y);
+      D magnitude = xd < 0.0 ? -xd : xd;
+      
+      D lnx = logDouble(magnitude);
+      lnx = magnitude == 0.0 ? -(double)Infinity : lnx;
+      lnx = magnitude == (double)Infinity ? (double)Infinity : lnx;
+      
+      // y ln(x) is only NaN (for non-NaN operands) where it's zero times infinity, as
+      // for 1^inf, and those powers are all 1.
+      D t = yd * lnx;
+      D result = expDouble(t);
+      result = t == t ? result : 1.0;
+      
+      // Negative bases have real powers only for integer exponents, which are odd if their
+      // last bit is set. Floats of magnitude 2^24 or more are all even integers.
+      D exponent = (yd < 16777216.0) & (yd > -16777216.0) ? yd : 0.0;
+      D shifted = exponent + 6755399441055744.0;
+      Long integer = bitCast<Long>(shifted) - 0x4338000000000000;
+      
+      auto isInteger = shifted - 6755399441055744.0 == exponent;
+      D negative = (integer & 1) != 0 ? -result : result;
+      result = xd < 0.0 ? (isInteger ? negative : (double)NaN) : result;
+      
+      result = (xd == xd) & (yd == yd) ? result : (double)NaN;
+      result = (yd == 0.0) | (xd == 1.0) ? 1.0 : result;
+      
+      return convert<T>(result);
+    }
+  }
+  
+  template <bool Precise>
+  struct SinOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &input, T *output) const {
+      *output = math::sin<Precise>(input);
+    }
+  };
+  
+  template <bool Precise>
+  struct CosOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &input, T *output) const {
+      *output = math::cos<Precise>(input);
+    }
+  };
+  
+  template <bool Precise>
+  struct ExpOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &input, T *output) const {
+      *output = math::exp<Precise>(input);
+    }
+  };
+  
+  template <bool Precise>
+  struct LogOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &input, T *output) const {
+      *output = math::log<Precise>(input);
+    }
+  };
+  
+  template <bool Precise>
+  struct TanhOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &input, T *output) const {
+      *output = math::tanh<Precise>(input);
+    }
+  };
+  
+  template <bool Precise>
+  struct PowOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &lhs, T const &rhs, T *output) const {
+      *output = math::pow<Precise>(lhs, rhs);
+    }
+  };
+  
+  
+  /** Noise, applicable to both floats and lane vectors **/
+  
+  // Hash each time sample with a seed to a uniformly distributed value in [0, 1), or in
+  // [-1, 1) if `Bipolar`. The hash only sees the bits of the time and seed, so noise is
+  // the same for the same time however blocks are split, and matches between kernels.
+  template <bool Bipolar>
+  struct NoiseOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &time, T const &seed, T *output) const {
+      typedef typename Lanes<sizeof(T) / sizeof(float)>::uintType Bits;
+      
+      // Adding zero takes -0 to +0, so that both zeros give the same noise. The seed is
+      // offset and spread by the golden ratio, so that nearby seeds give unrelated
+      // sequences and time zero isn't hashed to zero (a fixed point of the finalizer).
+      Bits key = (math::bitCast<Bits>(seed + 0.0f) + 1u) * 0x9E3779B9u;
+      Bits h = math::bitCast<Bits>(time + 0.0f) ^ key;
+      
+      // Finalizer from Chris Wellons' "lowbias32", a bijection whose output bits each
+      // depend on every input bit.
+      h ^= h >> 16;
+      h *= 0x7FEB352Du;
+      h ^= h >> 15;
+      h *= 0x846CA68Bu;
+      h ^= h >> 16;
+      
+      // Fill the mantissa of a float in [1, 2) (or [2, 4)) with the top bits of the hash,
+      // then shift the range exactly.
+      if (Bipolar) {
+        *output = math::bitCast<T>((h >> 9) | 0x40000000u) - 3.0f;
+      
+      } else {
+        *output = math::bitCast<T>((h >> 9) | 0x3F800000u) - 1.0f;
+      }
+    }
+  };
+  
+  // Binary operation with its operands swapped, so that loops over a vector and a scalar
+  // serve operations that don't commute.
+  template <typename Op>
+  struct Reversed {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &lhs, T const &rhs, T *output) const {
+      Op()(rhs, lhs, output);
+    }
+  };
+  
+  
+  /** Clamping and selection, applicable to both floats and lane vectors **/
+  
+  // Comparisons select per lane rather than branch, compiling to min/max and blend
+  // instructions. Where an operand is NaN, the lhs is kept.
+  struct MinOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &lhs, T const &rhs, T *output) const {
+      *output = rhs < lhs ? rhs : lhs;
+    }
+  };
+  
+  struct MaxOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &lhs, T const &rhs, T *output) const {
+      *output = rhs > lhs ? rhs : lhs;
+    }
+  };
+  
+  // Clip the lhs to -rhs..rhs. A NaN lhs is clipped to -rhs.
+  struct ClipOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &lhs, T const &rhs, T *output) const {
+      T low = -rhs;
+      T clipped = lhs > low ? lhs : low;
+      *output = clipped < rhs ? clipped : rhs;
+    }
+  };
+  
+  // Clear the sign bit, so that -0 and negative NaNs lose their sign too.
+  struct AbsOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &input, T *output) const {
+      *output = math::bitCast<T>(math::bitCast<math::IntLanes<T>>(input) & 0x7FFFFFFF);
+    }
+  };
+  
+  // Choose `ifTrue` where the condition is greater than zero, and `ifFalse` elsewhere
+  // (including where it is NaN).
+  struct SelectOp {
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &condition, T const &ifTrue, T const &ifFalse, T *output) const {
+      *output = condition > 0.0f ? ifTrue : ifFalse;
+    }
+  };
+  
+  
+  /** Table lookup, applicable to both floats and lane vectors **/
+  
+  // Read `samples[index]` for each lane.
+  ALWAYS_INLINE float gather(float const *samples, int32_t index) {
+    return samples[index];
+  }
+  
+  template <typename IntVec>
+  ALWAYS_INLINE auto gather(float const *samples, IntVec const &index) {
+    typename Lanes<sizeof(IntVec) / sizeof(int32_t)>::type result;
+    
+    for (size_t i = 0; i < sizeof(IntVec) / sizeof(int32_t); ++i) {
+      result[i] = samples[index[i]];
+    }
+    
+    return result;
+  }
+  
+#if defined(__x86_64__) || defined(__i386__)
+  // Only the AVX2 and AVX-512 kernels use 8 and 16 lanes, so these may use their
+  // gather instructions. They can't be forced inline into the generic lookup, which
+  // lacks their targets, but are inlined once it has been inlined into the kernel.
+  __attribute__((target("avx2")))
+  inline Lanes<8>::type gather(float const *samples, Lanes<8>::intType const &index) {
+    return (Lanes<8>::type)_mm256_i32gather_ps(samples, (__m256i)index, 4);
+  }
+  
+  __attribute__((target("avx512f")))
+  inline Lanes<16>::type gather(float const *samples, Lanes<16>::intType const &index) {
+    return (Lanes<16>::type)_mm512_mask_i32gather_ps(_mm512_setzero_ps(), 0xFFFF, (__m512i)index, samples, 4);
+  }
+#endif
+  
+  // Read one cycle of a table at each phase sample, interpolating as selected by `Mode`
+  // (0: nearest, 1: linear, 2: cubic). Phase wraps around at every integer, so the
+  // table's size must be a power of two, letting indices wrap with a mask.
+  //
+  // Phases are wrapped to their fractional part before scaling to the table, so that
+  // positions keep every fractional bit of the phase however many cycles have passed.
+  // Phases of 2^23 or more are whole numbers, and are read (as are NaN and infinite
+  // phases) at the start of the table.
+  template <int Mode>
+  struct TableLookupOp {
+    float const *samples;
+    uint32_t size;
+    
+    template <typename T>
+    ALWAYS_INLINE void operator()(T const &phase, T *output) const {
+      typedef math::IntLanes<T> Int;
+      int32_t mask = size - 1;
+      
+      // Subtracting the floor is exact, as the fraction needs no more bits than the phase.
+      T wrapped = (phase < 8388608.0f) & (phase > -8388608.0f) ? phase : 0.0f;
+      T whole = math::convert<T>(math::convert<Int>(wrapped));
+      whole = whole > wrapped ? whole - 1.0f : whole;
+      
+      T position = (wrapped - whole) * (float)size;
+      
+      // Split the position into the index of the sample at or before it, and the
+      // fraction of the way to the next sample.
+      Int i;
+      T below = math::roundToInt(position, &i);
+      auto rounded = below > position;
+      i = rounded ? i - 1 : i;
+      below = rounded ? below - 1.0f : below;
+      
+      T t = position - below;
+      
+      if (Mode == 0) {
+        *output = gather(samples, (t >= 0.5f ? i + 1 : i) & mask);
+        
+      } else if (Mode == 1) {
+        T a = gather(samples, i & mask);
+        T b = gather(samples, (i + 1) & mask);
+        
+        *output = a + (b - a) * t;
+        
+      } else {
+        // Catmull-Rom spline through the samples either side of the position.
+        T p0 = gather(samples, (i - 1) & mask);
+        T p1 = gather(samples, i & mask);
+        T p2 = gather(samples, (i + 1) & mask);
+        T p3 = gather(samples, (i + 2) & mask);
+        
+        T c3 = (p1 - p2) * 3.0f + p3 - p0;
+        T c2 = p0 * 2.0f - p1 * 5.0f + p2 * 4.0f - p3;
+        *output = p1 + 0.5f * t * (p2 - p0 + t * (c2 + t * c3));
+      }
+    }
+  };
+  
+  
+  /** Loops **/
+  
+  // Load lanes from a buffer of any alignment.
+  template <typename Vec>
+  ALWAYS_INLINE void load(float const *input, Vec *output) {
+    __builtin_memcpy(output, input, sizeof(Vec));
+  }
+  
+  // Store lanes to a buffer of any alignment.
+  template <typename Vec>
+  ALWAYS_INLINE void store(Vec const &input, float *output) {
+    __builtin_memcpy(output, &input, sizeof(Vec));
+  }
+  
+  // Set every lane of `output` to `value`.
+  template <typename Vec>
+  ALWAYS_INLINE void broadcast(float value, Vec *output) {
+    for (size_t i = 0; i < sizeof(Vec) / sizeof(float); ++i) {
+      (*output)[i] = value;
+    }
+  }
+  
+  // Apply `op` to each sample, one cache line per iteration, then finish any remaining
+  // samples one at a time.
+  template <size_t Width, typename Op>
+  ALWAYS_INLINE void unaryLoop(float const *input, float *output, size_t sampleCount, Op op) {
+    typedef typename Lanes<Width>::type Vec;
+    static_assert(LineSamples % Width == 0, "Lane width should divide the cache line size");
+    
+    size_t i = 0;
+    for (; i + LineSamples <= sampleCount; i += LineSamples) {
+#pragma GCC unroll 16
+      for (size_t j = i; j < i + LineSamples; j += Width) {
+        Vec inputLanes, outputLanes;
+        load(input + j, &inputLanes);
+        
+        op(inputLanes, &outputLanes);
+        store(outputLanes, output + j);
+      }
+    }
+    
+    for (; i < sampleCount; ++i) {
+      op(input[i], output + i);
+    }
+  }
+  
+  // Apply `op` to each pair of samples, one cache line per iteration, then finish
+  // any remaining samples one at a time.
+  template <size_t Width, typename Op>
+  ALWAYS_INLINE void vectorVectorLoop(float const *lhs, float const *rhs, float *output, size_t sampleCount, Op op) {
+    typedef typename Lanes<Width>::type Vec;
+    static_assert(LineSamples % Width == 0, "Lane width should divide the cache line size");
+    
+    size_t i = 0;
+    for (; i + LineSamples <= sampleCount; i += LineSamples) {
+#pragma GCC unroll 16
+      for (size_t j = i; j < i + LineSamples; j += Width) {
+        Vec lhsLanes, rhsLanes, outputLanes;
+        load(lhs + j, &lhsLanes);
+        load(rhs + j, &rhsLanes);
+        
+        op(lhsLanes, rhsLanes, &outputLanes);
+        store(outputLanes, output + j);
+      }
+    }
+    
+    for (; i < sampleCount; ++i) {
+      op(lhs[i], rhs[i], output + i);
+    }
+  }
+  
+  // Apply `op` to each sample and a scalar, one cache line per iteration, then finish
+  // any remaining samples one at a time.
+  template <size_t Width, typename Op>
+  ALWAYS_INLINE void vectorScalarLoop(float const *lhs, float rhs, float *output, size_t sampleCount, Op op) {
+    typedef typename Lanes<Width>::type Vec;
+    static_assert(LineSamples % Width == 0, "Lane width should divide the cache line size");
+    
+    Vec rhsLanes;
+    broadcast(rhs, &rhsLanes);
+    
+    size_t i = 0;
+    for (; i + LineSamples <= sampleCount; i += LineSamples) {
+#pragma GCC unroll 16
+      for (size_t j = i; j < i + LineSamples; j += Width) {
+        Vec lhsLanes, outputLanes;
+        load(lhs + j, &lhsLanes);
+        
+        op(lhsLanes, rhsLanes, &outputLanes);
+        store(outputLanes, output + j);
+      }
+    }
+    
+    for (; i < sampleCount; ++i) {
+      op(lhs[i], rhs, output + i);
+    }
+  }
+  
+  // Lanes of a ternary operation's operand starting at sample `i`. Vector operands are loaded
+  // from the buffer, scalar operands are broadcast once before the loop.
+  //
+  // Like `load`, these write lanes through a pointer, since returning a vector from a
+  // function without the caller's target attribute changes its ABI.
+  template <typename Vec>
+  ALWAYS_INLINE void operandLanes(float const *input, size_t i, Vec *lanes) {
+    load(input + i, lanes);
+  }
+  
+  template <typename Vec>
+  ALWAYS_INLINE void operandLanes(Vec const &input, size_t i, Vec *lanes) {
+    *lanes = input;
+  }
+  
+  // Sample `i` of a ternary operation's operand.
+  ALWAYS_INLINE float operandSample(float const *input, size_t i) {
+    return input[i];
+  }
+  
+  ALWAYS_INLINE float operandSample(float input, size_t i) {
+    return input;
+  }
+  
+  // Prepare a ternary operation's operand for use by `operandLanes`: the buffer of a
+  // vector operand, or the lanes of a scalar operand.
+  template <typename Vec, typename Operand>
+  struct OperandSource {
+    typedef float const *type;
+  };
+  
+  template <typename Vec>
+  struct OperandSource<Vec, float> {
+    typedef Vec type;
+  };
+  
+  template <typename Vec>
+  ALWAYS_INLINE void operandSource(float const *input, float const **source) {
+    *source = input;
+  }
+  
+  template <typename Vec>
+  ALWAYS_INLINE void operandSource(float input, Vec *source) {
+    broadcast(input, source);
+  }
+  
+  // Compute `lhs * mul + add` for each sample, one cache line per iteration, then finish
+  // any remaining samples one at a time. `mul` and `add` may be buffers or scalars.
+  //
+  // The product and sum are separate operations, so the compiler must not contract them
+  // into a single rounding (the build disables floating point contraction).
+  template <size_t Width, typename Mul, typename Add>
+  ALWAYS_INLINE void multiplyAddLoop(float const *lhs, Mul mul, Add add, float *output, size_t sampleCount) {
+    typedef typename Lanes<Width>::type Vec;
+    static_assert(LineSamples % Width == 0, "Lane width should divide the cache line size");
+    
+    typename OperandSource<Vec, Mul>::type mulSource;
+    typename OperandSource<Vec, Add>::type addSource;
+    operandSource<Vec>(mul, &mulSource);
+    operandSource<Vec>(add, &addSource);
+    
+    size_t i = 0;
+    for (; i + LineSamples <= sampleCount; i += LineSamples) {
+#pragma GCC unroll 16
+      for (size_t j = i; j < i + LineSamples; j += Width) {
+        Vec lhsLanes;
+        load(lhs + j, &lhsLanes);
+        
+        Vec mulLanes, addLanes;
+        operandLanes(mulSource, j, &mulLanes);
+        operandLanes(addSource, j, &addLanes);
+        
+        Vec product = lhsLanes * mulLanes;
+        store(product + addLanes, output + j);
+      }
+    }
+    
+    for (; i < sampleCount; ++i) {
+      float product = lhs[i] * operandSample(mul, i);
+      output[i] = product + operandSample(add, i);
+    }
+  }
+  
+  // Select between `ifTrue` and `ifFalse` for each sample of `condition`, one cache line
+  // per iteration, then finish any remaining samples one at a time. `ifTrue` and `ifFalse`
+  // may be buffers or scalars.
+  template <size_t Width, typename IfTrue, typename IfFalse>
+  ALWAYS_INLINE void selectLoop(float const *condition, IfTrue ifTrue, IfFalse ifFalse, float *output, size_t sampleCount) {
+    typedef typename Lanes<Width>::type Vec;
+    static_assert(LineSamples % Width == 0, "Lane width should divide the cache line size");
+    
+    typename OperandSource<Vec, IfTrue>::type trueSource;
+    typename OperandSource<Vec, IfFalse>::type falseSource;
+    operandSource<Vec>(ifTrue, &trueSource);
+    operandSource<Vec>(ifFalse, &falseSource);
+    
+    size_t i = 0;
+    for (; i + LineSamples <= sampleCount; i += LineSamples) {
+#pragma GCC unroll 16
+      for (size_t j = i; j < i + LineSamples; j += Width) {
+        Vec conditionLanes, trueLanes, falseLanes, outputLanes;
+        load(condition + j, &conditionLanes);
+        operandLanes(trueSource, j, &trueLanes);
+        operandLanes(falseSource, j, &falseLanes);
+        
+        SelectOp()(conditionLanes, trueLanes, falseLanes, &outputLanes);
+        store(outputLanes, output + j);
+      }
+    }
+    
+    for (; i < sampleCount; ++i) {
+      SelectOp()(condition[i], operandSample(ifTrue, i), operandSample(ifFalse, i), output + i);
+    }
+  }
+  
+  
+  // Return true if any lane of a comparison's result is set.
+  template <typename IntVec>
+  ALWAYS_INLINE bool anyLane(IntVec const &lanes) {
+    int32_t any = 0;
+    
+    for (size_t i = 0; i < sizeof(IntVec) / sizeof(int32_t); ++i) {
+      any |= lanes[i];
+    }
+    
+    return any != 0;
+  }
+  
+  // Test whether any sample of `condition` is greater than zero or, if `All`, whether
+  // every sample is. Tests a cache line per iteration, returning as soon as one decides
+  // the result, then tests any remaining samples one at a time.
+  template <size_t Width, bool All>
+  ALWAYS_INLINE bool conditionLoop(float const *condition, size_t sampleCount) {
+    typedef typename Lanes<Width>::type Vec;
+    typedef typename Lanes<Width>::intType IntVec;
+    static_assert(LineSamples % Width == 0, "Lane width should divide the cache line size");
+    
+    size_t i = 0;
+    for (; i + LineSamples <= sampleCount; i += LineSamples) {
+      // Lanes set where a sample decides the result: true samples, or false if `All`.
+      IntVec deciding = {};
+      
+#pragma GCC unroll 16
+      for (size_t j = i; j < i + LineSamples; j += Width) {
+        Vec conditionLanes;
+        load(condition + j, &conditionLanes);
+        
+        IntVec isTrue = conditionLanes > 0.0f;
+        deciding |= All ? ~isTrue : isTrue;
+      }
+      
+      if (anyLane(deciding)) {
+        return !All;
+      }
+    }
+    
+    for (; i < sampleCount; ++i) {
+      if ((condition[i] > 0.0f) != All) {
+        return !All;
+      }
+    }
+    
+    return All;
+  }
+  
+  
+  /** Kernel tables **/
+  
+  // Define a namespace containing each math kernel for an accuracy tier, compiled for an
+  // instruction set.
+  //
+  //  - TIER: Name of the math kernel table.
+  //  - PRECISE: True for the precise tier, false for the fast tier.
+  //  - WIDTH, TARGET: As for DEFINE_KERNELS.
+#define DEFINE_MATH_KERNELS(TIER, PRECISE, WIDTH, TARGET) \
+  namespace TIER { \
+    TARGET void sin(float const *input, float *output, size_t sampleCount) { \
+      unaryLoop<WIDTH>(input, output, sampleCount, SinOp<PRECISE>()); \
+    } \
+    TARGET void cos(float const *input, float *output, size_t sampleCount) { \
+      unaryLoop<WIDTH>(input, output, sampleCount, CosOp<PRECISE>()); \
+    } \
+    TARGET void exp(float const *input, float *output, size_t sampleCount) { \
+      unaryLoop<WIDTH>(input, output, sampleCount, ExpOp<PRECISE>()); \
+    } \
+    TARGET void log(float const *input, float *output, size_t sampleCount) { \
+      unaryLoop<WIDTH>(input, output, sampleCount, LogOp<PRECISE>()); \
+    } \
+    TARGET void tanh(float const *input, float *output, size_t sampleCount) { \
+      unaryLoop<WIDTH>(input, output, sampleCount, TanhOp<PRECISE>()); \
+    } \
+    TARGET void powVV(float const *lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorVectorLoop<WIDTH>(lhs, rhs, output, sampleCount, PowOp<PRECISE>()); \
+    } \
+    TARGET void powVS(float const *lhs, float rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(lhs, rhs, output, sampleCount, PowOp<PRECISE>()); \
+    } \
+    TARGET void powSV(float lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(rhs, lhs, output, sampleCount, Reversed<PowOp<PRECISE>>()); \
+    } \
+    \
+    MathTable const table = { \
+      sin, cos, exp, log, tanh, \
+      powVV, powVS, powSV \
+    }; \
+  }
+  
+  // Define a namespace containing each kernel compiled for an instruction set.
+  //
+  //  - ISA: Name of the kernel table.
+  //  - WIDTH: Number of float lanes in the instruction set's vector registers.
+  //  - TARGET: Function attribute enabling the instruction set (may be empty).
+#define DEFINE_KERNELS(ISA, WIDTH, TARGET) \
+  namespace ISA { \
+    TARGET void addVV(float const *lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorVectorLoop<WIDTH>(lhs, rhs, output, sampleCount, AddOp()); \
+    } \
+    TARGET void addVS(float const *lhs, float rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(lhs, rhs, output, sampleCount, AddOp()); \
+    } \
+    TARGET void mulVV(float const *lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorVectorLoop<WIDTH>(lhs, rhs, output, sampleCount, MulOp()); \
+    } \
+    TARGET void mulVS(float const *lhs, float rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(lhs, rhs, output, sampleCount, MulOp()); \
+    } \
+    TARGET void fmaVVV(float const *lhs, float const *mul, float const *add, float *output, size_t sampleCount) { \
+      multiplyAddLoop<WIDTH>(lhs, mul, add, output, sampleCount); \
+    } \
+    TARGET void fmaVSV(float const *lhs, float mul, float const *add, float *output, size_t sampleCount) { \
+      multiplyAddLoop<WIDTH>(lhs, mul, add, output, sampleCount); \
+    } \
+    TARGET void fmaVVS(float const *lhs, float const *mul, float add, float *output, size_t sampleCount) { \
+      multiplyAddLoop<WIDTH>(lhs, mul, add, output, sampleCount); \
+    } \
+    TARGET void fmaVSS(float const *lhs, float mul, float add, float *output, size_t sampleCount) { \
+      multiplyAddLoop<WIDTH>(lhs, mul, add, output, sampleCount); \
+    } \
+    \
+    TARGET void noiseVV(float const *lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorVectorLoop<WIDTH>(lhs, rhs, output, sampleCount, NoiseOp<false>()); \
+    } \
+    TARGET void noiseVS(float const *lhs, float rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(lhs, rhs, output, sampleCount, NoiseOp<false>()); \
+    } \
+    TARGET void noiseSV(float lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(rhs, lhs, output, sampleCount, Reversed<NoiseOp<false>>()); \
+    } \
+    TARGET void bipolarNoiseVV(float const *lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorVectorLoop<WIDTH>(lhs, rhs, output, sampleCount, NoiseOp<true>()); \
+    } \
+    TARGET void bipolarNoiseVS(float const *lhs, float rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(lhs, rhs, output, sampleCount, NoiseOp<true>()); \
+    } \
+    TARGET void bipolarNoiseSV(float lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(rhs, lhs, output, sampleCount, Reversed<NoiseOp<true>>()); \
+    } \
+    \
+    TARGET void tableNearest(float const *samples, uint32_t size, float const *phase, float *output, size_t sampleCount) { \
+      unaryLoop<WIDTH>(phase, output, sampleCount, TableLookupOp<0>{samples, size}); \
+    } \
+    TARGET void tableLinear(float const *samples, uint32_t size, float const *phase, float *output, size_t sampleCount) { \
+      unaryLoop<WIDTH>(phase, output, sampleCount, TableLookupOp<1>{samples, size}); \
+    } \
+    TARGET void tableCubic(float const *samples, uint32_t size, float const *phase, float *output, size_t sampleCount) { \
+      unaryLoop<WIDTH>(phase, output, sampleCount, TableLookupOp<2>{samples, size}); \
+    } \
+    \
+    TARGET void minVV(float const *lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorVectorLoop<WIDTH>(lhs, rhs, output, sampleCount, MinOp()); \
+    } \
+    TARGET void minVS(float const *lhs, float rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(lhs, rhs, output, sampleCount, MinOp()); \
+    } \
+    TARGET void minSV(float lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(rhs, lhs, output, sampleCount, Reversed<MinOp>()); \
+    } \
+    TARGET void maxVV(float const *lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorVectorLoop<WIDTH>(lhs, rhs, output, sampleCount, MaxOp()); \
+    } \
+    TARGET void maxVS(float const *lhs, float rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(lhs, rhs, output, sampleCount, MaxOp()); \
+    } \
+    TARGET void maxSV(float lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(rhs, lhs, output, sampleCount, Reversed<MaxOp>()); \
+    } \
+    TARGET void clipVV(float const *lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorVectorLoop<WIDTH>(lhs, rhs, output, sampleCount, ClipOp()); \
+    } \
+    TARGET void clipVS(float const *lhs, float rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(lhs, rhs, output, sampleCount, ClipOp()); \
+    } \
+    TARGET void clipSV(float lhs, float const *rhs, float *output, size_t sampleCount) { \
+      vectorScalarLoop<WIDTH>(rhs, lhs, output, sampleCount, Reversed<ClipOp>()); \
+    } \
+    TARGET void abs(float const *input, float *output, size_t sampleCount) { \
+      unaryLoop<WIDTH>(input, output, sampleCount, AbsOp()); \
+    } \
+    TARGET void selectVVV(float const *condition, float const *ifTrue, float const *ifFalse, float *output, size_t sampleCount) { \
+      selectLoop<WIDTH>(condition, ifTrue, ifFalse, output, sampleCount); \
+    } \
+    TARGET void selectVSV(float const *condition, float ifTrue, float const *ifFalse, float *output, size_t sampleCount) { \
+      selectLoop<WIDTH>(condition, ifTrue, ifFalse, output, sampleCount); \
+    } \
+    TARGET void selectVVS(float const *condition, float const *ifTrue, float ifFalse, float *output, size_t sampleCount) { \
+      selectLoop<WIDTH>(condition, ifTrue, ifFalse, output, sampleCount); \
+    } \
+    TARGET void selectVSS(float const *condition, float ifTrue, float ifFalse, float *output, size_t sampleCount) { \
+      selectLoop<WIDTH>(condition, ifTrue, ifFalse, output, sampleCount); \
+    } \
+    TARGET bool anyTrue(float const *condition, size_t sampleCount) { \
+      return conditionLoop<WIDTH, false>(condition, sampleCount); \
+    } \
+    TARGET bool allTrue(float const *condition, size_t sampleCount) { \
+      return conditionLoop<WIDTH, true>(condition, sampleCount); \
+    } \
+    \
+    DEFINE_MATH_KERNELS(precise, true, WIDTH, TARGET) \
+    DEFINE_MATH_KERNELS(fast, false, WIDTH, TARGET) \
+    \
+    Table const table = { \
+      #ISA, \
+      addVV, addVS, \
+      mulVV, mulVS, \
+      fmaVVV, fmaVSV, fmaVVS, fmaVSS, \
+      noiseVV, noiseVS, noiseSV, \
+      bipolarNoiseVV, bipolarNoiseVS, bipolarNoiseSV, \
+      tableNearest, tableLinear, tableCubic, \
+      minVV, minVS, minSV, \
+      maxVV, maxVS, maxSV, \
+      clipVV, clipVS, clipSV, \
+      abs, \
+      selectVVV, selectVSV, selectVVS, selectVSS, \
+      anyTrue, allTrue, \
+      precise::table, fast::table \
+    }; \
+  }
+  
+  DEFINE_KERNELS(generic, 4, )
+  
+#if defined(__x86_64__) || defined(__i386__)
+  DEFINE_KERNELS(sse2, 4, __attribute__((target("sse2"))))
+  DEFINE_KERNELS(avx2, 8, __attribute__((target("avx2"))))
+  DEFINE_KERNELS(avx512, 16, __attribute__((target("avx512f"))))
+#endif
+
+#undef DEFINE_KERNELS
+#undef DEFINE_MATH_KERNELS
+  
+  
+  // Return the kernel tables supported by the host CPU, widest first.
+  std::vector<Table const *> supportedTables() {
+    std::vector<Table const *> tables;
+    
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    
+    if (__builtin_cpu_supports("avx512f")) tables.push_back(&avx512::table);
+    if (__builtin_cpu_supports("avx2")) tables.push_back(&avx2::table);
+    if (__builtin_cpu_supports("sse2")) tables.push_back(&sse2::table);
+#endif
+    
+    tables.push_back(&generic::table);
+    return tables;
+  }
+  
+  // Select the widest supported kernel table, unless overridden by the environment.
+  Table const &selectTable() {
+    auto tables = supportedTables();
+    auto requested = getenv("TEMPO_KERNELS");
+    
+    if (!requested) {
+      return *tables.front();
+    }
+    
+    for (auto table : tables) {
+      if (strcmp(table->name, requested) == 0) {
+        return *table;
+      }
+    }
+    
+    auto err = std::stringstream() << "Kernels not supported by host CPU: `" << requested << "`";
+    throw std::runtime_error(err.str());
+  }
+}
+
+namespace vm {
+  namespace kernels {
+    Table const &active() {
+      static Table const &table = selectTable();
+      return table;
+    }
+  }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vm {
+  /**
+   SIMD Kernels
+   
+   Portable implementations of the VM's vector primitives. Each kernel is compiled
+   once per supported instruction set, and the widest variant the host CPU supports
+   is selected the first time the kernels are used.
+   
+   Kernels accept any buffer, but are fastest on the 64-byte aligned buffers backing
+   VectorStackSlot, whose lengths are a multiple of VectorStackSlot::SampleCount.
+   
+   The selection may be overridden by setting the TEMPO_KERNELS environment variable
+   to the name of a kernel table ("generic", "sse2", "avx2" or "avx512"). This is
+   useful for benchmarking and for testing the narrower variants on wide machines.
+   */
+  
+  namespace kernels {
+    // Vector-Vector kernel.
+    typedef void (*VectorVector)(float const *lhs, float const *rhs, float *output, size_t sampleCount);
+    
+    // Vector-Scalar kernel. Commutative operations reuse this for the Scalar-Vector case.
+    typedef void (*VectorScalar)(float const *lhs, float rhs, float *output, size_t sampleCount);
+    
+    // Multiply-add kernels, computing `lhs * mul + add` for each sample.
+    //
+    // The product is rounded before the add, so results match a separate multiply
+    // and add exactly. Naming follows the operand types of `lhs`, `mul` and `add`.
+    typedef void (*MultiplyAddVVV)(float const *lhs, float const *mul, float const *add, float *output, size_t sampleCount);
+    typedef void (*MultiplyAddVSV)(float const *lhs, float mul, float const *add, float *output, size_t sampleCount);
+    typedef void (*MultiplyAddVVS)(float const *lhs, float const *mul, float add, float *output, size_t sampleCount);
+    typedef void (*MultiplyAddVSS)(float const *lhs, float mul, float add, float *output, size_t sampleCount);
+    
+    // Element-wise kernel for functions of a single operand.
+    typedef void (*Unary)(float const *input, float *output, size_t sampleCount);
+    
+    // Scalar-Vector kernel, for operations that don't commute.
+    typedef void (*ScalarVector)(float lhs, float const *rhs, float *output, size_t sampleCount);
+    
+    // Table lookup kernel, reading a table of `size` samples (a power of two) at each
+    // sample of `phase`, measured in cycles of the table.
+    typedef void (*TableLookup)(float const *samples, uint32_t size, float const *phase, float *output, size_t sampleCount);
+    
+    // Select kernels, choosing `ifTrue` for each sample where `condition` is greater than
+    // zero, and `ifFalse` elsewhere. Naming follows the operand types of `condition`,
+    // `ifTrue` and `ifFalse`.
+    typedef void (*SelectVVV)(float const *condition, float const *ifTrue, float const *ifFalse, float *output, size_t sampleCount);
+    typedef void (*SelectVSV)(float const *condition, float ifTrue, float const *ifFalse, float *output, size_t sampleCount);
+    typedef void (*SelectVVS)(float const *condition, float const *ifTrue, float ifFalse, float *output, size_t sampleCount);
+    typedef void (*SelectVSS)(float const *condition, float ifTrue, float ifFalse, float *output, size_t sampleCount);
+    
+    // Condition test kernel, returning whether any (or every) sample of `condition` is
+    // greater than zero, as tested by the select kernels.
+    typedef bool (*ConditionTest)(float const *condition, size_t sampleCount);
+    
+    // Transcendental function kernels, computed to one accuracy tier (see VMOps.hpp).
+    //
+    // Every table computes the same result for each sample, whatever its width.
+    struct MathTable {
+      Unary sin;
+      Unary cos;
+      Unary exp;
+      Unary log;
+      Unary tanh;
+      
+      VectorVector powVV;
+      VectorScalar powVS;
+      ScalarVector powSV;
+    };
+    
+    // Set of kernels compiled for a specific instruction set.
+    struct Table {
+      char const *name;
+      
+      VectorVector addVV;
+      VectorScalar addVS;
+      
+      VectorVector mulVV;
+      VectorScalar mulVS;
+      
+      MultiplyAddVVV fmaVVV;
+      MultiplyAddVSV fmaVSV;
+      MultiplyAddVVS fmaVVS;
+      MultiplyAddVSS fmaVSS;
+      
+      // Noise of a time and a seed, in [0, 1) or, for bipolar noise, [-1, 1).
+      VectorVector noiseVV;
+      VectorScalar noiseVS;
+      ScalarVector noiseSV;
+      
+      VectorVector bipolarNoiseVV;
+      VectorScalar bipolarNoiseVS;
+      ScalarVector bipolarNoiseSV;
+      
+      // Table lookup, reading the nearest sample, or interpolating linearly or with a
+      // cubic spline.
+      TableLookup tableNearest;
+      TableLookup tableLinear;
+      TableLookup tableCubic;
+      
+      // Lesser and greater of two samples, and the lhs clipped to -rhs..rhs. None commute,
+      // since minimum and maximum keep the lhs where either operand is NaN.
+      VectorVector minVV;
+      VectorScalar minVS;
+      ScalarVector minSV;
+      
+      VectorVector maxVV;
+      VectorScalar maxVS;
+      ScalarVector maxSV;
+      
+      VectorVector clipVV;
+      VectorScalar clipVS;
+      ScalarVector clipSV;
+      
+      Unary abs;
+      
+      SelectVVV selectVVV;
+      SelectVSV selectVSV;
+      SelectVVS selectVVS;
+      SelectVSS selectVSS;
+      
+      // Tests of a whole condition, stopping at the first cache line that decides them.
+      ConditionTest anyTrue;
+      ConditionTest allTrue;
+      
+      MathTable precise;
+      MathTable fast;
+    };
+    
+    // Return the kernel table selected for the host CPU.
+    Table const &active();
+  }
+}
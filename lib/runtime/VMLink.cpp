@@ -0,0 +1,75 @@
+#include "VMLink.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace vm {
+  Package link(Package const *package, Arena *arena) {
+    Package result(arena);
+    result.code.reserve(package->code.size());
+    result.symbols.insert(package->symbols.begin(), package->symbols.end());
+    result.stackDepths.insert(package->stackDepths.begin(), package->stackDepths.end());
+    
+    for (auto &table : package->tables) {
+      auto size = table.samples.size();
+      
+      if (size == 0 || (size & (size - 1)) != 0) {
+        auto err = std::stringstream() << "Table `" << table.name << "` has " << size << " samples, expected a power of two";
+        throw std::runtime_error(err.str());
+      }
+      
+      result.tables.push_back(Table(arena, table.name));
+      result.tables.back().samples.assign(table.samples.begin(), table.samples.end());
+    }
+    
+    std::vector<Symbol> undefined;
+    
+    for (auto inst : package->code) {
+      if (inst.operation == Instruction::PUSH_SYM) {
+        auto hit = package->symbols.find(inst.operand.sym);
+        
+        // Symbols that don't name a function may name a table.
+        auto table = std::find_if(package->tables.begin(), package->tables.end(), [&](Table const &t) {
+          return t.name == inst.operand.sym;
+        });
+        
+        if (hit == package->symbols.end() && table != package->tables.end()) {
+          inst = Instruction(Instruction::PUSH, (uint32_t)(table - package->tables.begin()), Data::U32Value);
+          
+        } else if (hit == package->symbols.end()) {
+          if (std::find(undefined.begin(), undefined.end(), inst.operand.sym) == undefined.end()) {
+            undefined.push_back(inst.operand.sym);
+          }
+          
+        } else {
+          inst = Instruction(Instruction::PUSH, hit->second, Data::U32Value);
+        }
+      }
+      
+      result.code.push_back(inst);
+    }
+    
+    if (!undefined.empty()) {
+      auto err = std::stringstream() << "Undefined symbols:";
+      for (auto sym : undefined) {
+        err << " `" << sym << "`";
+      }
+      
+      throw std::runtime_error(err.str());
+    }
+    
+    return result;
+  }
+  
+  bool isLinked(Package const *package) {
+    for (auto inst : package->code) {
+      if (inst.operation == Instruction::PUSH_SYM) {
+        return false;
+      }
+    }
+    
+    return true;
+  }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Arena.hpp"
+#include "Instruction.hpp"
+
+namespace vm {
+  // Resolve every symbol referenced by a package's code.
+  //
+  // Returns a copy of the package where each PUSH_SYM instruction is replaced by a
+  // PUSH of the referenced function's address. Evaluation never modifies linked code,
+  // so a linked package may be shared between threads.
+  //
+  // Throws if any referenced symbols are undefined, listing all of them.
+  Package link(Package const *package, Arena *arena);
+  
+  // Return true if the package contains no unresolved symbol references.
+  bool isLinked(Package const *package);
+}
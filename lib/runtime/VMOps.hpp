@@ -1,56 +1,419 @@
 #pragma once
 
-#include <Accelerate/Accelerate.h>
 #include "Data.hpp"
+#include "Instruction.hpp"
+#include "VMKernels.hpp"
+
+#include <cmath>
 
 namespace vm {
   /** 
    Binary Operations.
    
    Each operation comes in 4 flavours, for each combination of vector & scalar operands.
+   Vector variants forward to the SIMD kernels selected for the host CPU.
+   
+   Scalar operands may make a vector variant's pass over its vector unnecessary. Operations
+   describe these values, so that evaluation can short-circuit them:
+      
+      * IDENTITY values leave the other operand unchanged.
+      * ABSORBING values give a result equal to themselves, whatever the other operand.
+        Short-circuiting these ignores infinite and NaN samples in the other operand.
   */
   
   struct Add {
     // Vector - Vector
     void operator()(float const *lhs, float const *rhs, float *output, size_t sampleCount) const {
-      vDSP_vadd(lhs, 1, rhs, 1, output, 1, sampleCount);
+      kernels::active().addVV(lhs, rhs, output, sampleCount);
     }
     
     // Vector - Scalar
     void operator()(float const *lhs, float const rhs, float *output, size_t sampleCount) const {
-      vDSP_vsadd(lhs, 1, &rhs, output, 1, sampleCount);
+      kernels::active().addVS(lhs, rhs, output, sampleCount);
     }
     
     // Scalar - Vector
     void operator()(float const lhs, float const *rhs, float *output, size_t sampleCount) const {
-      vDSP_vsadd(rhs, 1, &lhs, output, 1, sampleCount);
+      kernels::active().addVS(rhs, lhs, output, sampleCount);
     }
     
     // Scalar - Scalar
     void operator()(float lhs, float rhs, float *output) const {
       *output = lhs + rhs;
     }
+    
+    static bool isIdentity(float value) {
+      return value == 0;
+    }
+    
+    static bool isAbsorbing(float value) {
+      return false;
+    }
   };
   
   struct Multiply {
     // Vector - Vector
     void operator()(float const *lhs, float const *rhs, float *output, size_t sampleCount) const {
-      vDSP_vmul(lhs, 1, rhs, 1, output, 1, sampleCount);
+      kernels::active().mulVV(lhs, rhs, output, sampleCount);
     }
     
     // Vector - Scalar
     void operator()(float const *lhs, float const rhs, float *output, size_t sampleCount) const {
-      vDSP_vsmul(lhs, 1, &rhs, output, 1, sampleCount);
+      kernels::active().mulVS(lhs, rhs, output, sampleCount);
     }
     
     // Scalar - Vector
     void operator()(float const lhs, float const *rhs, float *output, size_t sampleCount) const {
-      vDSP_vsmul(rhs, 1, &lhs, output, 1, sampleCount);
+      kernels::active().mulVS(rhs, lhs, output, sampleCount);
     }
     
     // Scalar - Scalar
     void operator()(float lhs, float rhs, float *output) const {
       *output = lhs * rhs;
     }
+    
+    static bool isIdentity(float value) {
+      return value == 1;
+    }
+    
+    static bool isAbsorbing(float value) {
+      return value == 0;
+    }
+  };
+  
+  
+  /**
+   Math Operations.
+   
+   Transcendental functions, computed by branch-free polynomial kernels to one of two
+   accuracy tiers (see VMKernels.cpp for each function's bounds):
+      
+      * PRECISE results are within 1-2 ulp, and follow C's handling of special operands
+        (infinities, NaN, zeros and values outside the function's domain).
+      * FAST results are within about 1e-4, from shorter polynomials that skip the special
+        cases. Results for special or subnormal operands are unspecified.
+        
+   Scalar variants are computed by the same kernels, so match every sample of the vector
+   variants (and constants folded by the compiler) exactly.
+  */
+  
+  enum class Accuracy {
+    Precise,
+    Fast
+  };
+  
+  template <Accuracy Tier>
+  kernels::MathTable const &mathKernels() {
+    return Tier == Accuracy::Precise ? kernels::active().precise : kernels::active().fast;
+  }
+  
+  // Function of one operand, computed by the math kernel `Kernel`.
+  template <Accuracy Tier, kernels::Unary kernels::MathTable::*Kernel>
+  struct UnaryMath {
+    // Vector
+    void operator()(float const *input, float *output, size_t sampleCount) const {
+      (mathKernels<Tier>().*Kernel)(input, output, sampleCount);
+    }
+    
+    // Scalar
+    void operator()(float input, float *output) const {
+      (mathKernels<Tier>().*Kernel)(&input, output, 1);
+    }
+  };
+  
+  template <Accuracy Tier>
+  using Sin = UnaryMath<Tier, &kernels::MathTable::sin>;
+  
+  template <Accuracy Tier>
+  using Cos = UnaryMath<Tier, &kernels::MathTable::cos>;
+  
+  template <Accuracy Tier>
+  using Exp = UnaryMath<Tier, &kernels::MathTable::exp>;
+  
+  template <Accuracy Tier>
+  using Log = UnaryMath<Tier, &kernels::MathTable::log>;
+  
+  template <Accuracy Tier>
+  using Tanh = UnaryMath<Tier, &kernels::MathTable::tanh>;
+  
+  // Raise the lhs to the power of the rhs. A binary operation, but without values that
+  // short-circuit it, since its identity (1) only applies to the rhs.
+  template <Accuracy Tier>
+  struct Pow {
+    // Vector - Vector
+    void operator()(float const *lhs, float const *rhs, float *output, size_t sampleCount) const {
+      mathKernels<Tier>().powVV(lhs, rhs, output, sampleCount);
+    }
+    
+    // Vector - Scalar
+    void operator()(float const *lhs, float const rhs, float *output, size_t sampleCount) const {
+      mathKernels<Tier>().powVS(lhs, rhs, output, sampleCount);
+    }
+    
+    // Scalar - Vector
+    void operator()(float const lhs, float const *rhs, float *output, size_t sampleCount) const {
+      mathKernels<Tier>().powSV(lhs, rhs, output, sampleCount);
+    }
+    
+    // Scalar - Scalar
+    void operator()(float lhs, float rhs, float *output) const {
+      mathKernels<Tier>().powVS(&lhs, rhs, output, 1);
+    }
+    
+    static bool isIdentity(float value) {
+      return false;
+    }
+    
+    static bool isAbsorbing(float value) {
+      return false;
+    }
+  };
+  
+  
+  /**
+   Noise.
+   
+   Tempo functions are pure, so noise is a function of time rather than the state of a
+   generator: each time sample is hashed with a seed, giving a value that looks random
+   but is the same whenever that time is rendered. Distinct seeds give unrelated noise.
+   
+   The lhs is the time and the rhs the seed. Noise is uniformly distributed in [0, 1),
+   or in [-1, 1) for BIPOLAR noise, in steps of 2^-23 (or 2^-22).
+   */
+  
+  template <bool Bipolar>
+  struct Noise {
+    // Vector - Vector
+    void operator()(float const *lhs, float const *rhs, float *output, size_t sampleCount) const {
+      (Bipolar ? kernels::active().bipolarNoiseVV : kernels::active().noiseVV)(lhs, rhs, output, sampleCount);
+    }
+    
+    // Vector - Scalar
+    void operator()(float const *lhs, float const rhs, float *output, size_t sampleCount) const {
+      (Bipolar ? kernels::active().bipolarNoiseVS : kernels::active().noiseVS)(lhs, rhs, output, sampleCount);
+    }
+    
+    // Scalar - Vector
+    void operator()(float const lhs, float const *rhs, float *output, size_t sampleCount) const {
+      (Bipolar ? kernels::active().bipolarNoiseSV : kernels::active().noiseSV)(lhs, rhs, output, sampleCount);
+    }
+    
+    // Scalar - Scalar
+    void operator()(float lhs, float rhs, float *output) const {
+      (Bipolar ? kernels::active().bipolarNoiseVS : kernels::active().noiseVS)(&lhs, rhs, output, 1);
+    }
+    
+    static bool isIdentity(float value) {
+      return false;
+    }
+    
+    static bool isAbsorbing(float value) {
+      return false;
+    }
+  };
+  
+  
+  /**
+   Clamping.
+   
+   Branch-free minimum, maximum, clipping and absolute value. Where an operand of MIN or
+   MAX is NaN, the result is the lhs, so neither commutes. As for other operations, an
+   infinite scalar short-circuits them, ignoring NaN samples in the vector. CLIP clips the
+   lhs to the range -rhs..rhs, so NaN samples clip to -rhs.
+   
+   Scalar variants are computed by the same kernels, so match every sample of the vector
+   variants exactly.
+   */
+  
+  // Lesser (if `Greater` is false) or greater of two operands, or the lhs if either is NaN.
+  template <bool Greater>
+  struct Extremum {
+    // Vector - Vector
+    void operator()(float const *lhs, float const *rhs, float *output, size_t sampleCount) const {
+      (Greater ? kernels::active().maxVV : kernels::active().minVV)(lhs, rhs, output, sampleCount);
+    }
+    
+    // Vector - Scalar
+    void operator()(float const *lhs, float const rhs, float *output, size_t sampleCount) const {
+      (Greater ? kernels::active().maxVS : kernels::active().minVS)(lhs, rhs, output, sampleCount);
+    }
+    
+    // Scalar - Vector
+    void operator()(float const lhs, float const *rhs, float *output, size_t sampleCount) const {
+      (Greater ? kernels::active().maxSV : kernels::active().minSV)(lhs, rhs, output, sampleCount);
+    }
+    
+    // Scalar - Scalar
+    void operator()(float lhs, float rhs, float *output) const {
+      (Greater ? kernels::active().maxVS : kernels::active().minVS)(&lhs, rhs, output, 1);
+    }
+    
+    static bool isIdentity(float value) {
+      return value == (Greater ? -INFINITY : INFINITY);
+    }
+    
+    static bool isAbsorbing(float value) {
+      return value == (Greater ? INFINITY : -INFINITY);
+    }
+  };
+  
+  using Min = Extremum<false>;
+  using Max = Extremum<true>;
+  
+  // Clip the lhs to -rhs..rhs. Doesn't commute, so has no values that short-circuit it.
+  struct Clip {
+    // Vector - Vector
+    void operator()(float const *lhs, float const *rhs, float *output, size_t sampleCount) const {
+      kernels::active().clipVV(lhs, rhs, output, sampleCount);
+    }
+    
+    // Vector - Scalar
+    void operator()(float const *lhs, float const rhs, float *output, size_t sampleCount) const {
+      kernels::active().clipVS(lhs, rhs, output, sampleCount);
+    }
+    
+    // Scalar - Vector
+    void operator()(float const lhs, float const *rhs, float *output, size_t sampleCount) const {
+      kernels::active().clipSV(lhs, rhs, output, sampleCount);
+    }
+    
+    // Scalar - Scalar
+    void operator()(float lhs, float rhs, float *output) const {
+      kernels::active().clipVS(&lhs, rhs, output, 1);
+    }
+    
+    static bool isIdentity(float value) {
+      return false;
+    }
+    
+    static bool isAbsorbing(float value) {
+      return false;
+    }
+  };
+  
+  struct Abs {
+    // Vector
+    void operator()(float const *input, float *output, size_t sampleCount) const {
+      kernels::active().abs(input, output, sampleCount);
+    }
+    
+    // Scalar
+    void operator()(float input, float *output) const {
+      kernels::active().abs(&input, output, 1);
+    }
+  };
+  
+  
+  /**
+   Table Lookup.
+   
+   Read a package table at a phase, measured in cycles of the table so that phase wraps
+   around at every integer. Samples between the table's samples are interpolated:
+      
+      * NEAREST reads the closest sample.
+      * LINEAR interpolates between the two samples either side.
+      * CUBIC fits a Catmull-Rom spline through the four samples either side, which passes
+        through every sample with a continuous slope.
+        
+   Scalar variants are computed by the same kernels, so match every sample of the vector
+   variants exactly.
+   */
+  
+  enum class Interpolation {
+    Nearest,
+    Linear,
+    Cubic
+  };
+  
+  template <Interpolation Mode>
+  struct TableLookup {
+    static kernels::TableLookup kernel() {
+      return Mode == Interpolation::Nearest ? kernels::active().tableNearest
+      : Mode == Interpolation::Linear ? kernels::active().tableLinear
+      : kernels::active().tableCubic;
+    }
+    
+    // Vector
+    void operator()(Table const &table, float const *phase, float *output, size_t sampleCount) const {
+      kernel()(table.samples.data(), (uint32_t)table.samples.size(), phase, output, sampleCount);
+    }
+    
+    // Scalar
+    void operator()(Table const &table, float phase, float *output) const {
+      kernel()(table.samples.data(), (uint32_t)table.samples.size(), &phase, output, 1);
+    }
+  };
+  
+  
+  /**
+   Ternary Operations.
+   
+   The first operand is always a vector, unless all three are scalars. Each combination
+   of vector & scalar for the remaining operands is a separate overload.
+  */
+  
+  // Choose the second operand for each sample where the first is greater than zero, and
+  // the third elsewhere, including where the first is NaN.
+  struct Select {
+    // Vector ? Vector : Vector
+    void operator()(float const *condition, float const *ifTrue, float const *ifFalse, float *output, size_t sampleCount) const {
+      kernels::active().selectVVV(condition, ifTrue, ifFalse, output, sampleCount);
+    }
+    
+    // Vector ? Scalar : Vector
+    void operator()(float const *condition, float ifTrue, float const *ifFalse, float *output, size_t sampleCount) const {
+      kernels::active().selectVSV(condition, ifTrue, ifFalse, output, sampleCount);
+    }
+    
+    // Vector ? Vector : Scalar
+    void operator()(float const *condition, float const *ifTrue, float ifFalse, float *output, size_t sampleCount) const {
+      kernels::active().selectVVS(condition, ifTrue, ifFalse, output, sampleCount);
+    }
+    
+    // Vector ? Scalar : Scalar
+    void operator()(float const *condition, float ifTrue, float ifFalse, float *output, size_t sampleCount) const {
+      kernels::active().selectVSS(condition, ifTrue, ifFalse, output, sampleCount);
+    }
+    
+    // Scalar ? Scalar : Scalar
+    void operator()(float condition, float ifTrue, float ifFalse, float *output) const {
+      kernels::active().selectVSS(&condition, ifTrue, ifFalse, output, 1);
+    }
+    
+    static bool isTrue(float condition) {
+      return condition > 0;
+    }
+    
+    // True if any sample of a vector condition is true.
+    static bool isAnyTrue(float const *condition, size_t sampleCount) {
+      return kernels::active().anyTrue(condition, sampleCount);
+    }
+    
+    // True if every sample of a vector condition is true.
+    static bool isAllTrue(float const *condition, size_t sampleCount) {
+      return kernels::active().allTrue(condition, sampleCount);
+    }
+  };
+  
+  struct MultiplyAdd {
+    // Vector * Vector + Vector
+    void operator()(float const *lhs, float const *mul, float const *add, float *output, size_t sampleCount) const {
+      kernels::active().fmaVVV(lhs, mul, add, output, sampleCount);
+    }
+    
+    // Vector * Scalar + Vector
+    void operator()(float const *lhs, float mul, float const *add, float *output, size_t sampleCount) const {
+      kernels::active().fmaVSV(lhs, mul, add, output, sampleCount);
+    }
+    
+    // Vector * Vector + Scalar
+    void operator()(float const *lhs, float const *mul, float add, float *output, size_t sampleCount) const {
+      kernels::active().fmaVVS(lhs, mul, add, output, sampleCount);
+    }
+    
+    // Vector * Scalar + Scalar
+    void operator()(float const *lhs, float mul, float add, float *output, size_t sampleCount) const {
+      kernels::active().fmaVSS(lhs, mul, add, output, sampleCount);
+    }
   };
 }
@@ -0,0 +1,135 @@
+#include "VMRender.hpp"
+#include "VMState.hpp"
+
+#include <algorithm>
+
+namespace vm {
+  Renderer::Renderer(Package const *package, unsigned threadCount, uint32_t blockSamples_, Dispatch dispatch, uint32_t tileSamples)
+  : blockSamples(std::max<uint32_t>(blockSamples_ / VectorStackSlot::SampleCount, 1) * VectorStackSlot::SampleCount)
+  , nextBlock(0)
+  {
+    if (threadCount == AutoThreadCount) {
+      // May be unknown, in which case render on the calling thread alone.
+      threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    
+    // Contexts are created up front, so that any error in the package is thrown here rather
+    // than from a worker. Offline rendering has no deadline to meet, so needn't lock stacks.
+    for (unsigned i = 0; i < threadCount; ++i) {
+      contexts.emplace_back(new Context(package, AutoStackSize, dispatch, false, tileSamples));
+    }
+    
+    // The calling thread renders alongside the others, so only start threads for the rest.
+    // The destructor won't run if one fails to start, so join those already started here.
+    try {
+      for (size_t i = 1; i < contexts.size(); ++i) {
+        workers.emplace_back(&Renderer::runWorker, this, contexts[i].get());
+      }
+      
+    } catch (...) {
+      stopWorkers();
+      throw;
+    }
+  }
+  
+  Renderer::~Renderer() {
+    stopWorkers();
+  }
+  
+  void Renderer::render(Symbol symbol_, double startTime_, double timeStep_, float *output_, uint64_t sampleCount_) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      
+      symbol = symbol_;
+      startTime = startTime_;
+      timeStep = timeStep_;
+      output = output_;
+      sampleCount = sampleCount_;
+      blockCount = (sampleCount + blockSamples - 1) / blockSamples;
+      
+      nextBlock = 0;
+      error = nullptr;
+      
+      // Spans too short to share leave the workers waiting.
+      if (blockCount > 1) {
+        busyWorkers = workers.size();
+        ++renderCount;
+      }
+    }
+    
+    renderStarted.notify_all();
+    renderBlocks(contexts[0].get());
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    renderFinished.wait(lock, [this] { return busyWorkers == 0; });
+    
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  
+  void Renderer::runWorker(Context *context) {
+    uint64_t rendered = 0;
+    
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        renderStarted.wait(lock, [&] { return stopping || renderCount != rendered; });
+        
+        if (stopping) {
+          return;
+        }
+        
+        rendered = renderCount;
+      }
+      
+      renderBlocks(context);
+      
+      std::lock_guard<std::mutex> lock(mutex);
+      
+      if (--busyWorkers == 0) {
+        renderFinished.notify_one();
+      }
+    }
+  }
+  
+  void Renderer::renderBlocks(Context *context) {
+    try {
+      for (uint64_t block = nextBlock++; block < blockCount; block = nextBlock++) {
+        auto offset = block * blockSamples;
+        auto count = (uint32_t)std::min<uint64_t>(blockSamples, sampleCount - offset);
+        auto samples = output + offset;
+        
+        // Write each sample's time in place, as the input rendered over.
+        for (uint32_t i = 0; i < count; ++i) {
+          samples[i] = (float)(startTime + double(offset + i) * timeStep);
+        }
+        
+        context->render(symbol, samples, samples, count);
+      }
+      
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      
+      if (!error) {
+        error = std::current_exception();
+      }
+      
+      // Leave no blocks for the other workers, so that they stop early.
+      nextBlock = blockCount;
+    }
+  }
+  
+  void Renderer::stopWorkers() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    
+    renderStarted.notify_all();
+    
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+}
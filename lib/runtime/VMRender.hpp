@@ -0,0 +1,125 @@
+#pragma once
+
+#include "VMEval.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vm {
+  /**
+   Offline Rendering
+   
+   A composition is a pure function of time, so any span of it can be rendered without
+   the others. The offline renderer splits the span being rendered into fixed-size blocks
+   and renders them on a pool of worker threads, each with its own Context (and so its own
+   stacks) sharing the one linked package. Workers are started with the renderer and wait
+   between renders, so rendering many short spans doesn't start a thread for each.
+   
+   Each block is rendered directly into its place in the output, so blocks are stitched
+   in order however they happen to be scheduled. Block boundaries depend only on the block
+   size, so the output is bit-identical whatever the # threads.
+   */
+  
+  // Thread count for Renderer, other than an explicit # threads: one per hardware thread.
+  unsigned const AutoThreadCount = 0;
+  
+  // # samples each worker renders at a time, by default. Large enough that scheduling a
+  // block costs little next to rendering it, and small enough to balance the load.
+  uint32_t const DefaultBlockSamples = 16384;
+  
+  // Renders spans of time from a package, in parallel.
+  //
+  // A renderer may only be used by one thread at a time. The package must outlive it.
+  class Renderer {
+  public:
+    //   package:      Linked package to evaluate (see vm::link).
+    //   threadCount:  # threads rendering blocks, including the thread calling render, or
+    //                 AutoThreadCount.
+    //   blockSamples: # samples in each block (rounded down to a whole vector slot).
+    //   dispatch:     Instruction dispatch strategy.
+    //   tileSamples:  # samples each worker evaluates at a time (see Context).
+    explicit Renderer(Package const *package, unsigned threadCount = AutoThreadCount, uint32_t blockSamples = DefaultBlockSamples, Dispatch dispatch = ThreadedDispatch, uint32_t tileSamples = AutoTileSize);
+    
+    // Stops and joins the workers.
+    ~Renderer();
+    
+    Renderer(Renderer const &) = delete;
+    Renderer &operator=(Renderer const &) = delete;
+    
+    // Render a function over a span of samples, writing the result to `output`.
+    //
+    // Sample i is rendered at time `startTime + i * timeStep`, computed in double precision
+    // then rounded, so that each sample's time is independent of the block it falls in.
+    // Throws the first error any worker encounters, once every worker has stopped.
+    //
+    //   symbol:      Name of function to execute.
+    //   startTime:   Time of the first sample.
+    //   timeStep:    Time between consecutive samples.
+    //   output:      Buffer receiving the result (sampleCount samples).
+    //   sampleCount: # samples to render.
+    void render(Symbol symbol, double startTime, double timeStep, float *output, uint64_t sampleCount);
+    
+    // # threads rendering blocks.
+    unsigned getThreadCount() const {
+      return (unsigned)contexts.size();
+    }
+    
+    // # samples in each block.
+    uint32_t getBlockSamples() const {
+      return blockSamples;
+    }
+    
+  private:
+    // Wait for each render, then render blocks with the worker's context until none remain.
+    void runWorker(Context *context);
+    
+    // Render blocks of the current render until none remain, recording the first error.
+    void renderBlocks(Context *context);
+    
+    // Stop the workers, and join those started.
+    void stopWorkers();
+    
+    uint32_t blockSamples;
+    
+    // Context for each worker, the first used by the thread calling render.
+    std::vector<std::unique_ptr<Context>> contexts;
+    
+    // Threads using the remaining contexts, in order.
+    std::vector<std::thread> workers;
+    
+    // Guards the fields below but `nextBlock`, which workers claim blocks from atomically.
+    std::mutex mutex;
+    
+    // Signals a new render (or stopping) to the workers, and the end of it to render.
+    std::condition_variable renderStarted;
+    std::condition_variable renderFinished;
+    
+    // # renders started, so that each worker takes part in each render once.
+    uint64_t renderCount = 0;
+    
+    // # workers yet to finish the current render.
+    size_t busyWorkers = 0;
+    
+    bool stopping = false;
+    
+    // First error encountered in the current render.
+    std::exception_ptr error;
+    
+    // The current render, written by render before starting it.
+    Symbol symbol;
+    double startTime = 0;
+    double timeStep = 0;
+    float *output = nullptr;
+    uint64_t sampleCount = 0;
+    uint64_t blockCount = 0;
+    
+    // Index of the next block to render, claimed by whichever worker is free first.
+    std::atomic<uint64_t> nextBlock;
+  };
+}
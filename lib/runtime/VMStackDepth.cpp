@@ -0,0 +1,170 @@
+#include "VMStackDepth.hpp"
+#include "VMAbstractEval.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace vm {
+  namespace {
+    struct DepthSlot {
+      bool strong;
+      
+      // True if the slot holds a known function address, so that CALL can follow it.
+      bool isAddress;
+      uint32_t address;
+      
+      // True if the slot holds a symbol not defined in the package.
+      bool isUndefined;
+      
+      bool operator==(DepthSlot const &rhs) const {
+        return strong == rhs.strong && isAddress == rhs.isAddress && address == rhs.address && isUndefined == rhs.isUndefined;
+      }
+    };
+    
+    // Tracks which slots are strong vector references, and records the most of each
+    // stack used. Values are otherwise unknown, so operands are never uniform.
+    class DepthAnalysis : public AbstractEval<DepthAnalysis, DepthSlot> {
+    public:
+      // Begin with the input vector, as pushed by Context.
+      DepthAnalysis(Package const *package, Symbol symbol, uint32_t entry)
+      : AbstractEval(package, symbol, entry, {true, false, 0, false})
+      , depth{1, 1, 0} {
+      }
+      
+      StackDepth depth;
+      
+      void push(DepthSlot slot) {
+        stack.push_back(slot);
+        vectors += slot.strong;
+        
+        depth.scalars = std::max(depth.scalars, (uint32_t)stack.size());
+        depth.vectors = std::max(depth.vectors, vectors);
+        
+        if (depth.scalars > MaxStackDepth) tooDeep("scalar slots");
+        if (depth.vectors > MaxStackDepth) tooDeep("vectors");
+      }
+      
+      void pop(uint32_t count) {
+        for (; count > 0 && !stack.empty(); --count) {
+          vectors -= stack.back().strong;
+          stack.pop_back();
+        }
+      }
+      
+      DepthSlot at(uint32_t offset) const {
+        return (offset > 0 && offset <= stack.size()) ? stack[stack.size() - offset] : DepthSlot{false, false, 0, false};
+      }
+      
+      DepthSlot get(uint32_t offset, bool isVector) const {
+        return at(offset);
+      }
+      
+      DepthSlot constant(uint32_t value) const {
+        return {false, true, value, false};
+      }
+      
+      DepthSlot linkedSymbol(Symbol name) const {
+        auto hit = package->symbols.find(name);
+        return hit == package->symbols.end() ? DepthSlot{false, false, 0, true} : DepthSlot{false, true, hit->second, false};
+      }
+      
+      DepthSlot copy(DepthSlot slot) const {
+        return {false, slot.isAddress, slot.address, slot.isUndefined};
+      }
+      
+      DepthSlot reference(DepthSlot slot) const {
+        return {false, false, 0, false};
+      }
+      
+      // Conservatively assume the dropped value is a new vector, which it may be if it
+      // needed copying. Likewise for uniform results, which don't allocate, and never
+      // lead to operations using more vectors than they would if they did.
+      DepthSlot dropVector(DepthSlot slot) const {
+        return {true, false, 0, false};
+      }
+      
+      bool isUniform(DepthSlot slot) const {
+        return false;
+      }
+      
+      void pushResult(bool isVector, bool isUniform) {
+        push({isVector, false, 0, false});
+      }
+      
+      // The result reuses the top operand's vector.
+      void collapse(uint32_t count) {
+        pop(count);
+        push({true, false, 0, false});
+      }
+      
+      void lookUp(DepthSlot table) {
+      }
+      
+      // Addresses passed in by callers are followed when analysing the callers.
+      bool callTarget(DepthSlot target, uint32_t *address) const {
+        *address = target.address;
+        return !target.isUndefined && target.isAddress && target.address < package->code.size();
+      }
+      
+      void enteredCall() {
+        depth.calls = std::max(depth.calls, (uint32_t)frames.size());
+        if (depth.calls > MaxStackDepth) tooDeep("call frames");
+      }
+      
+      void exited() {
+      }
+      
+      [[noreturn]] void fail(std::string const &reason) const {
+        auto err = std::stringstream() << "Can't bound stack depth: `" << symbol << "` at instruction " << instPtr << ": " << reason;
+        throw std::runtime_error(err.str());
+      }
+      
+    private:
+      [[noreturn]] void tooDeep(char const *what) const {
+        auto err = std::stringstream() << "Stack too deep: `" << symbol << "` uses more than " << MaxStackDepth << " " << what;
+        throw std::runtime_error(err.str());
+      }
+    };
+  }
+  
+  bool computeStackDepth(Package const *package, Symbol symbol, StackDepth *result) {
+    auto entry = package->symbols.find(symbol);
+    
+    if (entry == package->symbols.end()) {
+      auto err = std::stringstream() << "Undefined symbol: `" << symbol << "`";
+      throw std::runtime_error(err.str());
+    }
+    
+    DepthAnalysis analysis(package, symbol, entry->second);
+    
+    if (!analysis.run()) {
+      return false;
+    }
+    
+    *result = analysis.depth;
+    return true;
+  }
+  
+  bool stackDepth(Package const *package, Symbol symbol, StackDepth *depth) {
+    auto stored = package->stackDepths.find(symbol);
+    
+    if (stored != package->stackDepths.end()) {
+      *depth = stored->second;
+      return true;
+    }
+    
+    return computeStackDepth(package, symbol, depth);
+  }
+  
+  StackDepth stackDepth(Package const *package, Symbol symbol) {
+    StackDepth depth;
+    
+    if (!stackDepth(package, symbol, &depth)) {
+      auto err = std::stringstream() << "Can't bound stack depth: `" << symbol << "` calls an undefined symbol or an address passed to it";
+      throw std::runtime_error(err.str());
+    }
+    
+    return depth;
+  }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Instruction.hpp"
+#include "Symbol.hpp"
+
+#include <cstdint>
+
+namespace vm {
+  /**
+   Stack Depth Analysis
+   
+   The analysis follows every path through a function (see VMAbstractEval.hpp), recording
+   only which scalar slots are strong vector references (and which hold function
+   addresses, so that calls can be followed).
+   
+   Functions whose depth can't be bounded are rejected rather than risk overflowing a
+   stack during evaluation: usage beyond MaxStackDepth, and code that doesn't exit within
+   MaxStackDepthSteps instructions (for example, recursion).
+   
+   A function calling an address it doesn't push itself, such as a function-typed
+   parameter, can't be analysed on its own. It is analysed as part of each function
+   calling it, where the address is known.
+   */
+  
+  // Largest # scalar slots, vectors or call frames a function may use.
+  uint32_t const MaxStackDepth = 16 * 1024;
+  
+  // Largest # instructions followed when analysing a function.
+  size_t const MaxStackDepthSteps = 1 << 22;
+  
+  // Analyse the stack usage of the function named `symbol` into `depth`.
+  //
+  // Returns false if the function calls a symbol that isn't defined in the package, so
+  // can't be analysed until it's linked, or calls an address it doesn't push, so can only
+  // be analysed from its callers. Throws if its stack usage can't be bounded.
+  bool computeStackDepth(Package const *package, Symbol symbol, StackDepth *depth);
+  
+  // Find the stack usage of the function named `symbol`, as stored in the package if the
+  // compiler computed it, otherwise by analysing it. Returns false as computeStackDepth
+  // does, and throws if it can't be bounded.
+  bool stackDepth(Package const *package, Symbol symbol, StackDepth *depth);
+  
+  // Return the stack usage of the function named `symbol`. Throws if it can't be bounded,
+  // or can't be analysed on its own.
+  StackDepth stackDepth(Package const *package, Symbol symbol);
+}
@@ -1,6 +1,11 @@
 #pragma once
 
 #include "Data.hpp"
+#include "Instruction.hpp"
+
+#include <cassert>
+#include <sstream>
+#include <stdexcept>
 
 namespace vm {
   /**
@@ -10,14 +15,14 @@ namespace vm {
    internal state.
    
    The VM is stack-based and maintains two separate stacks:
-  
+      
       * The SCALAR STACK holds typed fixed-size (8 byte) slots.
         Slots have 4 bytes available for type information and metadata, and 4 bytes for the
         data payload.
-   
+        
       * The VECTOR STACK has variable-sized, cache-aligned slots containing raw binary data.
         Slots are sized by the current frame size.
-   
+        
    This distinction is isolated from instruction execution. The Execution environment interacts
    only with the scalar stack directly -- From its point of view, the vector stack functions
    like a reference-counted heap.
@@ -27,8 +32,22 @@ namespace vm {
    slot. When a strong reference to a vector buffer is popped from the stack, its corresponding
    vector slot is popped.
    
-   The VM should therefore preserve the following invariants:
+   Vectors with the same value in every sample (such as those produced by FILL) are held as
+   UNIFORM slots instead, with the value in the payload and no vector slot. Operations on them
+   take the scalar variant of their kernel, or produce another uniform slot without touching
+   the vector stack.
+   
+   Operations may also skip their kernel depending on their operands' values (for example,
+   multiplying by zero, or adding it). Their result is then uniform, or a reference to the
+   vector operand, where a new vector would otherwise be allocated. Either only ever frees
+   vector slots, and operations in place allocate their result if their top operand turns
+   out not to be a strong reference.
+   
+   Function calls do not recurse into the evaluation loop. Instead, the state of the calling
+   function is saved to a fixed-size CALL STACK and restored when the callee exits.
    
+   The VM should therefore preserve the following invariants:
+      
       1) Vector slots are have exactly one strong reference.
       2) No weak references to a vector exist below the vector's strong reference.
       3) Scalar slots are always popped in LIFO order.
@@ -39,7 +58,10 @@ namespace vm {
   enum SlotType : uint8_t {
     StrongVecRef,
     WeakVecRef,
-    ScalarFP
+    ScalarFP,
+    
+    // Vector with the payload's value in every sample, without a vector slot.
+    UniformVec
   };
   
   
@@ -67,16 +89,44 @@ namespace vm {
   };
   
   
+  // Saved state of a calling function, restored when the callee exits.
+  struct CallFrame {
+    // Instruction to resume the caller at.
+    uint32_t returnAddress;
+    
+    // Caller's offset applied to popping instructions (set by RET).
+    uint32_t resultOffset;
+    
+    // # values the caller pops from the stack when it returns.
+    uint32_t popCount;
+  };
+  
+  
   // VM state interface
-  class VMState {
+  //
+  // Checked states assert the invariants above on every operation, and check for call stack
+  // overflow. Unchecked states skip all of these checks, so may only evaluate code proven to
+  // preserve the invariants (see vm::verify) using stacks large enough for it (see
+  // vm::stackDepth).
+  template <bool Checked>
+  class BasicVMState {
   public:
-    VMState(ScalarStackSlot *scalarStack_, uint32_t scalarStackTop_,
+    BasicVMState(ScalarStackSlot *scalarStack_, uint32_t scalarStackTop_,
             VectorStackSlot *vectorStack_, uint32_t vectorStackTop_,
-            uint32_t sampleCount_)
+            CallFrame *callStack_, uint32_t callStackSize_,
+            uint32_t sampleCount_,
+            Table const *tables_ = nullptr, uint32_t tableCount_ = 0)
     : vectorStack(vectorStack_)
     , stack(scalarStack_)
+    , callStack(callStack_)
+    , tables(tables_)
+    , callStackSize(callStackSize_)
+    , tableCount(tableCount_)
+    , callDepth(0)
+    , samples(sampleCount_)
     , vectorStackTop(vectorStackTop_)
-    , stackSize(scalarStackTop_) {
+    , stackSize(scalarStackTop_)
+    , skippedOps(0) {
       frameSlots = (sampleCount_ % VectorStackSlot::SampleCount == 0)
       ? sampleCount_ / VectorStackSlot::SampleCount
       : sampleCount_ / VectorStackSlot::SampleCount + 1
@@ -87,8 +137,8 @@ namespace vm {
     // and return the reference.
     ScalarStackSlot alloc();
     
-    // Push a weak reference to the buffer referenced by `ref` onto the stack
-    // and return the reference.
+    // Return a weak reference to the buffer referenced by `ref`, or `ref` itself if it
+    // is uniform.
     ScalarStackSlot reference(ScalarStackSlot ref);
     
     // Obtain a pointer to the vector buffer referenced by `ref`
@@ -110,11 +160,48 @@ namespace vm {
     // Pop n slots from the top (and any strongly referenced vectors)
     void pop(uint32_t count);
     
+    // True if the vector referenced by `ref` hasn't been popped.
+    bool isAllocated(ScalarStackSlot ref) const {
+      return ref.payload.u32 < vectorStackTop;
+    }
+    
+    // Replace the top n slots with the top slot, keeping the vector it references.
+    // The top slot must be the only strong reference among them.
+    void collapse(uint32_t count);
+    
+    // Save the calling function's state before entering a function.
+    // Throws if the call stack is full (if checked).
+    void pushFrame(CallFrame frame);
+    
+    // Restore the state of the calling function into `frame` when exiting a function.
+    // Returns false if the exiting function is the entry point.
+    bool popFrame(CallFrame *frame);
+    
+    // Return the package table at `index`.
+    // Throws if there is no such table (if checked).
+    Table const &table(uint32_t index);
+    
     // Return the length (in # of samples) of vectors in the current frame.
     uint64_t frameSamples() const {
       return frameSlots * VectorStackSlot::SampleCount;
     }
     
+    // Return the # samples being evaluated. Vectors are padded beyond these to a whole
+    // number of slots, with arbitrary values, so only these may decide a test of a vector.
+    uint32_t sampleCount() const {
+      return samples;
+    }
+    
+    // Record that an operation skipped its pass over a vector.
+    void countSkipped() {
+      ++skippedOps;
+    }
+    
+    // # operations that skipped their pass over a vector.
+    uint64_t getSkippedOps() const {
+      return skippedOps;
+    }
+    
   private:
     // Pop the vector referenced by `data`
     void dealloc(ScalarStackSlot data);
@@ -125,6 +212,24 @@ namespace vm {
     // Base of the scalar stack.
     ScalarStackSlot *stack;
     
+    // Base of the call stack.
+    CallFrame *callStack;
+    
+    // Tables of the package being evaluated.
+    Table const *tables;
+    
+    // Capacity of the call stack.
+    uint32_t callStackSize;
+    
+    // # tables of the package being evaluated.
+    uint32_t tableCount;
+    
+    // Current call stack index.
+    uint32_t callDepth;
+    
+    // # samples being evaluated.
+    uint32_t samples;
+    
     // Number of vector slots in a vector in the current frame.
     // Equal to # samples / vector slot size
     uint32_t frameSlots;
@@ -134,20 +239,29 @@ namespace vm {
     
     // Current vector stack index (in vector slots)
     uint32_t vectorStackTop;
+    
+    // # operations that skipped their pass over a vector.
+    uint64_t skippedOps;
   };
   
+  typedef BasicVMState<true> VMState;
+  typedef BasicVMState<false> UncheckedVMState;
   
-  ScalarStackSlot &VMState::get(uint32_t offset) {
+  
+  template <bool Checked>
+  inline ScalarStackSlot &BasicVMState<Checked>::get(uint32_t offset) {
     return stack[stackSize - offset];
   }
   
-  void VMState::push(ScalarStackSlot data) {
+  template <bool Checked>
+  inline void BasicVMState<Checked>::push(ScalarStackSlot data) {
     stack[stackSize] = data;
     ++stackSize;
   }
   
-  void VMState::pop() {
-    assert(stackSize != 0);
+  template <bool Checked>
+  inline void BasicVMState<Checked>::pop() {
+    assert(!Checked || stackSize != 0);
     
     --stackSize;
     
@@ -156,19 +270,36 @@ namespace vm {
     }
   }
   
-  void VMState::pop(uint32_t count) {
+  template <bool Checked>
+  inline void BasicVMState<Checked>::pop(uint32_t count) {
     while (count > 0) {
       --count;
       pop();
     }
   }
   
-  uint32_t VMState::stackTop() {
+  template <bool Checked>
+  inline void BasicVMState<Checked>::collapse(uint32_t count) {
+    if (Checked) {
+      assert(stack[stackSize - 1].type == StrongVecRef);
+      
+      for (uint32_t i = 2; i <= count; ++i) {
+        assert(stack[stackSize - i].type != StrongVecRef);
+      }
+    }
+    
+    stack[stackSize - count] = stack[stackSize - 1];
+    stackSize -= count - 1;
+  }
+  
+  template <bool Checked>
+  inline uint32_t BasicVMState<Checked>::stackTop() {
     return stackSize - 1;
   }
   
   
-  ScalarStackSlot VMState::alloc() {
+  template <bool Checked>
+  inline ScalarStackSlot BasicVMState<Checked>::alloc() {
     ScalarStackSlot ref;
     ref.type = StrongVecRef;
     ref.payload.u32 = vectorStackTop;
@@ -179,23 +310,62 @@ namespace vm {
     return ref;
   }
   
-  void VMState::dealloc(ScalarStackSlot ref) {
-    assert(ref.type == StrongVecRef);
-    assert(vectorStackTop - frameSlots == ref.payload.u32);
+  template <bool Checked>
+  inline void BasicVMState<Checked>::dealloc(ScalarStackSlot ref) {
+    assert(!Checked || ref.type == StrongVecRef);
+    assert(!Checked || vectorStackTop - frameSlots == ref.payload.u32);
     
     vectorStackTop -= frameSlots;
   }
   
-  ScalarStackSlot VMState::reference(ScalarStackSlot ref) {
-    assert(ref.type == StrongVecRef || ref.type == WeakVecRef);
+  template <bool Checked>
+  inline ScalarStackSlot BasicVMState<Checked>::reference(ScalarStackSlot ref) {
+    assert(!Checked || ref.type != ScalarFP);
     
-    return {WeakVecRef, ref.payload};
+    return {ref.type == UniformVec ? UniformVec : WeakVecRef, ref.payload};
   }
   
-  Data::Value *VMState::dereference(ScalarStackSlot ref) {
-    assert(ref.type == StrongVecRef || ref.type == WeakVecRef);
-    assert(vectorStackTop - frameSlots == ref.payload.u32);
+  template <bool Checked>
+  inline Data::Value *BasicVMState<Checked>::dereference(ScalarStackSlot ref) {
+    // The vector needn't be the top one, or even still allocated: operations may read
+    // their operands after popping them, as long as they do so before writing results.
+    assert(!Checked || ref.type == StrongVecRef || ref.type == WeakVecRef);
     
     return (Data::Value *)(vectorStack + ref.payload.u32);
   }
+  
+  
+  template <bool Checked>
+  inline Table const &BasicVMState<Checked>::table(uint32_t index) {
+    if (Checked && index >= tableCount) {
+      auto err = std::stringstream() << "Undefined table (index: " << index << ")";
+      throw std::runtime_error(err.str());
+    }
+    
+    return tables[index];
+  }
+  
+  
+  template <bool Checked>
+  inline void BasicVMState<Checked>::pushFrame(CallFrame frame) {
+    if (Checked && callDepth == callStackSize) {
+      auto err = std::stringstream() << "Call stack overflow (depth: " << callDepth << ")";
+      throw std::runtime_error(err.str());
+    }
+    
+    callStack[callDepth] = frame;
+    ++callDepth;
+  }
+  
+  template <bool Checked>
+  inline bool BasicVMState<Checked>::popFrame(CallFrame *frame) {
+    if (callDepth == 0) {
+      return false;
+    }
+    
+    --callDepth;
+    *frame = callStack[callDepth];
+    
+    return true;
+  }
 }
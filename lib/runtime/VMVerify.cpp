@@ -0,0 +1,198 @@
+#include "VMVerify.hpp"
+#include "VMAbstractEval.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+namespace vm {
+  namespace {
+    struct VerifySlot {
+      SlotType type;
+      
+      // Index of the referenced vector (counted in vectors from the bottom of the vector
+      // stack), or the value of a scalar pushed by PUSH.
+      uint32_t value;
+      
+      // True if the slot holds a value pushed by PUSH, so may be a call target.
+      bool isPushed;
+      
+      bool operator==(VerifySlot const &rhs) const {
+        return type == rhs.type && value == rhs.value && isPushed == rhs.isPushed;
+      }
+    };
+    
+    // Tracks the type of each slot and the vector each reference refers to, failing on the
+    // first instruction that breaks an invariant.
+    class Verifier : public AbstractEval<Verifier, VerifySlot> {
+    public:
+      // Begin with the input vector, as pushed by Context.
+      Verifier(Package const *package, Symbol symbol, uint32_t entry)
+      : AbstractEval(package, symbol, entry, {StrongVecRef, 0, false}) {
+      }
+      
+      void push(VerifySlot slot) {
+        stack.push_back(slot);
+        vectors += slot.type == StrongVecRef;
+      }
+      
+      void pop(uint32_t count) {
+        if (count > stack.size()) {
+          fail("pops below the bottom of the stack");
+        }
+        
+        for (; count > 0; --count) {
+          auto slot = stack.back();
+          stack.pop_back();
+          
+          if (slot.type != StrongVecRef) {
+            continue;
+          }
+          
+          if (slot.value != vectors - 1) {
+            fail("pops vectors out of order");
+          }
+          
+          --vectors;
+          
+          for (auto other : stack) {
+            if (other.type == WeakVecRef && other.value == slot.value) {
+              fail("pops a vector that is still referenced");
+            }
+          }
+        }
+      }
+      
+      VerifySlot at(uint32_t offset) const {
+        if (offset == 0 || offset > stack.size()) {
+          fail("operand outside the stack");
+        }
+        
+        return stack[stack.size() - offset];
+      }
+      
+      // Slot n-th from the top (1 is the top), which must be a vector reference or a scalar.
+      VerifySlot get(uint32_t offset, bool isVector) const {
+        auto slot = at(offset);
+        
+        if ((slot.type != ScalarFP) != isVector) {
+          fail(isVector ? "expected a vector operand" : "expected a scalar operand");
+        }
+        
+        return slot;
+      }
+      
+      VerifySlot constant(uint32_t value) const {
+        return {ScalarFP, value, true};
+      }
+      
+      VerifySlot linkedSymbol(Symbol name) const {
+        fail("unlinked symbol");
+      }
+      
+      VerifySlot copy(VerifySlot slot) const {
+        if (slot.type == StrongVecRef) {
+          fail("copies a strong reference");
+        }
+        
+        return slot;
+      }
+      
+      VerifySlot reference(VerifySlot slot) const {
+        return slot.type == UniformVec ? slot : VerifySlot{WeakVecRef, slot.value, false};
+      }
+      
+      VerifySlot dropVector(VerifySlot slot) const {
+        if (slot.type == UniformVec) {
+          return slot;
+        }
+        
+        if (slot.value < vectors) {
+          return {WeakVecRef, slot.value, false};
+        }
+        
+        return {StrongVecRef, vectors, false};
+      }
+      
+      bool isUniform(VerifySlot slot) const {
+        return slot.type == UniformVec;
+      }
+      
+      // Push the result of an operation, which is uniform if all its vector operands are.
+      void pushResult(bool isVector, bool isUniform) {
+        if (!isVector) {
+          push({ScalarFP, 0, false});
+          
+        } else if (isUniform) {
+          push({UniformVec, 0, false});
+          
+        } else {
+          push({StrongVecRef, vectors, false});
+        }
+      }
+      
+      // Replace the top n slots with the top slot, as VMState::collapse.
+      void collapse(uint32_t count) {
+        auto top = stack.back();
+        
+        if (top.type != StrongVecRef) {
+          fail("operates in place on a vector it doesn't own");
+        }
+        
+        for (uint32_t i = 2; i <= count; ++i) {
+          if (stack[stack.size() - i].type == StrongVecRef) {
+            fail("drops a strong reference in place");
+          }
+        }
+        
+        stack.resize(stack.size() - count);
+        stack.push_back(top);
+      }
+      
+      void lookUp(VerifySlot table) const {
+        if (!table.isPushed || table.value >= package->tables.size()) {
+          fail("looks up an unknown table");
+        }
+        
+        // Lookups wrap indices with a mask of the table's size.
+        auto size = package->tables[table.value].samples.size();
+        if (size == 0 || (size & (size - 1)) != 0) {
+          fail("looks up a table whose size isn't a power of two");
+        }
+      }
+      
+      bool callTarget(VerifySlot target, uint32_t *address) const {
+        if (!target.isPushed || target.value >= package->code.size()) {
+          fail("calls an unknown address");
+        }
+        
+        *address = target.value;
+        return true;
+      }
+      
+      void enteredCall() {
+      }
+      
+      void exited() const {
+        if (stack.size() != 1 || (stack[0].type != StrongVecRef && stack[0].type != UniformVec)) {
+          fail("doesn't return a vector in place of its input");
+        }
+      }
+      
+      [[noreturn]] void fail(std::string const &reason) const {
+        auto err = std::stringstream() << "Invalid code in `" << symbol << "` at instruction " << instPtr << ": " << reason;
+        throw std::runtime_error(err.str());
+      }
+    };
+  }
+  
+  void verify(Package const *package, Symbol symbol) {
+    auto entry = package->symbols.find(symbol);
+    
+    if (entry == package->symbols.end()) {
+      auto err = std::stringstream() << "Undefined symbol: `" << symbol << "`";
+      throw std::runtime_error(err.str());
+    }
+    
+    Verifier(package, symbol, entry->second).run();
+  }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Instruction.hpp"
+#include "Symbol.hpp"
+
+namespace vm {
+  /**
+   Bytecode Verification
+   
+   Proves that evaluating a function preserves the invariants documented in VMState.hpp,
+   so that it can be evaluated without checking them (see UncheckedVMState).
+   
+   As with stack depth analysis, the verifier follows every path through the code exactly
+   as evaluation would (see VMAbstractEval.hpp), tracking the type of each scalar slot (including which vectors
+   are uniform because they were filled) and which vector each reference refers to.
+   Evaluation may make further results uniform, or references to an operand, depending
+   on their values (see VMState.hpp). This only ever frees vectors, so it preserves
+   what the verifier proves. It checks that:
+      
+      * Every operand is on the stack and has the type its instruction expects.
+      * Strong references are never copied, so each vector has exactly one.
+      * Vectors are popped in LIFO order, and no references to them remain when they are.
+      * Operations in place own the vector they write to.
+      * Calls target addresses pushed by the code.
+      * Jumps land within the code, further on.
+   */
+  
+  // Verify the function named `symbol` in a linked package, evaluated against a vector
+  // input as Context does. Throws describing the first violation found.
+  void verify(Package const *package, Symbol symbol);
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
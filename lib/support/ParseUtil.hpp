@@ -4,6 +4,9 @@
 #include "Symbol.hpp"
 
 #include <experimental/optional>
+#include <climits>
+#include <cstring>
+#include <memory>
 #include <functional>
 #include <string>
 #include <sstream>
@@ -34,8 +37,11 @@ namespace parse {
   
   
   // Represents the current parse state.
+  //
+  // States are trivially copyable (the error list lives in the arena), which
+  // keeps GCC's handling of `?:` on parse results well defined.
   struct State {
-    typedef std::shared_ptr<std::vector<std::string>> ErrorList;
+    typedef Arena::vector<Arena::string> *ErrorList;
     ErrorList errors;
     Arena::string const *input;
     size_t offset;
@@ -59,8 +65,8 @@ namespace parse {
       return State(string, arena, 0);
     }
     
-    State(Arena::string const *input_, Arena *arena_, size_t offset_, ErrorList errors_ = std::make_shared<std::vector<std::string>>())
-    : errors(errors_)
+    State(Arena::string const *input_, Arena *arena_, size_t offset_, ErrorList errors_ = nullptr)
+    : errors(errors_ ?: arena_->create<Arena::vector<Arena::string>>(arena_->allocator<Arena::string>()))
     , input(input_)
     , offset(offset_)
     , arena(arena_)
@@ -131,7 +137,14 @@ namespace parse {
       return true;
       
     } else {
-      if (errors) *errors = *state.errors;
+      if (errors) {
+        errors->clear();
+        
+        for (auto &err : *state.errors) {
+          errors->push_back(std::string(err.begin(), err.end()));
+        }
+      }
+      
       return false;
     }
   }
@@ -156,8 +169,13 @@ namespace parse {
   }
   
   namespace operators {
+    // Resolves only for character set types, so that the operators below don't
+    // capture unrelated overloads (such as those for std::ios flags).
+    template <typename T>
+    using CharSet = decltype(std::declval<T const &>()(char()));
+    
     // Union of lhs & rhs character sets
-    template <typename LHS, typename RHS>
+    template <typename LHS, typename RHS, typename = CharSet<LHS>, typename = CharSet<RHS>>
     auto operator||(const LHS &lhs, const RHS &rhs) {
       return [=](char chr) -> bool {
         return lhs(chr) || rhs(chr);
@@ -165,7 +183,7 @@ namespace parse {
     }
     
     // Inverse character set
-    template <typename LHS>
+    template <typename LHS, typename = CharSet<LHS>>
     auto operator!(const LHS &lhs) {
       return [=](char chr) -> bool {
         return !lhs(chr);
@@ -173,7 +191,7 @@ namespace parse {
     }
     
     // Intersection character set
-    template <typename LHS, typename RHS>
+    template <typename LHS, typename RHS, typename = CharSet<LHS>, typename = CharSet<RHS>>
     auto operator&&(const LHS &lhs, const RHS &rhs) {
       return [=](char chr) -> bool {
         return lhs(chr) && rhs(chr);
@@ -325,7 +343,7 @@ namespace parse {
   // Inject a side-effect into a sequence of parsers.
   template <typename Fn>
   auto inject(Fn const &fn) {
-    return [&](State const &state) -> Result {
+    return [=](State const &state) -> Result {
       fn();
       return state;
     };
@@ -348,7 +366,7 @@ namespace parse {
     err << "Parse error (line " << state.lineNo() << "):\n"
     << "expected " << msg;
     
-    state.errors->push_back(err.str());
+    state.errors->push_back(Arena::string(err.str().c_str(), state.allocator<char>()));
     return reject;
   }
   
@@ -587,6 +605,27 @@ namespace parse {
     };
   }
   
+  // A real number with an optional leading minus sign, for serialized values. Source
+  // code uses `real`, since it parses `-` as an operator.
+  template <typename T = double, typename Action>
+  auto signedReal(Action const &out) {
+    using namespace parse::operators;
+    
+    return [=](State const &state) -> Result {
+      T sign = 1;
+      T magnitude = 0;
+      
+      auto minus = [&](State const &state) -> Result {
+        return state >> match("-") >> inject([&](){ sign = -1; });
+      };
+      
+      return state
+      >> optional(minus)
+      >> real<T>(receive(&magnitude))
+      >> inject([&](){ out(sign * magnitude); });
+    };
+  }
+  
   template <typename T = int64_t, typename Action>
   auto integer(Action const &out) {
     using namespace parse::operators;
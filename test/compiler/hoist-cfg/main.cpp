@@ -0,0 +1,83 @@
+#include "SerializeCFG.hpp"
+#include "HoistCFG.hpp"
+#include "GivenExpectTest.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// The hoisted package, followed by the report printed for it.
+struct Hoisted {
+  cfg::Package package;
+  
+  // Lines of the report without surrounding whitespace. Functions are reported in the
+  // package's (unordered) order, so lines are sorted.
+  std::vector<std::string> report;
+  
+  bool operator!=(Hoisted const &rhs) const {
+    return !(package == rhs.package) || report != rhs.report;
+  }
+};
+
+std::vector<std::string> reportLines(std::string const &text) {
+  std::vector<std::string> lines;
+  std::stringstream str(text);
+  std::string line;
+  
+  while (std::getline(str, line)) {
+    auto begin = line.find_first_not_of(" \t");
+    
+    if (begin != std::string::npos) {
+      lines.push_back(line.substr(begin, line.find_last_not_of(" \t") + 1 - begin));
+    }
+  }
+  
+  std::sort(lines.begin(), lines.end());
+  return lines;
+}
+
+std::ostream &operator<<(std::ostream &str, Hoisted const &hoisted) {
+  str << hoisted.package << std::endl << "@report:" << std::endl;
+  
+  for (auto &line : hoisted.report) {
+    str << "  " << line << std::endl;
+  }
+  
+  return str;
+}
+
+// Expected packages are followed by `@report:` and the report, up to the end of the file.
+parse::Grammar hoisted(parse::GenericAction<Hoisted> out) {
+  using namespace parse;
+  
+  return [=](State const &state) -> Result {
+    std::unique_ptr<cfg::Package> package;
+    std::string report;
+    
+    auto result = state
+    >> cfg::unserialize::package(receivePointerValue(&package))
+    >> optionalWhitespace
+    >> requiredMatch("@report:")
+    >> optional(repeat(match([](char) { return true; }, [&](char chr) { report += chr; })))
+    ;
+    
+    if (result) {
+      out({*package, reportLines(report)});
+    }
+    
+    return result;
+  };
+}
+
+int main(int argc, char const *const *argv) {
+  Arena arena;
+  
+  return givenExpectTest(argc, argv, cfg::unserialize::package, hoisted, [&](cfg::Package package) -> Hoisted {
+    auto report = compiler::hoistCFG(&arena, &package);
+    
+    std::stringstream str;
+    str << report;
+    
+    return {package, reportLines(str.str())};
+  });
+}
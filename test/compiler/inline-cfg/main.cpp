@@ -0,0 +1,12 @@
+#include "SerializeCFG.hpp"
+#include "InlineCFG.hpp"
+#include "GivenExpectTest.hpp"
+
+int main(int argc, char const *const *argv) {
+  Arena arena;
+  
+  return givenExpectTest(argc, argv, cfg::unserialize::package, cfg::unserialize::package, [&](cfg::Package package) -> cfg::Package {
+    compiler::inlineCFG(&arena, &package);
+    return package;
+  });
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "ParseUtil.hpp"
+
+template <typename T>
+using Parser = parse::Grammar(*)(parse::GenericAction<T>);
+
+// Time each named variant of an evaluation function against each example file.
+//
+// Example files use the same format as `evalTest`. The expect clause is ignored.
+//
+//   iterations:  Number of times each variant is evaluated per example.
+//   variants:    List of (name, prepare) pairs. `prepare` accepts the given value and
+//                returns a function evaluating it with the with value. Only calls to
+//                the returned function are timed.
+template <typename GivenValue, typename ParamValue, typename Variant>
+int evalBenchmark(int argc, char const *const *argv, Parser<GivenValue> given, Parser<ParamValue> params, size_t iterations, std::vector<std::pair<char const *, Variant>> const &variants) {
+  using std::unique_ptr;
+  using namespace parse;
+  using Clock = std::chrono::steady_clock;
+  
+  std::vector<char const *> args(argv + 1, argv + argc);
+  std::vector<double> totals(variants.size(), 0);
+  
+  for (auto filepath : args) {
+    Arena arena;
+    unique_ptr<GivenValue> givenVal;
+    unique_ptr<ParamValue> paramVal;
+    
+    auto parseTest = [&](State const &state) -> Result {
+      return state
+      >> optionalWhitespace
+      >> requiredMatch("@given:") >> require("given clause value", optionalWhitespace >> given(receivePointerValue(&givenVal))) >> optionalWhitespace
+      >> requiredMatch("@with:") >> require("with clause value", optionalWhitespace >> params(receivePointerValue(&paramVal))) >> optionalWhitespace
+      >> requiredMatch("@expect:") >> repeat(match(range(0x01, CHAR_MAX)))
+      ;
+    };
+    
+    std::ifstream input(filepath);
+    std::vector<std::string> errors;
+    
+    if (!read(input, &arena, parseTest, &errors)) {
+      std::cout << "FAILED: " << filepath << std::endl
+      << "Invalid input representation" << std::endl;
+      
+      for (auto x : errors) std::cout << x << std::endl;
+      
+      return 1;
+    }
+    
+    std::cout << filepath << std::endl;
+    
+    for (size_t i = 0; i < variants.size(); ++i) {
+      auto &variant = variants[i];
+      auto evaluate = variant.second(*givenVal);
+      auto start = Clock::now();
+      
+      for (size_t n = 0; n < iterations; ++n) {
+        evaluate(*paramVal);
+      }
+      
+      std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+      auto nsPerEval = elapsed.count() / iterations;
+      totals[i] += nsPerEval;
+      
+      std::cout << "  " << std::setw(12) << std::left << variant.first
+      << std::setw(10) << std::right << std::fixed << std::setprecision(1) << nsPerEval << " ns/eval" << std::endl;
+    }
+  }
+  
+  std::cout << std::endl << "Total" << std::endl;
+  
+  for (size_t i = 0; i < variants.size(); ++i) {
+    std::cout << "  " << std::setw(12) << std::left << variants[i].first
+    << std::setw(10) << std::right << std::fixed << std::setprecision(1) << totals[i] << " ns/eval" << std::endl;
+  }
+  
+  return 0;
+}
@@ -0,0 +1,46 @@
+#include "VMRender.hpp"
+#include "VMLink.hpp"
+#include "SerializeInstruction.hpp"
+#include "SerializeData.hpp"
+#include "EvalTest.hpp"
+
+#include <cstring>
+
+int main(int argc, char const *const *argv) {
+  using vm::unserialize::package;
+  using vm::unserialize::data;
+  
+  // The span to render is given as {startTime timeStep sampleCount}.
+  return evalTest(argc, argv, package, data, data, [](vm::Package package, vm::Data const &params) {
+    Arena arena;
+    auto linked = vm::link(&package, &arena);
+    
+    auto startTime = params.values[0].f32;
+    auto timeStep = params.values[1].f32;
+    auto sampleCount = (uint32_t)params.values[2].f32;
+    
+    // Render with one thread, then check that every other thread count and block size
+    // (including blocks ending part way through the span) renders exactly the same.
+    vm::Data result(vm::Data::F32Value, sampleCount);
+    vm::Renderer(&linked, 1).render(Symbol::get("main"), startTime, timeStep, (float *)result.values.data(), sampleCount);
+    
+    // Each renderer renders twice, to check that its workers can be reused.
+    for (unsigned threadCount : {2u, 3u, 8u}) {
+      for (uint32_t blockSamples : {1u, 48u, vm::DefaultBlockSamples}) {
+        vm::Renderer renderer(&linked, threadCount, blockSamples);
+        
+        for (int i = 0; i < 2; ++i) {
+          vm::Data other(vm::Data::F32Value, sampleCount);
+          renderer.render(Symbol::get("main"), startTime, timeStep, (float *)other.values.data(), sampleCount);
+          
+          if (memcmp(other.values.data(), result.values.data(), sampleCount * sizeof(float)) != 0) {
+            auto err = std::stringstream() << "Rendering with " << threadCount << " threads in blocks of " << blockSamples << " samples changed the result";
+            throw std::runtime_error(err.str());
+          }
+        }
+      }
+    }
+    
+    return result;
+  });
+}
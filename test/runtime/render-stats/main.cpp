@@ -0,0 +1,26 @@
+#include "VMEval.hpp"
+#include "VMLink.hpp"
+#include "SerializeInstruction.hpp"
+#include "SerializeData.hpp"
+#include "EvalTest.hpp"
+
+int main(int argc, char const *const *argv) {
+  using vm::unserialize::package;
+  using vm::unserialize::data;
+  
+  // Stats from rendering the input as one block are written as {uniformTiles skippedOps}.
+  return evalTest(argc, argv, package, data, data, [](vm::Package package, vm::Data const &params) {
+    Arena arena;
+    auto linked = vm::link(&package, &arena);
+    
+    vm::Context context(&linked);
+    vm::Data result(params.type, params.sampleCount());
+    
+    context.render(Symbol::get("main"), (float const *)params.values.data(), (float *)result.values.data(), params.sampleCount());
+    
+    auto stats = context.getStats();
+    std::vector<vm::Data::Value> values = {(float)stats.uniformTiles, (float)stats.skippedOps};
+    
+    return vm::Data(vm::Data::F32Value, values.begin(), values.end());
+  });
+}
@@ -0,0 +1,14 @@
+#include "VMStackDepth.hpp"
+#include "SerializeInstruction.hpp"
+#include "SerializeData.hpp"
+#include "GivenExpectTest.hpp"
+
+int main(int argc, char const *const *argv) {
+  // Depths are written as a vector of {scalars vectors calls}.
+  return givenExpectTest(argc, argv, vm::unserialize::package, vm::unserialize::data, [&](vm::Package package) -> vm::Data {
+    auto depth = vm::stackDepth(&package, Symbol::get("main"));
+    std::vector<vm::Data::Value> values = {(float)depth.scalars, (float)depth.vectors, (float)depth.calls};
+    
+    return vm::Data(vm::Data::F32Value, values.begin(), values.end());
+  });
+}
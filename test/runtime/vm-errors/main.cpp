@@ -0,0 +1,34 @@
+#include "VMEval.hpp"
+#include "VMLink.hpp"
+#include "SerializeInstruction.hpp"
+#include "SerializeData.hpp"
+#include "EvalTest.hpp"
+
+int main(int argc, char const *const *argv) {
+  using vm::unserialize::package;
+  using vm::unserialize::data;
+  
+  // Results are written as {1} for each dispatch whose render of "main" throws, {0} for
+  // each that doesn't, in the order {switch threaded closure jit}.
+  return evalTest(argc, argv, package, data, data, [](vm::Package package, vm::Data const &params) {
+    Arena arena;
+    auto linked = vm::link(&package, &arena);
+    
+    std::vector<vm::Data::Value> values;
+    
+    for (auto dispatch : {vm::SwitchDispatch, vm::ThreadedDispatch, vm::ClosureDispatch, vm::JitDispatch}) {
+      vm::Context context(&linked, vm::AutoStackSize, dispatch);
+      vm::Data result(params.type, params.sampleCount());
+      
+      try {
+        context.render(Symbol::get("main"), (float const *)params.values.data(), (float *)result.values.data(), params.sampleCount());
+        values.push_back(0.0f);
+        
+      } catch (std::runtime_error const &err) {
+        values.push_back(1.0f);
+      }
+    }
+    
+    return vm::Data(vm::Data::F32Value, values.begin(), values.end());
+  });
+}
@@ -1,4 +1,7 @@
 #include "VMEval.hpp"
+#include "VMJit.hpp"
+#include "VMLink.hpp"
+#include "VMVerify.hpp"
 #include "SerializeInstruction.hpp"
 #include "SerializeData.hpp"
 #include "EvalTest.hpp"
@@ -7,7 +10,55 @@ int main(int argc, char const *const *argv) {
   using vm::unserialize::package;
   using vm::unserialize::data;
   
-  return evalTest(argc, argv, package, data, data, [](vm::Package package, vm::Data const &params) {
-    return vm::eval(&package, Symbol::get("main"), params);
-  });
+  int status = 0;
+  
+  for (auto dispatch : {vm::SwitchDispatch, vm::ThreadedDispatch, vm::ClosureDispatch, vm::JitDispatch}) {
+    status |= evalTest(argc, argv, package, data, data, [dispatch](vm::Package package, vm::Data const &params) {
+      return vm::eval(&package, Symbol::get("main"), params, 16 * 1024, dispatch);
+    });
+    
+    // Render each block twice through the same context, to check that it can be reused, with
+    // stacks sized exactly for the package.
+    status |= evalTest(argc, argv, package, data, data, [dispatch](vm::Package package, vm::Data const &params) {
+      Arena arena;
+      auto linked = vm::link(&package, &arena);
+      
+      vm::Context context(&linked, vm::AutoStackSize, dispatch);
+      vm::Data result(params.type, params.sampleCount());
+      
+      // Every example should compile, so that the JIT is checked against the interpreter.
+      if (dispatch == vm::JitDispatch && vm::jit::isHostSupported() && context.getDispatch() != vm::JitDispatch) {
+        throw std::runtime_error("JIT fell back to the interpreter");
+      }
+      
+      // Likewise, every example should verify, so that the interpreters are also checked
+      // without the VM state's assertions.
+      if ((dispatch == vm::SwitchDispatch || dispatch == vm::ThreadedDispatch) && !context.isVerified(Symbol::get("main"))) {
+        vm::verify(&linked, Symbol::get("main"));
+      }
+      
+      for (int i = 0; i < 2; ++i) {
+        context.render(Symbol::get("main"), (float const *)params.values.data(), (float *)result.values.data(), params.sampleCount());
+      }
+      
+      return result;
+    });
+    
+    // Render in tiles chosen for the package, and in the smallest possible tiles so that
+    // multi-tile blocks end with a partial tile.
+    for (uint32_t tileSamples : {vm::AutoTileSize, 1u}) {
+      status |= evalTest(argc, argv, package, data, data, [dispatch, tileSamples](vm::Package package, vm::Data const &params) {
+        Arena arena;
+        auto linked = vm::link(&package, &arena);
+        
+        vm::Context context(&linked, 1024, dispatch, false, tileSamples);
+        vm::Data result(params.type, params.sampleCount());
+        
+        context.render(Symbol::get("main"), (float const *)params.values.data(), (float *)result.values.data(), params.sampleCount());
+        return result;
+      });
+    }
+  }
+  
+  return status;
 }
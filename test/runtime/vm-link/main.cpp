@@ -0,0 +1,11 @@
+#include "SerializeInstruction.hpp"
+#include "VMLink.hpp"
+#include "GivenExpectTest.hpp"
+
+int main(int argc, char const *const *argv) {
+  Arena arena;
+  
+  return givenExpectTest(argc, argv, vm::unserialize::package, vm::unserialize::package, [&](vm::Package source) -> vm::Package {
+    return vm::link(&source, &arena);
+  });
+}
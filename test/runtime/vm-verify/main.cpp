@@ -0,0 +1,21 @@
+#include "VMVerify.hpp"
+#include "VMLink.hpp"
+#include "SerializeInstruction.hpp"
+#include "SerializeData.hpp"
+#include "GivenExpectTest.hpp"
+
+int main(int argc, char const *const *argv) {
+  // Results are written as {1} if "main" verifies, {0} if it doesn't.
+  return givenExpectTest(argc, argv, vm::unserialize::package, vm::unserialize::data, [&](vm::Package package) -> vm::Data {
+    Arena arena;
+    auto linked = vm::link(&package, &arena);
+    
+    try {
+      vm::verify(&linked, Symbol::get("main"));
+      return vm::Data(vm::Data::F32Value, vm::Data::Value(1.0f));
+      
+    } catch (std::runtime_error const &err) {
+      return vm::Data(vm::Data::F32Value, vm::Data::Value(0.0f));
+    }
+  });
+}